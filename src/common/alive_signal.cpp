@@ -0,0 +1,68 @@
+#include "common/alive_signal.h"
+
+#include <Arduino.h>
+#include <Ticker.h>
+
+#include "common/globals.h"
+#include "common/shared_state.h"
+
+/*
+  The flash pattern is played by a Ticker (esp_timer on ESP32, os_timer on ESP8266),
+  so the loop never sleeps for it.
+  Pattern: 5 flashes, each 60ms on and 40ms off, one step every aliveSignalTickMillis.
+*/
+const uint8_t aliveSignalTickMillis = 20;
+const uint8_t aliveSignalOnTicks = 3;  // 60ms
+const uint8_t aliveSignalOffTicks = 2; // 40ms
+const uint8_t aliveSignalFlashes = 5;
+
+Ticker aliveSignalTicker;
+volatile uint8_t aliveSignalTick = 0;
+volatile bool aliveSignalRunning = false;
+
+void setAliveLed(bool on)
+{
+    // NodeMCU boards: LOW = LED ON (inverted logic)
+    digitalWrite(integratedLEDPin, on != integratedLEDInvertedLogic ? HIGH : LOW);
+}
+
+void aliveSignalStep()
+{
+    const uint8_t flashTicks = aliveSignalOnTicks + aliveSignalOffTicks;
+    if (aliveSignalTick >= aliveSignalFlashes * flashTicks)
+    {
+        setAliveLed(false);
+        aliveSignalTicker.detach();
+        aliveSignalRunning = false;
+        return;
+    }
+
+    setAliveLed(aliveSignalTick % flashTicks < aliveSignalOnTicks);
+    aliveSignalTick = aliveSignalTick + 1;
+}
+
+void setupAliveSignal()
+{
+    pinMode(integratedLEDPin, OUTPUT);
+    setAliveLed(false); // Start with LED off
+}
+
+/**
+ * Starts one flash sequence and returns immediately.
+ * Does nothing if the alive signal is disabled in device configuration.
+ */
+void startAliveSignalFlash()
+{
+    bool aliveSignalEnabled;
+    {
+        SharedStateLock lock;
+        aliveSignalEnabled = currentDeviceConfiguration && currentDeviceConfiguration->isAliveSignalEnabled;
+    }
+    if (!aliveSignalEnabled || aliveSignalRunning)
+        return;
+
+    aliveSignalRunning = true;
+    aliveSignalTick = 0;
+    aliveSignalStep();
+    aliveSignalTicker.attach_ms(aliveSignalTickMillis, aliveSignalStep);
+}
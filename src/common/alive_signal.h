@@ -0,0 +1,7 @@
+#ifndef ALIVE_SIGNAL_H
+#define ALIVE_SIGNAL_H
+
+void setupAliveSignal();
+void startAliveSignalFlash();
+
+#endif // ALIVE_SIGNAL_H
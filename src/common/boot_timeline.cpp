@@ -0,0 +1,80 @@
+#include "common/boot_timeline.h"
+
+#include <ArduinoJson.h>
+
+#include "common/globals.h"
+#include "common/reset_breadcrumbs.h"
+#include "common/utils.h"
+
+// Milliseconds since chip boot at which each phase was first reached, 0 if not reached yet
+uint32_t bootPhaseTimestamps[BOOT_PHASE_COUNT] = {0};
+
+/**
+ * Records the time a phase is reached. Only the first call per phase counts.
+ */
+void markBootPhase(BootPhase phase)
+{
+    if (phase >= BOOT_PHASE_COUNT || bootPhaseTimestamps[phase] != 0)
+        return;
+    // never store 0, which means "not reached"
+    bootPhaseTimestamps[phase] = std::max<uint32_t>(monotonicMillis(), 1);
+    recordBootPhaseBreadcrumb(phase, bootPhaseTimestamps[phase]);
+}
+
+uint32_t bootPhaseMillis(BootPhase phase)
+{
+    return phase < BOOT_PHASE_COUNT ? bootPhaseTimestamps[phase] : 0;
+}
+
+const char *bootPhaseName(BootPhase phase)
+{
+    switch (phase)
+    {
+    case BOOT_PHASE_SETUP_START:
+        return "setupStart";
+    case BOOT_PHASE_CONFIG_READ:
+        return "configRead";
+    case BOOT_PHASE_NETWORK_UP:
+        return "networkUp";
+    case BOOT_PHASE_SERVER_STARTED:
+        return "serverStarted";
+    case BOOT_PHASE_SETUP_DONE:
+        return "setupDone";
+    case BOOT_PHASE_WIFI_CONNECTED:
+        return "wifiConnected";
+    case BOOT_PHASE_FIRST_REQUEST:
+        return "firstRequest";
+    case BOOT_PHASE_OTA_CHECKED:
+        return "otaChecked";
+    default:
+        return "unknown";
+    }
+}
+
+/**
+ * For each reached phase: time since chip boot, and time since the previous reached phase.
+ */
+String bootTimelineToJson()
+{
+    JsonDocument doc;
+    doc["swVersion"] = SW_VERSION;
+
+    JsonArray phases = doc["phases"].to<JsonArray>();
+    uint32_t previousMillis = 0;
+    for (uint8_t phase = 0; phase < BOOT_PHASE_COUNT; phase++)
+    {
+        uint32_t atMillis = bootPhaseTimestamps[phase];
+        if (atMillis == 0)
+            continue;
+
+        JsonObject jsonPhase = phases.add<JsonObject>();
+        jsonPhase["phase"] = bootPhaseName((BootPhase)phase);
+        jsonPhase["atMillis"] = atMillis;
+        jsonPhase["durationMillis"] = atMillis >= previousMillis ? atMillis - previousMillis : 0;
+        previousMillis = std::max(previousMillis, atMillis);
+    }
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
@@ -0,0 +1,27 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <Arduino.h>
+
+/**
+ * Milestones of the boot pipeline, in the order they are normally reached.
+ */
+enum BootPhase : uint8_t
+{
+    BOOT_PHASE_SETUP_START,    // commonSetup() entered
+    BOOT_PHASE_CONFIG_READ,    // quick restarts and device configuration read
+    BOOT_PHASE_NETWORK_UP,     // WiFi interface started (STA connecting, or AP up)
+    BOOT_PHASE_SERVER_STARTED, // web server listening
+    BOOT_PHASE_SETUP_DONE,     // commonSetup() returned, project setup can run
+    BOOT_PHASE_WIFI_CONNECTED, // STA connection established
+    BOOT_PHASE_FIRST_REQUEST,  // first HTTP request received
+    BOOT_PHASE_OTA_CHECKED,    // deferred firmware update check done
+    BOOT_PHASE_COUNT
+};
+
+void markBootPhase(BootPhase phase);
+uint32_t bootPhaseMillis(BootPhase phase);
+const char *bootPhaseName(BootPhase phase);
+String bootTimelineToJson();
+
+#endif // BOOT_TIMELINE_H
@@ -7,6 +7,7 @@ const uint8_t integratedLEDPin = 2; // NodeMCU-32S has built-in LED on GPIO2
 #elif defined(ESP8266)
 const uint8_t integratedLEDPin = 2;
 #endif
+const bool integratedLEDInvertedLogic = true; // LOW = LED ON
 const uint ledFlashMinInterval = 4000;
 
 // Firmware
@@ -23,6 +24,7 @@ const int watchdogTimeout_s = 45; // 45s (increased for slow WiFi connections)
 const uint8_t bootLoopModeMinCount = 5;
 const uint16_t quickRestarMaxDurationMillis = 50 * 1000;   // 50s (must be > watchdog)
 const uint32_t configModeCheckEveryMillis = 2 * 60 * 1000; // 2m
+const uint32_t restartReplyDelayMillis = 3000;              // requested restarts wait for the reply to be sent
 uint8_t minQuickRestartCountToEnterConfigMode = 2;
 
 // Wifi
@@ -32,5 +34,32 @@ const uint32_t wifiConnectionStatusCheckMillis = 3 * 60 * 1000; // 3m
 const uint16_t wifiConnectionMaxMillis = 12 * 1000;             // 12s
 const IPAddress dns(8, 8, 8, 8);                                // Google's DNS
 
+// Logs
+const uint32_t logDrainIntervalMillis = 10; // at 115200 baud, 10ms fill the UART FIFO (128 bytes)
+const uint32_t logWebsocketFlushIntervalMillis = 100; // lines drained meanwhile go out as one frame per client
+const uint32_t logSyslogFlushIntervalMillis = 250;     // at most one datagram to the log collector per interval
+const uint32_t logFileFlushIntervalMillis = 100;       // whole pieces of the log file buffer written, compression steps
+const uint32_t logFileSyncIntervalMillis = 60 * 1000;  // lines survive a reset at most that long after they are logged
+const uint32_t vccLogIntervalMillis = 5000;
+
+// EEPROM
+const uint32_t eepromCommitDelayMillis = 5 * 1000; // deferred commits coalesce the writes made meanwhile
+const uint32_t counterCommitDelayMillis = 60 * 1000; // counter increments lost on a reset at most that old, see counter_store.h
+const uint32_t uptimeCounterIntervalMillis = 60 * 60 * 1000; // COUNTER_UPTIME_HOURS resolution
+
 // Ram Stats
-uint64_t ramStatsUpdateIntervalMillis = 30000;
\ No newline at end of file
+uint64_t ramStatsUpdateIntervalMillis = 30000;
+
+// Power Monitor
+const uint32_t vccCheckIntervalMillis = 1000;
+
+// OTA
+const uint32_t checkForSoftwareUpdateMillis = 60 * 60 * 1000; // check for software update every 1 hour
+const uint32_t otaBootCheckDelayMillis = 60 * 1000;            // first check after boot, past the quick restart window
+const uint32_t otaBootCheckRetryMillis = 10 * 1000;            // retry while WiFi is still connecting
+
+// Housekeeping task (ESP32, with HOUSEKEEPING_TASK)
+const uint8_t housekeepingTaskCore = 0;            // Arduino loop runs on core 1
+const uint8_t housekeepingTaskPriority = 1;        // same as the Arduino loop task
+const uint32_t housekeepingTaskStackSize = 8192;   // TLS handshakes of the OTA check need a large stack
+const uint32_t housekeepingMaxIdleMillis = 100;    // upper bound between housekeeping passes
\ No newline at end of file
@@ -1,28 +1,207 @@
+#define LOG_MODULE LOG_MODULE_MAIN
+
 #include <Arduino.h>
 
 #ifdef ESP32
 #include <esp_task_wdt.h>
 #include <esp_sleep.h>
+#include <WiFi.h>
 #elif defined(ESP8266)
-//
+#include <ESP8266WiFi.h>
 #endif
 
+#include "common/alive_signal.h"
+#include "common/boot_timeline.h"
+#include "common/counter_store.h"
 #include "common/device_configuration.h"
-#include "common/eeprom_utils.tpp"
+#include "common/eeprom_layout.h"
+#include "common/eeprom_session.h"
 #include "common/globals.h"
+#include "common/log_file.h"
+#include "common/log_syslog.h"
+#include "common/log_websocket.h"
+#include "common/loop_profiler.h"
 #include "common/ota_handler.h"
 #include "common/power_monitor.h"
+#include "common/reset_breadcrumbs.h"
+#include "common/scheduler.h"
 #include "common/server_handler.h"
+#include "common/shared_state.h"
 #include "common/wifi_handler.h"
 
-uint64_t lastLedFlashMillis = 0;
-
 uint8_t quickRestartsCount;
-bool configMode = false;
-bool bootLoopMode = false;
-uint64_t configModeLastCheckMillis = 0;
+std::atomic<bool> configMode(false);
+std::atomic<bool> bootLoopMode(false);
 ESPGithubOtaUpdate *updater = nullptr;
 
+// Result of the last housekeeping pass, see commonLoop()
+std::atomic<uint8_t> commonStatus(0);
+
+uint8_t runHousekeeping();
+
+#if defined(ESP32) && defined(HOUSEKEEPING_TASK)
+TaskHandle_t housekeepingTaskHandle = nullptr;
+
+/**
+ * Runs common housekeeping on its own task, pinned to housekeepingTaskCore,
+ * so network checks and OTA downloads never stall the application loop.
+ */
+void housekeepingTask(void *)
+{
+    esp_task_wdt_add(NULL);
+    while (true)
+    {
+        runHousekeeping();
+        uint32_t idleMillis = std::min<uint32_t>(housekeepingMaxIdleMillis, scheduler.millisUntilNextDeadline());
+        vTaskDelay(pdMS_TO_TICKS(std::max<uint32_t>(idleMillis, 1)));
+    }
+}
+
+void startHousekeepingTask()
+{
+    xTaskCreatePinnedToCore(housekeepingTask, "housekeeping", housekeepingTaskStackSize, nullptr,
+                            housekeepingTaskPriority, &housekeepingTaskHandle, housekeepingTaskCore);
+}
+#endif
+
+/**
+ * Check if in config mode but a valid configuration is found.
+ * This covers the case where connection to WiFI was temporarily unsuccessful
+ * but the configuration is valid so the rest of the code can be executed
+ */
+void recheckConfigMode()
+{
+    if (!configMode || bootLoopMode)
+        return;
+
+    if (readDeviceConfigurationFromEeprom())
+    {
+        // Back to config mode if the connection fails, see restartWifi()
+        LOG_PRINTLN("Got valid configuration, connecting to wifi.");
+        configMode = false;
+        restartWifi();
+    }
+}
+
+TaskId otaCheckTask = INVALID_TASK_ID;
+
+/**
+ * Checks for a software update, and performs it if one is found.
+ * While WiFi is still connecting, the check is retried shortly instead of waiting a full period.
+ */
+void runOtaCheck()
+{
+    if (configMode)
+        return;
+
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        scheduler.reschedule(otaCheckTask, otaBootCheckRetryMillis);
+        return;
+    }
+
+    updater->checkForSoftwareUpdate();
+    markBootPhase(BOOT_PHASE_OTA_CHECKED);
+}
+
+/**
+ * From any task, typically the web server's: the check runs on the housekeeping task, now.
+ */
+void requestOtaCheck()
+{
+    scheduler.reschedule(otaCheckTask, 0);
+}
+
+TaskId restartTask = INVALID_TASK_ID; // guarded by SharedStateLock
+
+/**
+ * From any task, typically the web server's: the restart happens on the housekeeping task,
+ * delayMillis later so that the reply gets out, once the deferred writes are committed and
+ * the logs flushed. The first request wins.
+ */
+void requestRestart(uint32_t delayMillis)
+{
+    SharedStateLock lock;
+    if (restartTask != INVALID_TASK_ID)
+        return;
+    restartTask = scheduler.scheduleOnce("restart", delayMillis, []()
+                                         {
+        eepromSession.commit(); // don't lose deferred writes
+        flushLogs();
+        ESP.restart(); });
+}
+
+/**
+ * Registers the periodic housekeeping with the scheduler, so that commonLoop() only runs what is due.
+ */
+void scheduleHousekeepingTasks()
+{
+    scheduler.scheduleEvery("logDrain", logDrainIntervalMillis, []()
+                            {
+        PROFILE_STAGE(STAGE_LOG_DRAIN);
+        drainLogs(); });
+
+    scheduler.scheduleEvery("logWebsocket", logWebsocketFlushIntervalMillis, []()
+                            {
+        PROFILE_STAGE(STAGE_LOG_WEBSOCKET);
+        flushLogWebsocket(); });
+
+    scheduler.scheduleEvery("logSyslog", logSyslogFlushIntervalMillis, []()
+                            {
+        PROFILE_STAGE(STAGE_LOG_SYSLOG);
+        flushLogSyslog(); });
+
+#if LOG_FILE
+    scheduler.scheduleEvery("logFile", logFileFlushIntervalMillis, []()
+                            {
+        PROFILE_STAGE(STAGE_LOG_FILE);
+        flushLogFile(); });
+#endif
+
+    scheduler.scheduleEvery("vcc", vccCheckIntervalMillis, []()
+                            {
+        PROFILE_STAGE(STAGE_VCC);
+        logVCC(); });
+
+    scheduler.scheduleEvery("aliveLed", ledFlashMinInterval, []()
+                            {
+        PROFILE_STAGE(STAGE_ALIVE_LED);
+        startAliveSignalFlash(); }, ledFlashMinInterval);
+
+    // - reset the quick restart counter once the device has been up long enough
+    scheduler.scheduleOnce("quickRestarts", quickRestarMaxDurationMillis, []()
+                           {
+        PROFILE_STAGE(STAGE_QUICK_RESTARTS);
+        saveQuickRestarts(false);
+        quickRestartsCount = 0; });
+
+    scheduler.scheduleEvery("configMode", configModeCheckEveryMillis, []()
+                            {
+        PROFILE_STAGE(STAGE_CONFIG_MODE);
+        recheckConfigMode(); }, configModeCheckEveryMillis);
+
+    scheduler.scheduleEvery("wifiCheck", wifiConnectionStatusCheckMillis, []()
+                            {
+        PROFILE_STAGE(STAGE_WIFI_CHECK);
+        checkWiFiConnection(); }, wifiConnectionStatusCheckMillis);
+
+    // - ota software updates, first check deferred off the boot path
+    otaCheckTask = scheduler.scheduleEvery("otaCheck", checkForSoftwareUpdateMillis, []()
+                                           {
+        PROFILE_STAGE(STAGE_OTA_CHECK);
+        runOtaCheck(); }, otaBootCheckDelayMillis);
+
+    // - persistent counters
+    scheduler.scheduleEvery("uptimeCounter", uptimeCounterIntervalMillis, []()
+                            { persistentCounters.add(COUNTER_UPTIME_HOURS); }, uptimeCounterIntervalMillis);
+
+    // Ram Stats
+    scheduler.scheduleEvery("memoryStats", ramStatsUpdateIntervalMillis, []()
+                            {
+        PROFILE_STAGE(STAGE_MEMORY_STATS);
+        updateMemoryStats(); });
+}
+
 void commonSetup()
 {
 // Enable software Watchdog
@@ -34,28 +213,32 @@ void commonSetup()
     ESP.wdtEnable(WDTO_8S);
 #endif
 
-    checkResetCause();
+    loadResetBreadcrumbs();
+    markBootPhase(BOOT_PHASE_SETUP_START);
     logVCC();
 
-    pinMode(integratedLEDPin, OUTPUT);
-    digitalWrite(integratedLEDPin, HIGH); // Start with LED off (inverted logic on NodeMCU-32S)
+    setupAliveSignal();
 
     Serial.begin(115200);
     LOG_PRINTLN(F("==============\n== Welcome! ==\n=============="));
+    checkResetCause();
+    logResetBreadcrumbs();
+#if LOG_FILE
+    beginLogFile();
+#endif
 
-    // init EEPROM addresses
-    JUST_RESTARTED_EEPROM_ADDR = 0;
-    DEVICE_CONFIGURATION_EEPROM_ADDR = nextEepromSlot<QuickRestarts>(JUST_RESTARTED_EEPROM_ADDR);
+    importLegacyEepromLayout();
+    persistentCounters.begin(CommonEepromLayout::address<CounterSnapshot>());
 
     // Check whether it's a quick restart or the device config is not valid
-    quickRestartsCount = readQuickRestartsFromEeprom();
+    quickRestartsCount = readQuickRestarts();
     readDeviceConfigurationFromEeprom();
     if (quickRestartsCount > minQuickRestartCountToEnterConfigMode || !currentDeviceConfiguration)
     {
         configMode = true;
         if (quickRestartsCount >= bootLoopModeMinCount)
         {
-            DEBUG_PRINTLN("Entering bootLoopMode as quickRestartCount = " + String(quickRestartsCount));
+            LOGF_DEBUG("Entering bootLoopMode as quickRestartCount = %u", quickRestartsCount);
             bootLoopMode = true;
         }
     }
@@ -66,129 +249,96 @@ void commonSetup()
     }
 
     // Quick Restart
-    saveQuickRestartsToEeprom(true);
-
-    // Feed watchdog before WiFi setup (can take 30+ seconds on slow networks)
-    LOG_PRINTLN("Feeding watchdog before WiFi connection...");
-#ifdef ESP32
-    esp_task_wdt_reset();
-#elif defined(ESP8266)
-    ESP.wdtFeed();
-#endif
+    saveQuickRestarts(true);
+    markBootPhase(BOOT_PHASE_CONFIG_READ);
 
-    // Wifi setup
-    if (!setupWifi())
-    {
-        configMode = true;
-        setupWifi();  // Enter AP mode after failed STA connection
-    }
+    // Wifi setup: the STA connection completes in the background (see beginWifi()),
+    // falling back to config mode (AP) if it fails
+    beginWifi();
+    markBootPhase(BOOT_PHASE_NETWORK_UP);
 
     // Server setup
     setupServer();
+    markBootPhase(BOOT_PHASE_SERVER_STARTED);
 
-    // OTA Updater
-    updater = new ESPGithubOtaUpdate(SW_VERSION, BINARY_NAME, releaseRepo, currentDeviceConfiguration->githubAuthToken);
+    // OTA Updater, the first check is run by the scheduler (see runOtaCheck())
+    updater = new ESPGithubOtaUpdate(SW_VERSION, BINARY_NAME, releaseRepo, githubAuthTokenStorage());
     updater->registerFirmwareUploadRoutes(webServer, &routeDescriptions);
-    if (!configMode)
-        updater->upgradeSoftware(); // Check and perform upgrade on startup
 
-    LOG_PRINTLN("SW_VERSION: " + String(SW_VERSION));
+    scheduleHousekeepingTasks();
+    commonStatus = bootLoopMode ? 2 : configMode ? 1 : 0;
+#if defined(ESP32) && defined(HOUSEKEEPING_TASK)
+    startHousekeepingTask();
+#endif
+
+    LOGF_INFO("SW_VERSION: %s", SW_VERSION);
     LOG_PRINTLN("Common setup complete");
+    flushLogs(); // setup logs more than the ring holds at once
+    markBootPhase(BOOT_PHASE_SETUP_DONE);
 }
 
 /**
  * Performs all housekeeping operations.
- * To allow caller to avoid running code other than basic functionality to setup device,
- * Returns
- * - 2 if device is in boot loop mode
- * - 1 if device is in config mode
- * - 0 if fully configured and running
+ * Periodic housekeeping is run by the scheduler, only when due;
+ * use scheduler.millisUntilNextDeadline() to know how long the caller may idle.
+ * Returns the same status as commonLoop().
  */
-uint8_t commonLoop()
+uint8_t runHousekeeping()
 {
-    // Housekeeping //
+    PROFILE_LOOP_START();
 
-    // - Watchdog
-#ifdef ESP32
-    esp_task_wdt_reset();
-#elif defined(ESP8266)
-    ESP.wdtFeed();
-#endif
-
-    // Power Monitor
-    logVCC();
-
-    // LED flash - only if enabled in device configuration
-    bool aliveSignalEnabled = currentDeviceConfiguration && currentDeviceConfiguration->isAliveSignalEnabled;
-    if (aliveSignalEnabled && millis() - lastLedFlashMillis > ledFlashMinInterval)
+    // Housekeeping //
     {
-        lastLedFlashMillis = millis();
+        PROFILE_STAGE(STAGE_HOUSEKEEPING);
 
+        // - Watchdog
+        {
+            PROFILE_STAGE(STAGE_WATCHDOG);
 #ifdef ESP32
-        // Flush any pending serial data BEFORE LED operations to prevent corruption
-        Serial.flush();
+            esp_task_wdt_reset();
+#elif defined(ESP8266)
+            ESP.wdtFeed();
 #endif
+        }
 
-        // Flash LED
-        for (int i = 0; i < 5; i++)
+        // - wifi and server
         {
-            digitalWrite(integratedLEDPin, LOW);  // NodeMCU-32S: LOW = LED ON (inverted logic)
-            delay(60);
-            digitalWrite(integratedLEDPin, HIGH); // NodeMCU-32S: HIGH = LED OFF (inverted logic)
-            delay(40);
+            PROFILE_STAGE(STAGE_WIFI);
+            loopWiFi();
+            loopServer();
         }
 
-#ifdef ESP32
-        // Restore UART TX pin and wait for stabilization before any serial output
-        gpio_matrix_out(GPIO_NUM_1, U0TXD_OUT_IDX, false, false);
-        delay(1);  // 1ms delay for full UART stabilization
-#endif
-
-        // Print AFTER LED flash and UART restoration
-        Serial.println("Alive signal flash LED: done");
-    }
-
-    // - check if just restarted
-    if (quickRestartsCount > 0 && millis() > quickRestarMaxDurationMillis)
-    {
-        saveQuickRestartsToEeprom(false);
-        quickRestartsCount = 0;
-    }
-    // - check if in config mode but a valid configuration is found.
-    // This covers the case where connection to WiFI was temporarily unsuccessful
-    // but the configuration is valid so the rest of the code can be executed
-    if (configMode && !bootLoopMode && millis() - configModeLastCheckMillis > configModeCheckEveryMillis)
-    {
-        configModeLastCheckMillis = millis();
-        if (readDeviceConfigurationFromEeprom())
+        // - firmware upload server
         {
-            if (setupWifi())
-            {
-                configMode = false;
-                LOG_PRINTLN("Got valid configuration and connected to wifi.");
-                // delay(500);
-                // ESP.restart();
-            }
+            PROFILE_STAGE(STAGE_OTA);
+            updater->loop();
         }
-    }
 
-    // - wifi and server
-    loopWiFi();
-    loopServer();
-
-    // - ota software updates
-    if (!configMode)
-    {
-        updater->checkForSoftwareUpdate();
+        // - periodic tasks
+        scheduler.runDueTasks();
     }
+    // End of Housekeeping //
 
-    // Ram Stats
-    updateMemoryStats();
+    uint8_t status = bootLoopMode ? 2 : configMode ? 1 : 0;
+    commonStatus = status;
+    return status;
+}
 
-    if (bootLoopMode)
-        return 2;
-    if (configMode)
-        return 1;
-    return 0;
-    // End of Housekeeping //
-}
\ No newline at end of file
+/**
+ * To allow caller to avoid running code other than basic functionality to setup device,
+ * Returns
+ * - 2 if device is in boot loop mode
+ * - 1 if device is in config mode
+ * - 0 if fully configured and running
+ * With HOUSEKEEPING_TASK on ESP32, housekeeping runs on its own task and this only
+ * feeds the caller's watchdog and returns the last published status, without blocking.
+ */
+uint8_t commonLoop()
+{
+#if defined(ESP32) && defined(HOUSEKEEPING_TASK)
+    esp_task_wdt_reset();
+    return commonStatus;
+#else
+    return runHousekeeping();
+#endif
+}
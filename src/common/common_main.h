@@ -1,7 +1,11 @@
 #ifndef COMMON_MAIN_H
 #define COMMON_MAIN_H
 
+#include <stdint.h>
+
 void commonSetup();
 uint8_t commonLoop();
+void requestRestart(uint32_t delayMillis);
+void requestOtaCheck();
 
 #endif //COMMON_MAIN_H
\ No newline at end of file
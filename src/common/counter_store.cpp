@@ -0,0 +1,301 @@
+#define LOG_MODULE LOG_MODULE_STORAGE
+
+#include "common/counter_store.h"
+
+#include <ArduinoJson.h>
+
+#include "common/eeprom_utils.tpp"
+#include "common/globals.h"
+#include "common/shared_state.h"
+
+CounterStore persistentCounters;
+
+uint8_t counterLogEntryCheck(const CounterLogEntry &entry)
+{
+    return entry.counterId ^ (entry.delta & 0xFF) ^ (entry.delta >> 8) ^ 0xA5;
+}
+
+#ifdef COUNTER_LOG_PARTITION
+const uint32_t counterLogMagic = 0x434E5452; // "CNTR"
+
+// Defined out of line too: toJson() hands it to ArduinoJson by reference
+const uint16_t PartitionCounterLog::sectorEntries;
+
+uint32_t counterLogHeaderCrc(const CounterLogSectorHeader &header)
+{
+    return crc32Update(0, reinterpret_cast<const uint8_t *>(&header), offsetof(CounterLogSectorHeader, crc));
+}
+
+/**
+ * Picks the valid sector with the highest sequence. Fails if there is no such partition.
+ */
+bool PartitionCounterLog::begin(const char *label)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)PartitionStorageBackend::partitionSubtype, label);
+    uint32_t partitionSectors = partition != nullptr ? partition->size / SPI_FLASH_SEC_SIZE : 0;
+    // Same condition as PartitionStorageBackend::begin(), which leaves these sectors to the log
+    if (partitionSectors < 2 + PartitionStorageBackend::counterLogSectors)
+    {
+        partition = nullptr;
+        return false;
+    }
+    firstSectorOffset = (partitionSectors - PartitionStorageBackend::counterLogSectors) * SPI_FLASH_SEC_SIZE;
+
+    activeSector = 0;
+    sequence = 0;
+    usedEntries = 0;
+    for (uint8_t sector = 0; sector < PartitionStorageBackend::counterLogSectors; sector++)
+    {
+        CounterLogSectorHeader header;
+        if (esp_partition_read(partition, sectorOffset(sector), &header, sizeof(header)) != ESP_OK)
+            continue;
+        if (header.magic != counterLogMagic || header.sequence <= sequence || header.crc != counterLogHeaderCrc(header))
+            continue; // blank, torn rotation, or the journal of earlier firmware
+        activeSector = sector;
+        sequence = header.sequence;
+    }
+    return true;
+}
+
+/**
+ * Replays the active sector into values. Fails if no sector is valid.
+ */
+bool PartitionCounterLog::load(uint32_t *values)
+{
+    if (sequence == 0)
+        return false;
+    CounterLogSectorHeader header;
+    if (esp_partition_read(partition, sectorOffset(activeSector), &header, sizeof(header)) != ESP_OK)
+        return false;
+    memcpy(values, header.values, sizeof(header.values));
+
+    // Read in chunks, a flash read each
+    CounterLogEntry entries[32];
+    size_t entriesOffset = sectorOffset(activeSector) + sizeof(header);
+    for (usedEntries = 0; usedEntries < sectorEntries; usedEntries++)
+    {
+        uint8_t chunkEntry = usedEntries % 32;
+        if (chunkEntry == 0 &&
+            esp_partition_read(partition, entriesOffset + usedEntries * sizeof(CounterLogEntry), entries,
+                               std::min<size_t>(32, sectorEntries - usedEntries) * sizeof(CounterLogEntry)) != ESP_OK)
+            return false;
+        const CounterLogEntry &entry = entries[chunkEntry];
+        if (entry.counterId == 0xFF && entry.delta == 0xFFFF && entry.check == 0xFF)
+            break; // erased: the end of the log
+        if (entry.counterId < COUNTER_COUNT && entry.check == counterLogEntryCheck(entry))
+            values[entry.counterId] += entry.delta;
+        // else torn by a power cut, its slot stays used
+    }
+    return true;
+}
+
+/**
+ * Programs entry after the last one. values, which already count it, start the other sector
+ * when the active one is full.
+ */
+bool PartitionCounterLog::append(const CounterLogEntry &entry, const uint32_t *values)
+{
+    if (sequence == 0 || usedEntries == sectorEntries)
+        return rotate(values);
+    size_t offset = sectorOffset(activeSector) + sizeof(CounterLogSectorHeader) + usedEntries * sizeof(CounterLogEntry);
+    // Used even if the write fails: the slot may be partly programmed
+    usedEntries++;
+    return esp_partition_write(partition, offset, &entry, sizeof(entry)) == ESP_OK;
+}
+
+/**
+ * Erases the other sector and starts it with values. The active sector stays valid until the
+ * header is programmed.
+ */
+bool PartitionCounterLog::rotate(const uint32_t *values)
+{
+    uint8_t nextSector = sequence == 0 ? 0 : (activeSector + 1) % PartitionStorageBackend::counterLogSectors;
+    CounterLogSectorHeader header;
+    header.magic = counterLogMagic;
+    header.sequence = sequence + 1;
+    memcpy(header.values, values, sizeof(header.values));
+    header.crc = counterLogHeaderCrc(header);
+    if (esp_partition_erase_range(partition, sectorOffset(nextSector), SPI_FLASH_SEC_SIZE) != ESP_OK ||
+        esp_partition_write(partition, sectorOffset(nextSector), &header, sizeof(header)) != ESP_OK)
+        return false;
+
+    activeSector = nextSector;
+    sequence = header.sequence;
+    usedEntries = 0;
+    rotations++;
+    return true;
+}
+#endif
+
+int CounterStore::entryAddress(uint8_t entry) const
+{
+    return address + sizeof(RecordHeader) + sizeof(CounterSnapshot) + entry * sizeof(CounterLogEntry);
+}
+
+/**
+ * Loads the snapshot, then replays the log into the RAM index. With the partition counter log,
+ * the record is only read once, to carry its values over into the log.
+ */
+void CounterStore::begin(int eepromAddress)
+{
+    SharedStateLock lock;
+    address = eepromAddress;
+    memset(values, 0, sizeof(values));
+    logEntries = 0;
+
+#ifdef COUNTER_LOG_PARTITION
+    if (partitionLog.begin("config") && partitionLog.load(values))
+        return;
+#endif
+
+    CounterSnapshot snapshot;
+    bool valid = readDataFromEeprom(address, snapshot);
+    if (valid)
+    {
+        memcpy(values, snapshot.values, sizeof(values));
+        for (; logEntries < COUNTER_LOG_ENTRIES; logEntries++)
+        {
+            CounterLogEntry entry;
+            eepromSession.get(entryAddress(logEntries), entry);
+            if (entry.counterId >= COUNTER_COUNT || entry.check != counterLogEntryCheck(entry))
+                break;
+            values[entry.counterId] += entry.delta;
+        }
+    }
+
+#ifdef COUNTER_LOG_PARTITION
+    if (partitionLog.started())
+    {
+        LOG_INFO(F("starting the counter log"));
+        if (!partitionLog.rotate(values))
+            LOG_WARN(F("cannot write the counter log"));
+        return;
+    }
+#endif
+    if (!valid)
+    {
+        LOG_WARN(F("got invalid counters from EEPROM, starting from 0"));
+        compact(EEPROM_COMMIT_DEFERRED);
+    }
+}
+
+/**
+ * Writes the current values as the new snapshot, and frees the log.
+ */
+void CounterStore::compact(EepromCommitMode mode)
+{
+    CounterSnapshot snapshot;
+    memcpy(snapshot.values, values, sizeof(values));
+    writeDataToEeprom<CounterSnapshot>(address, &snapshot, EEPROM_COMMIT_NONE);
+
+    CounterLogEntry freeEntry;
+    memset(&freeEntry, 0xFF, sizeof(freeEntry));
+    for (uint8_t entry = 0; entry < COUNTER_LOG_ENTRIES; entry++)
+        eepromSession.put(entryAddress(entry), freeEntry, EEPROM_COMMIT_NONE);
+    logEntries = 0;
+    compactions++;
+    commit(mode);
+}
+
+/**
+ * Deferred commits wait counterCommitDelayMillis, rather than eepromCommitDelayMillis: the
+ * increments made meanwhile share the commit.
+ */
+void CounterStore::commit(EepromCommitMode mode)
+{
+    if (mode == EEPROM_COMMIT_NOW)
+        eepromSession.commit();
+    else if (mode == EEPROM_COMMIT_DEFERRED && commitTask == INVALID_TASK_ID)
+        commitTask = scheduler.scheduleOnce("counterCommit", counterCommitDelayMillis, [this]()
+                                            {
+            {
+                SharedStateLock lock;
+                commitTask = INVALID_TASK_ID;
+            }
+            eepromSession.commit(); });
+}
+
+/**
+ * Adds delta to a counter. By default the write is committed together with others, see EepromCommitMode.
+ */
+void CounterStore::add(uint8_t counterId, uint16_t delta, EepromCommitMode mode)
+{
+    SharedStateLock lock;
+    if (address < 0 || counterId >= COUNTER_COUNT || delta == 0)
+        return;
+
+    values[counterId] += delta;
+    CounterLogEntry entry;
+    entry.counterId = counterId;
+    entry.delta = delta;
+    entry.check = counterLogEntryCheck(entry);
+
+#ifdef COUNTER_LOG_PARTITION
+    // Written through, whatever mode
+    if (partitionLog.started())
+    {
+        if (!partitionLog.append(entry, values))
+            LOG_WARN(F("cannot write the counter log"));
+        return;
+    }
+#endif
+
+    if (logEntries == COUNTER_LOG_ENTRIES)
+    {
+        compact(mode);
+        return;
+    }
+    eepromSession.put(entryAddress(logEntries++), entry, EEPROM_COMMIT_NONE);
+    commit(mode);
+}
+
+const char *counterName(uint8_t counterId)
+{
+    switch (counterId)
+    {
+    case COUNTER_UPTIME_HOURS:
+        return "uptimeHours";
+    case COUNTER_WIFI_RECONNECTS:
+        return "wifiReconnects";
+    case COUNTER_OTA_ATTEMPTS:
+        return "otaAttempts";
+    default:
+        return nullptr;
+    }
+}
+
+String CounterStore::toJson() const
+{
+    SharedStateLock lock;
+    JsonDocument doc;
+    JsonObject counters = doc["counters"].to<JsonObject>();
+    for (uint8_t counterId = 0; counterId < COUNTER_COUNT; counterId++)
+    {
+        const char *name = counterName(counterId);
+        if (name != nullptr)
+            counters[name] = values[counterId];
+        else
+            counters["counter" + String(counterId)] = values[counterId];
+    }
+#ifdef COUNTER_LOG_PARTITION
+    if (partitionLog.started())
+    {
+        doc["log"] = "partition";
+        doc["logEntries"] = partitionLog.getUsedEntries();
+        doc["logCapacity"] = PartitionCounterLog::sectorEntries;
+        doc["rotations"] = partitionLog.getRotations();
+    }
+    else
+#endif
+    {
+        doc["log"] = "eeprom";
+        doc["logEntries"] = logEntries;
+        doc["logCapacity"] = COUNTER_LOG_ENTRIES;
+        doc["compactions"] = compactions;
+        doc["commitDelayMillis"] = counterCommitDelayMillis;
+    }
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
@@ -0,0 +1,153 @@
+#ifndef COUNTER_STORE_H
+#define COUNTER_STORE_H
+
+#include <Arduino.h>
+
+#include "common/eeprom_session.h"
+#include "common/record_store.h"
+#include "common/scheduler.h"
+#include "common/storage_backend.h"
+
+#if defined(ESP32) && STORAGE_BACKEND == STORAGE_BACKEND_PARTITION
+#define COUNTER_LOG_PARTITION
+#endif
+
+const uint8_t COUNTER_COUNT = 8;
+const uint8_t COUNTER_LOG_ENTRIES = 32;
+
+/**
+ * Persistent counters. Ids from COUNTER_PROJECT_FIRST up to COUNTER_COUNT - 1 are free for the project.
+ */
+enum CounterId : uint8_t
+{
+    COUNTER_UPTIME_HOURS,
+    COUNTER_WIFI_RECONNECTS,
+    COUNTER_OTA_ATTEMPTS,
+    COUNTER_PROJECT_FIRST
+};
+
+#pragma pack(push, 1)
+
+/**
+ * Counter values at the last compaction, stored as a regular record.
+ */
+struct CounterSnapshot
+{
+    uint32_t values[COUNTER_COUNT];
+
+    CounterSnapshot() { memset(values, 0, sizeof(values)); }
+};
+
+/**
+ * One increment appended to the log. check guards against torn or stale entries.
+ */
+struct CounterLogEntry
+{
+    uint8_t counterId; // 0xFF for a free entry
+    uint16_t delta;
+    uint8_t check;
+};
+
+#ifdef COUNTER_LOG_PARTITION
+/**
+ * Starts each counter log sector: the values when the sector was started, then the entries.
+ */
+struct CounterLogSectorHeader
+{
+    uint32_t magic;
+    uint32_t sequence; // one more than the other sector's
+    uint32_t values[COUNTER_COUNT];
+    uint32_t crc; // of the fields above, guards against a torn rotation
+};
+#endif
+
+#pragma pack(pop)
+
+// The capacity covers the snapshot and the log appended after it, so the slot holds both
+template <>
+struct RecordTraits<CounterSnapshot> : AppendOnlyMigration<CounterSnapshot>
+{
+    static const uint8_t typeId = 3;
+    static const uint8_t schemaVersion = 1;
+    static const uint16_t capacity = sizeof(CounterSnapshot) + COUNTER_LOG_ENTRIES * sizeof(CounterLogEntry);
+};
+
+#ifdef COUNTER_LOG_PARTITION
+/*
+  The counter log in flash sectors of its own, the last PartitionStorageBackend::counterLogSectors
+  of the config partition: an increment programs its entry in the erased space after the last
+  one, with no erase and no storage commit. A full sector is replaced by the other one, erased
+  and started with the current values: its header, programmed last, makes it the newer one.
+
+  A power cut while programming an entry leaves it torn, it fails its check and is skipped; one
+  during a rotation leaves the previous sector, still valid.
+*/
+class PartitionCounterLog
+{
+private:
+    const esp_partition_t *partition = nullptr;
+    uint32_t firstSectorOffset = 0;
+    uint8_t activeSector = 0;
+    uint32_t sequence = 0; // of the active sector, 0 if none is valid
+    uint16_t usedEntries = 0;
+    uint32_t rotations = 0;
+
+    size_t sectorOffset(uint8_t sector) const { return firstSectorOffset + sector * SPI_FLASH_SEC_SIZE; }
+
+public:
+    static const uint16_t sectorEntries = (SPI_FLASH_SEC_SIZE - sizeof(CounterLogSectorHeader)) / sizeof(CounterLogEntry);
+
+    bool begin(const char *label);
+    bool started() const { return partition != nullptr; }
+    bool load(uint32_t *values);
+    bool append(const CounterLogEntry &entry, const uint32_t *values);
+    bool rotate(const uint32_t *values);
+
+    uint16_t getUsedEntries() const { return usedEntries; }
+    uint32_t getRotations() const { return rotations; }
+};
+#endif
+
+/*
+  Log-structured counters: an increment appends a 4 bytes entry after the snapshot,
+  instead of rewriting the counter in place. The snapshot is only rewritten (compaction)
+  when the log is full. Values are kept in RAM, so reads never touch EEPROM.
+
+  Flash erased per increment, by storage backend (see STORAGE_BACKEND):
+  - partition (ESP32): none, the entry is programmed into the counter log sectors, see
+    PartitionCounterLog. One 4 KB sector is erased every PartitionCounterLog::sectorEntries
+    (about 1000) increments. Nothing is lost on a reset.
+  - the others: the increments are committed together, counterCommitDelayMillis after the
+    first one, and those since the last commit are lost on a reset. A commit erases one
+    4 KB sector plus the LittleFS backup on ESP8266 EEPROM, wears the whole EEPROM image
+    (one NVS blob) on ESP32 EEPROM, one page and its headers (160 B) on NVS, and
+    (blocks + 1) * 4 KB on LittleFS: see bytesErasedPerCommit(). EEPROM_COMMIT_NOW commits
+    an increment on its own, at that cost.
+*/
+class CounterStore
+{
+private:
+    int address = -1;
+    uint32_t values[COUNTER_COUNT] = {0};
+    uint8_t logEntries = 0; // entries used in the log
+    uint32_t compactions = 0;
+    TaskId commitTask = INVALID_TASK_ID;
+#ifdef COUNTER_LOG_PARTITION
+    PartitionCounterLog partitionLog;
+#endif
+
+    int entryAddress(uint8_t entry) const;
+    void compact(EepromCommitMode mode);
+    void commit(EepromCommitMode mode);
+
+public:
+    void begin(int eepromAddress);
+    void add(uint8_t counterId, uint16_t delta = 1, EepromCommitMode mode = EEPROM_COMMIT_DEFERRED);
+    uint32_t get(uint8_t counterId) const { return counterId < COUNTER_COUNT ? values[counterId] : 0; }
+
+    String toJson() const;
+};
+
+extern CounterStore persistentCounters;
+
+#endif // COUNTER_STORE_H
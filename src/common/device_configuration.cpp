@@ -1,10 +1,17 @@
+#define LOG_MODULE LOG_MODULE_CONFIG
+
 #include "common/device_configuration.h"
+#include "common/eeprom_layout.h"
 #include "common/eeprom_utils.tpp"
 #include "common/globals.h"
+#include "common/reset_breadcrumbs.h"
+#include "common/shared_state.h"
 
-int JUST_RESTARTED_EEPROM_ADDR;
-int DEVICE_CONFIGURATION_EEPROM_ADDR;
+const int quickRestartsEepromAddress = CommonEepromLayout::address<QuickRestarts>();
+const int deviceConfigurationEepromAddress = CommonEepromLayout::address<DeviceConfiguration>();
 
+// Statically owned: currentDeviceConfiguration points to it when a configuration is set, nullptr otherwise
+DeviceConfiguration deviceConfigurationStorage;
 DeviceConfiguration *currentDeviceConfiguration = nullptr;
 
 void DeviceConfiguration::printToSerial()
@@ -13,56 +20,206 @@ void DeviceConfiguration::printToSerial()
     LOG_PRINTLN(message);
 }
 
+/**
+ * Converts the records written by firmware using the legacy layout
+ * (QuickRestarts at 0, then DeviceConfiguration, each a byte sum checksum followed by the struct),
+ * so that a firmware update does not drop the device into config mode.
+ * Runs only while there is no record in the current format at quickRestartsEepromAddress.
+ */
+void importLegacyEepromLayout()
+{
+    RecordHeader header;
+    eepromSession.get(quickRestartsEepromAddress, header);
+    if (header.magic == RECORD_MAGIC && header.typeId == RecordTraits<QuickRestarts>::typeId)
+        return;
+
+    // Both legacy records are read before anything is written, the new slots overlap them
+    const int legacyQuickRestartsAddress = 0;
+    const int legacyDeviceConfigurationAddress = legacyQuickRestartsAddress + sizeof(checksum_type) + sizeof(QuickRestarts);
+    const size_t legacyDeviceConfigurationSize = offsetof(DeviceConfiguration, syslogHost); // the fields it had then
+    QuickRestarts quickRestarts(0);
+    DeviceConfiguration deviceConfiguration;
+    bool hasQuickRestarts = readLegacyDataFromEeprom(legacyQuickRestartsAddress, quickRestarts);
+    bool hasDeviceConfiguration = readLegacyDataFromEeprom(legacyDeviceConfigurationAddress, deviceConfiguration, legacyDeviceConfigurationSize);
+    if (!hasQuickRestarts)
+        quickRestarts = QuickRestarts(0);
+
+    LOG_PRINTLN(hasDeviceConfiguration ? F("EEPROM: importing legacy device configuration") : F("EEPROM: no legacy device configuration"));
+    writeDataToEeprom<QuickRestarts>(quickRestartsEepromAddress, &quickRestarts, EEPROM_COMMIT_NONE);
+    if (hasDeviceConfiguration)
+        writeDataToEeprom<DeviceConfiguration>(deviceConfigurationEepromAddress, &deviceConfiguration, EEPROM_COMMIT_NONE);
+    else
+        invalidateEepromData<DeviceConfiguration>(deviceConfigurationEepromAddress, EEPROM_COMMIT_NONE);
+    eepromSession.commit();
+}
+
 bool readDeviceConfigurationFromEeprom()
 {
     DEBUG_PRINTLN(F("EEPROM: device configuration: read"));
-    DeviceConfiguration *eepromConfig = readDataFromEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR);
-    if (eepromConfig != nullptr)
+    DeviceConfiguration eepromConfig;
+    if (readDataFromEeprom(deviceConfigurationEepromAddress, eepromConfig))
     {
-        currentDeviceConfiguration = eepromConfig;
-        DEBUG_PRINTLN(currentDeviceConfiguration->toStr());
+        setCurrentDeviceConfiguration(&eepromConfig);
+        DEBUG_PRINTLN(eepromConfig.toStr());
         return true;
     }
-    LOG_PRINTLN(F(">>WARNING: got invalid DeviceConfiguration info from EEPROM"));
+    LOG_WARN(F("got invalid DeviceConfiguration info from EEPROM"));
     return false;
 }
 
+/**
+ * Copies config into the statically owned configuration, or clears it if config is nullptr.
+ */
+void setCurrentDeviceConfiguration(const DeviceConfiguration *config)
+{
+    SharedStateLock lock;
+    if (config == nullptr)
+    {
+        currentDeviceConfiguration = nullptr;
+        return;
+    }
+    deviceConfigurationStorage = *config;
+    currentDeviceConfiguration = &deviceConfigurationStorage;
+}
+
+/**
+ * Copies the current configuration into config. Returns false if there is none.
+ */
+bool copyCurrentDeviceConfiguration(DeviceConfiguration &config)
+{
+    SharedStateLock lock;
+    if (currentDeviceConfiguration == nullptr)
+        return false;
+    config = *currentDeviceConfiguration;
+    return true;
+}
+
+/**
+ * Stable for the whole run (the configuration is updated in place), empty while there is no configuration.
+ */
+const char *githubAuthTokenStorage()
+{
+    return deviceConfigurationStorage.githubAuthToken;
+}
+
 void saveDeviceConfigurationToEeprom()
 {
     DEBUG_PRINTLN(F("EEPROM: device configuration: write"));
-    DEBUG_PRINTLN(currentDeviceConfiguration->toStr());
+    SharedStateLock lock;
     if (currentDeviceConfiguration == nullptr)
         return;
+    DEBUG_PRINTLN(currentDeviceConfiguration->toStr());
 
-    writeDataToEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR, currentDeviceConfiguration);
+    writeDataToEeprom<DeviceConfiguration>(deviceConfigurationEepromAddress, currentDeviceConfiguration);
     DEBUG_PRINTLN(F("Done writing to EEPROM"));
 }
 
 void invalidateDeviceConfigurationOnEeprom()
 {
     DEBUG_PRINTLN(F("EEPROM: device configuration: invalidate"));
-    invalidateEepromData<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR);
+    invalidateEepromData<DeviceConfiguration>(deviceConfigurationEepromAddress);
+}
+
+/*
+  The quick restarts count lives in RTC memory, which survives warm resets (watchdog, panic, software):
+  a crash loop never touches flash. Flash is only used across power-on resets, which clear RTC memory,
+  and which is how users deliberately power-cycle the device into config mode.
+*/
+struct RtcQuickRestarts
+{
+    uint32_t magic;
+    uint32_t count;
+    uint32_t crc;
+};
+
+const uint32_t rtcQuickRestartsMagic = 0x51524331;
+
+#ifdef ESP32
+RTC_NOINIT_ATTR RtcQuickRestarts rtcQuickRestarts;
+#endif
+
+uint32_t rtcQuickRestartsCrc(const RtcQuickRestarts &record)
+{
+    return crc32Update(0, reinterpret_cast<const uint8_t *>(&record), offsetof(RtcQuickRestarts, crc));
+}
+
+bool readQuickRestartsFromRtc(uint8_t &count)
+{
+    if (isPowerOnReset())
+        return false;
+
+    RtcQuickRestarts record;
+#ifdef ESP32
+    record = rtcQuickRestarts;
+#elif defined(ESP8266)
+    ESP.rtcUserMemoryRead(rtcQuickRestartsBlock, (uint32_t *)&record, sizeof(record));
+#endif
+    if (record.magic != rtcQuickRestartsMagic || record.crc != rtcQuickRestartsCrc(record) || record.count > UINT8_MAX)
+        return false;
+    count = record.count;
+    return true;
+}
+
+void saveQuickRestartsToRtc(uint8_t count)
+{
+    RtcQuickRestarts record;
+    record.magic = rtcQuickRestartsMagic;
+    record.count = count;
+    record.crc = rtcQuickRestartsCrc(record);
+#ifdef ESP32
+    rtcQuickRestarts = record;
+#elif defined(ESP8266)
+    ESP.rtcUserMemoryWrite(rtcQuickRestartsBlock, (uint32_t *)&record, sizeof(record));
+#endif
+}
+
+/**
+ * From RTC memory if it survived the last reset, from flash otherwise.
+ */
+uint8_t readQuickRestarts()
+{
+    uint8_t count;
+    if (readQuickRestartsFromRtc(count))
+    {
+        LOGF_DEBUG("RTC: just restarted: %u", count);
+        return count;
+    }
+    return readQuickRestartsFromEeprom();
+}
+
+/**
+ * Boot (isQuickRestart): increments the count in RTC memory, and on flash only after a power-on reset.
+ * Once the device has been up long enough: clears both, flash being left untouched if already 0.
+ */
+void saveQuickRestarts(bool isQuickRestart)
+{
+    uint8_t rtcCount;
+    bool fromRtc = readQuickRestartsFromRtc(rtcCount);
+    uint8_t restartsCount = !isQuickRestart ? 0 : (fromRtc ? rtcCount : readQuickRestartsFromEeprom()) + 1;
+
+    saveQuickRestartsToRtc(restartsCount);
+    if (!isQuickRestart || !fromRtc)
+        saveQuickRestartsToEeprom(restartsCount);
 }
 
 uint8_t readQuickRestartsFromEeprom()
 {
     DEBUG_PRINTLN(F("EEPROM: just restarted: read...: "));
-    QuickRestarts *eepromConfig = readDataFromEeprom<QuickRestarts>(JUST_RESTARTED_EEPROM_ADDR);
-    if (eepromConfig == nullptr)
+    QuickRestarts eepromConfig;
+    if (!readDataFromEeprom(quickRestartsEepromAddress, eepromConfig))
     {
-        LOG_PRINTLN(F(">>WARNING: got invalid quickRestart info from EEPROM"));
+        LOG_WARN(F("got invalid quickRestart info from EEPROM"));
         return 255;
     }
-    DEBUG_PRINTLN(eepromConfig->consecutiveQuickRestartsCount == 0 ? "Not a quick restart!" : String(eepromConfig->consecutiveQuickRestartsCount));
-    return eepromConfig->consecutiveQuickRestartsCount;
+    DEBUG_PRINTLN(eepromConfig.consecutiveQuickRestartsCount == 0 ? "Not a quick restart!" : String(eepromConfig.consecutiveQuickRestartsCount));
+    return eepromConfig.consecutiveQuickRestartsCount;
 }
 
-void saveQuickRestartsToEeprom(bool isQuickRestart)
+void saveQuickRestartsToEeprom(uint8_t restartsCount)
 {
-    uint8_t restartsCount = !isQuickRestart ? 0 : readQuickRestartsFromEeprom() + 1;
-
-    DEBUG_PRINTLN("EEPROM: just restarted: write: count: " + String(restartsCount));
+    LOGF_DEBUG("EEPROM: just restarted: write: count: %u", restartsCount);
     QuickRestarts qr(restartsCount);
-    writeDataToEeprom<QuickRestarts>(JUST_RESTARTED_EEPROM_ADDR, &qr);
+    // A quick restart must be on flash before the device can crash again; clearing the count can wait
+    writeDataToEeprom<QuickRestarts>(quickRestartsEepromAddress, &qr, restartsCount > 0 ? EEPROM_COMMIT_NOW : EEPROM_COMMIT_DEFERRED);
     DEBUG_PRINTLN(F(" ..done"));
 }
@@ -1,6 +1,7 @@
 #ifndef DEVICE_CONFIGURATION_H
 #define DEVICE_CONFIGURATION_H
 
+#include "record_store.h"
 #include "utils.h"
 
 /*
@@ -37,10 +38,15 @@ struct DeviceConfiguration
   char deviceName[20];
   char githubAuthToken[100];
   bool isAliveSignalEnabled;
+  // Schema version 2: log collector, see log_syslog.h. No host: logs are not shipped
+  char syslogHost[40];
+  uint16_t syslogPort;
+  uint8_t syslogFormat; // LogSyslogFormat
 
-  DeviceConfiguration() : isAliveSignalEnabled(true) {}
+  DeviceConfiguration() : isAliveSignalEnabled(true), syslogHost(), syslogPort(514), syslogFormat(0) {}
 
-  DeviceConfiguration(const char *s, const char *pass, const char *hostn, const char *name, const char *githubT, bool aliveSignal = true)
+  DeviceConfiguration(const char *s, const char *pass, const char *hostn, const char *name, const char *githubT, bool aliveSignal = true,
+                      const char *syslogH = "", uint16_t syslogP = 514, uint8_t syslogF = 0)
   {
     strncpy(ssid, s, sizeof(ssid));
     strncpy(password, pass, sizeof(password));
@@ -48,6 +54,9 @@ struct DeviceConfiguration
     strncpy(deviceName, name, sizeof(deviceName));
     strncpy(githubAuthToken, githubT, sizeof(githubAuthToken));
     isAliveSignalEnabled = aliveSignal;
+    strncpy(syslogHost, syslogH, sizeof(syslogHost));
+    syslogPort = syslogP;
+    syslogFormat = syslogF;
   }
 
   String toStr() const
@@ -65,6 +74,11 @@ struct DeviceConfiguration
     text += stringMask(String(githubAuthToken), '*');
     text += "'\nAlive Signal: '";
     text += isAliveSignalEnabled ? "Enabled" : "Disabled";
+    text += "'\nLog collector: '";
+    text += String(syslogHost);
+    text += ":";
+    text += String(syslogPort);
+    text += syslogFormat == 0 ? " syslog" : " framed";
     text += "'\n###\n";
     return text;
   }
@@ -74,11 +88,34 @@ struct DeviceConfiguration
 
 #pragma pack(pop)
 
+// Bump schemaVersion when a struct changes, see record_store.h
+template <>
+struct RecordTraits<QuickRestarts> : AppendOnlyMigration<QuickRestarts>
+{
+  static const uint8_t typeId = 1;
+  static const uint8_t schemaVersion = 1;
+  static const uint16_t capacity = 8;
+};
+
+template <>
+struct RecordTraits<DeviceConfiguration> : AppendOnlyMigration<DeviceConfiguration>
+{
+  static const uint8_t typeId = 2;
+  static const uint8_t schemaVersion = 2; // 2: syslog fields appended
+  static const uint16_t capacity = 256;
+};
+
+void importLegacyEepromLayout();
 bool readDeviceConfigurationFromEeprom();
+void setCurrentDeviceConfiguration(const DeviceConfiguration *config);
+bool copyCurrentDeviceConfiguration(DeviceConfiguration &config);
+const char *githubAuthTokenStorage();
 void saveDeviceConfigurationToEeprom();
 void invalidateDeviceConfigurationOnEeprom();
 
+uint8_t readQuickRestarts();
+void saveQuickRestarts(bool isQuickRestart);
 uint8_t readQuickRestartsFromEeprom();
-void saveQuickRestartsToEeprom(bool is_quick_restart);
+void saveQuickRestartsToEeprom(uint8_t restartsCount);
 
 #endif
\ No newline at end of file
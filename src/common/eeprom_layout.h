@@ -0,0 +1,83 @@
+#ifndef EEPROM_LAYOUT_H
+#define EEPROM_LAYOUT_H
+
+#include <Arduino.h>
+#include <type_traits>
+
+#include "common/counter_store.h"
+#include "common/device_configuration.h"
+#include "common/eeprom_session.h"
+#include "common/record_store.h"
+
+/**
+ * Bytes taken by a record of type T: header and reserved capacity.
+ */
+template <typename T>
+constexpr int eepromSlotSize()
+{
+    return sizeof(RecordHeader) + RecordTraits<T>::capacity;
+}
+
+template <typename... Records>
+struct EepromSlotsSize
+{
+    static const int value = 0;
+};
+
+template <typename First, typename... Rest>
+struct EepromSlotsSize<First, Rest...>
+{
+    static const int value = eepromSlotSize<First>() + EepromSlotsSize<Rest...>::value;
+};
+
+template <typename T, typename... Records>
+struct EepromLayoutContains
+{
+    static const bool value = false;
+};
+
+template <typename T, typename First, typename... Rest>
+struct EepromLayoutContains<T, First, Rest...>
+{
+    static const bool value = std::is_same<T, First>::value || EepromLayoutContains<T, Rest...>::value;
+};
+
+// Not defined when T is not part of the layout
+template <typename T, int Start, typename... Records>
+struct EepromSlotOf;
+
+template <typename T, int Start, typename... Rest>
+struct EepromSlotOf<T, Start, T, Rest...>
+{
+    static_assert(!EepromLayoutContains<T, Rest...>::value, "record type registered twice in the EEPROM layout");
+    static const int address = Start;
+};
+
+template <typename T, int Start, typename First, typename... Rest>
+struct EepromSlotOf<T, Start, First, Rest...> : EepromSlotOf<T, Start + eepromSlotSize<First>(), Rest...>
+{
+};
+
+/*
+  Compile-time EEPROM layout: records are laid out back to back from Start, in the given order,
+  each taking eepromSlotSize<T>(). Addresses are constants, e.g. CommonEepromLayout::address<QuickRestarts>().
+  Appending a record, or growing a capacity, moves every following record: only append new records at the end.
+*/
+template <int Start, typename... Records>
+struct EepromLayout
+{
+    static const int start = Start;
+    static const int end = Start + EepromSlotsSize<Records...>::value;
+    static_assert(end <= EEPROM_SIZE, "EEPROM layout overflows EEPROM_SIZE");
+
+    template <typename T>
+    static constexpr int address()
+    {
+        return EepromSlotOf<T, Start, Records...>::address;
+    }
+};
+
+// Records used by the common code. Project records go in a layout starting at CommonEepromLayout::end.
+typedef EepromLayout<0, QuickRestarts, DeviceConfiguration, CounterSnapshot> CommonEepromLayout;
+
+#endif // EEPROM_LAYOUT_H
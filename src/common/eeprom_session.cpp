@@ -0,0 +1,197 @@
+#define LOG_MODULE LOG_MODULE_STORAGE
+
+#include "common/eeprom_session.h"
+
+#include <ArduinoJson.h>
+
+#include "common/globals.h"
+#include "common/shared_state.h"
+
+EepromSession eepromSession;
+
+bool isErased(const uint8_t *image, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (image[i] != 0xFF)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * A storage backend that was never written gets the fallback's content once, so that
+ * switching backend keeps the records.
+ */
+void EepromSession::importFromFallback()
+{
+    StorageBackend &fallback = fallbackStorageBackend();
+    const uint8_t *current = backend->readData();
+    if (backend == &fallback || current == nullptr || !isErased(current, EEPROM_SIZE))
+        return;
+    if (!fallback.begin(EEPROM_SIZE + STORAGE_SCRATCH_SIZE))
+        return;
+    LOGF_INFO("Importing the storage from the %s backend", fallback.name());
+    uint8_t *image = backend->writeData();
+    if (image != nullptr)
+    {
+        memcpy(image, fallback.readData(), EEPROM_SIZE);
+        dirtyBegin = 0;
+        dirtyEnd = EEPROM_SIZE;
+    }
+    fallback.end();
+    commit();
+}
+
+void EepromSession::begin()
+{
+    SharedStateLock lock;
+    if (opened)
+        return;
+    opened = true;
+    StorageBackend *candidates[] = {&defaultStorageBackend(), &fallbackStorageBackend()};
+    for (StorageBackend *candidate : candidates)
+    {
+        if (candidate->begin(EEPROM_SIZE + STORAGE_SCRATCH_SIZE))
+        {
+            backend = candidate;
+            importFromFallback();
+            return;
+        }
+        LOGF_WARN("cannot start the %s storage backend", candidate->name());
+    }
+}
+
+/**
+ * Pointer to [address, address + size) of the storage, nullptr if out of range or not started.
+ * Nothing is copied; the pointer is valid until the next write() or commit(), hold a SharedStateLock meanwhile.
+ */
+const uint8_t *EepromSession::peek(int address, size_t size)
+{
+    begin();
+    SharedStateLock lock;
+    if (backend == nullptr || address < 0 || (size_t)address + size > EEPROM_SIZE)
+        return nullptr;
+    const uint8_t *image = backend->readData();
+    return image != nullptr ? image + address : nullptr;
+}
+
+/**
+ * Bytes outside of the storage, or not loaded, read as erased (0xFF).
+ */
+void EepromSession::read(int address, uint8_t *data, size_t size)
+{
+    SharedStateLock lock;
+    const uint8_t *stored = peek(address, size);
+    if (stored == nullptr)
+    {
+        memset(data, 0xFF, size);
+        return;
+    }
+    memcpy(data, stored, size);
+}
+
+/**
+ * Updates the image, only where it differs from data, and extends the dirty range accordingly.
+ */
+void EepromSession::write(int address, const uint8_t *data, size_t size, EepromCommitMode mode)
+{
+    begin();
+    {
+        SharedStateLock lock;
+        const uint8_t *stored = peek(address, size);
+        if (stored == nullptr)
+            return;
+        // Only taken on the first change: a memory-mapped backend copies the image to RAM then
+        uint8_t *image = nullptr;
+        for (size_t i = 0; i < size; i++)
+        {
+            int byteAddress = address + i;
+            if (image == nullptr && stored[i] == data[i])
+                continue;
+            if (image == nullptr)
+                image = backend->writeData();
+            if (image == nullptr || image[byteAddress] == data[i])
+                continue;
+
+            image[byteAddress] = data[i];
+            bytesChanged++;
+            if (dirtyBegin < 0 || byteAddress < dirtyBegin)
+                dirtyBegin = byteAddress;
+            if (byteAddress + 1 > dirtyEnd)
+                dirtyEnd = byteAddress + 1;
+        }
+    }
+
+    if (mode == EEPROM_COMMIT_NOW)
+        commit();
+    else if (mode == EEPROM_COMMIT_DEFERRED)
+        commitDeferred();
+}
+
+/**
+ * Writes the mirror to flash if anything changed since the last commit.
+ */
+bool EepromSession::commit()
+{
+    SharedStateLock lock;
+    if (commitTask != INVALID_TASK_ID)
+    {
+        scheduler.cancel(commitTask);
+        commitTask = INVALID_TASK_ID;
+    }
+
+    if (!isDirty())
+    {
+        skippedCommits++;
+        return true;
+    }
+
+    LOGF_DEBUG("EEPROM: committing bytes %d to %d", dirtyBegin, dirtyEnd - 1);
+    if (!backend->commit(dirtyBegin, dirtyEnd))
+    {
+        failedCommits++;
+        LOG_ERROR(F("EEPROM commit failed"));
+        return false;
+    }
+    commits++;
+    bytesCommitted += dirtyEnd - dirtyBegin;
+    bytesErased += backend->bytesErasedPerCommit(dirtyBegin, dirtyEnd);
+    dirtyBegin = -1;
+    dirtyEnd = -1;
+    return true;
+}
+
+/**
+ * Commits eepromCommitDelayMillis from now, unless a deferred commit is already pending.
+ */
+void EepromSession::commitDeferred()
+{
+    SharedStateLock lock;
+    if (commitTask != INVALID_TASK_ID || !isDirty())
+        return;
+    commitTask = scheduler.scheduleOnce("eepromCommit", eepromCommitDelayMillis, [this]()
+                                        {
+        commitTask = INVALID_TASK_ID;
+        commit(); });
+}
+
+String EepromSession::statsToJson() const
+{
+    SharedStateLock lock;
+    JsonDocument doc;
+    doc["backend"] = backend != nullptr ? backend->name() : "none";
+    doc["size"] = EEPROM_SIZE;
+    doc["commits"] = commits;
+    doc["failedCommits"] = failedCommits;
+    doc["skippedCommits"] = skippedCommits;
+    doc["bytesChanged"] = bytesChanged;
+    doc["bytesCommitted"] = bytesCommitted;
+    doc["estimatedBytesErased"] = bytesErased;
+    doc["dirtyBytes"] = isDirty() ? dirtyEnd - dirtyBegin : 0;
+    doc["commitPending"] = commitTask != INVALID_TASK_ID;
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
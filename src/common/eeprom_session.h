@@ -0,0 +1,75 @@
+#ifndef EEPROM_SESSION_H
+#define EEPROM_SESSION_H
+
+#include <Arduino.h>
+
+#include "common/scheduler.h"
+#include "common/storage_backend.h"
+
+#ifndef EEPROM_SIZE
+#define EEPROM_SIZE 1024
+#endif
+
+/**
+ * When a write reaches flash:
+ * - EEPROM_COMMIT_NOW: before the write returns
+ * - EEPROM_COMMIT_DEFERRED: eepromCommitDelayMillis later, together with the other writes made meanwhile
+ * - EEPROM_COMMIT_NONE: on the next commit, explicit or deferred
+ */
+enum EepromCommitMode : uint8_t
+{
+    EEPROM_COMMIT_NOW,
+    EEPROM_COMMIT_DEFERRED,
+    EEPROM_COMMIT_NONE
+};
+
+/*
+  The storage backend (see storage_backend.h) exposes an image of the storage, in RAM or
+  memory-mapped. The session opens it once and keeps it open, instead of allocating and
+  reading it back for each record: reads need no flash access, and writes only touch the
+  bytes that changed, so that unchanged records cost no flash commit at all.
+*/
+class EepromSession
+{
+private:
+    bool opened = false;
+    StorageBackend *backend = nullptr; // nullptr if no backend could start
+    int dirtyBegin = -1; // dirty range [dirtyBegin, dirtyEnd), -1 if clean
+    int dirtyEnd = -1;
+    TaskId commitTask = INVALID_TASK_ID;
+
+    void importFromFallback();
+
+    // Stats
+    uint32_t commits = 0;
+    uint32_t failedCommits = 0;
+    uint32_t skippedCommits = 0; // commits requested with nothing to write
+    uint32_t bytesChanged = 0;   // bytes that differed from the mirror
+    uint32_t bytesCommitted = 0; // sum of the committed dirty ranges
+    uint32_t bytesErased = 0;    // estimated, see StorageBackend::bytesErasedPerCommit()
+
+public:
+    void begin();
+    const uint8_t *peek(int address, size_t size);
+    void read(int address, uint8_t *data, size_t size);
+    void write(int address, const uint8_t *data, size_t size, EepromCommitMode mode = EEPROM_COMMIT_NOW);
+    bool commit();
+    void commitDeferred();
+    bool isDirty() const { return dirtyBegin >= 0; }
+    StorageBackend *getBackend() const { return backend; }
+
+    template <typename T>
+    void get(int address, T &data) { read(address, reinterpret_cast<uint8_t *>(&data), sizeof(T)); }
+
+    template <typename T>
+    void put(int address, const T &data, EepromCommitMode mode = EEPROM_COMMIT_NOW)
+    {
+        write(address, reinterpret_cast<const uint8_t *>(&data), sizeof(T), mode);
+    }
+
+    String statsToJson() const;
+};
+
+extern EepromSession eepromSession;
+
+#endif // EEPROM_SESSION_H
@@ -1,83 +1,147 @@
 #ifndef EEPROM_UTILS_TPP
 #define EEPROM_UTILS_TPP
 
-#include <EEPROM.h>
 #include <Arduino.h>
 
+#include "common/eeprom_session.h"
 #include "common/globals.h"
-
-#ifndef EEPROM_SIZE
-#define EEPROM_SIZE 1024
-#endif
+#include "common/record_store.h"
+#include "common/shared_state.h"
 
 using checksum_type = uint32_t;
 
 template <typename T>
-T *readDataFromEeprom(const int eepromAddress)
-{
-    DEBUG_PRINTLN(String("Reading from EEPROM address ") + String(eepromAddress));
-    EEPROM.begin(EEPROM_SIZE);
-
-    // read checksum first, then data
-    checksum_type expectedChecksum;
-    EEPROM.get(eepromAddress, expectedChecksum);
-
-    T *data = new T();
-    EEPROM.get(eepromAddress + sizeof(checksum_type), *data);
-    EEPROM.end();
+void writeDataToEeprom(int eepromAddress, const T *data, EepromCommitMode mode = EEPROM_COMMIT_NOW);
 
-    checksum_type checksum = calculateChecksum(data);
+/**
+ * Payload of the valid record of type T stored at eepromAddress, checked in place: nullptr otherwise.
+ * Hold a SharedStateLock while using it, see EepromSession::peek().
+ */
+template <typename T>
+const uint8_t *peekRecordPayload(const int eepromAddress, RecordHeader &header)
+{
+    typedef RecordTraits<T> Traits;
+    eepromSession.get(eepromAddress, header);
+    if (header.magic != RECORD_MAGIC || header.typeId != Traits::typeId)
+        return nullptr;
+    // invalidated, or corrupted
+    if (header.length == 0 || header.length > Traits::capacity)
+        return nullptr;
 
-    if (checksum == expectedChecksum)
-        return data;
-    else
+    const uint8_t *stored = eepromSession.peek(eepromAddress + sizeof(RecordHeader), header.length);
+    if (stored == nullptr || recordCrc(header, stored) != header.crc)
+    {
+        LOGF_WARN("CRC mismatch for EEPROM record at address %d", eepromAddress);
         return nullptr;
+    }
+    return stored;
 }
 
+/**
+ * Reads the record of type T stored at eepromAddress (see record_store.h) into data.
+ * Records stored with an older schema version are migrated, and rewritten in the current one.
+ * Returns false, leaving data untouched, if there is no valid record of type T.
+ * Does not allocate: the payload is checked in place, and copied once into data.
+ */
 template <typename T>
-void writeDataToEeprom(int eepromAddress, T *data)
+bool readDataFromEeprom(const int eepromAddress, T &data)
 {
-    DEBUG_PRINTLN(String("Writing to EEPROM address ") + String(eepromAddress));
-    EEPROM.begin(EEPROM_SIZE);
-
-    checksum_type checksum = calculateChecksum(data);
-    EEPROM.put(eepromAddress, checksum);
-    EEPROM.put(eepromAddress + sizeof(checksum_type), *data);
+    typedef RecordTraits<T> Traits;
+    static_assert(sizeof(T) <= Traits::capacity, "record capacity is smaller than the struct");
+
+    SharedStateLock lock; // keeps the peeked payload valid
+    RecordHeader header;
+    const uint8_t *stored = peekRecordPayload<T>(eepromAddress, header);
+    if (stored == nullptr)
+        return false;
+
+    if (header.schemaVersion == Traits::schemaVersion && header.length == sizeof(T))
+    {
+        memcpy(reinterpret_cast<uint8_t *>(&data), stored, sizeof(T));
+        return true;
+    }
+
+    T migrated;
+    if (!Traits::migrate(header.schemaVersion, stored, header.length, migrated))
+    {
+        LOGF_WARN("cannot migrate EEPROM record from schema version %u", header.schemaVersion);
+        return false;
+    }
+    data = migrated;
+    // A newer record (firmware downgrade) is read as is, but not overwritten
+    if (header.schemaVersion < Traits::schemaVersion)
+    {
+        LOGF_INFO("EEPROM record at address %d migrated from schema version %u to %u", eepromAddress,
+                  header.schemaVersion, (unsigned)Traits::schemaVersion);
+        writeDataToEeprom<T>(eepromAddress, &data, EEPROM_COMMIT_DEFERRED);
+    }
+    return true;
+}
 
-    EEPROM.commit();
-    EEPROM.end();
+/**
+ * Only the bytes that changed are written; nothing reaches flash if the record is unchanged.
+ * See EepromCommitMode for when the write is committed.
+ */
+template <typename T>
+void writeDataToEeprom(int eepromAddress, const T *data, EepromCommitMode mode)
+{
+    typedef RecordTraits<T> Traits;
+    static_assert(sizeof(T) <= Traits::capacity, "record capacity is smaller than the struct");
+    LOGF_DEBUG("Writing to EEPROM address %d", eepromAddress);
+
+    RecordHeader header;
+    header.magic = RECORD_MAGIC;
+    header.typeId = Traits::typeId;
+    header.schemaVersion = Traits::schemaVersion;
+    header.length = sizeof(T);
+    header.crc = recordCrc(header, reinterpret_cast<const uint8_t *>(data));
+
+    eepromSession.put(eepromAddress, header, EEPROM_COMMIT_NONE);
+    eepromSession.put(eepromAddress + sizeof(RecordHeader), *data, mode);
 }
 
+/**
+ * Checksum of the legacy, headerless layout: a byte sum.
+ */
 template <typename T>
-checksum_type calculateChecksum(const T *data)
+checksum_type calculateChecksum(const T *data, size_t length = sizeof(T))
 {
     checksum_type checksum = 0;
     const uint8_t *ptr = reinterpret_cast<const uint8_t *>(data);
-    for (size_t i = 0; i < sizeof(T); i++)
+    for (size_t i = 0; i < length; i++)
         checksum += *ptr++;
 
     return checksum;
 }
 
+/**
+ * Reads a record stored in the legacy layout (byte sum checksum, then the struct) into data.
+ * length is the size the struct had then: the fields appended since keep their default values.
+ */
 template <typename T>
-void invalidateEepromData(const int eepromAddress)
+bool readLegacyDataFromEeprom(const int eepromAddress, T &data, size_t length = sizeof(T))
 {
-    EEPROM.begin(EEPROM_SIZE);
+    checksum_type expectedChecksum;
+    eepromSession.get(eepromAddress, expectedChecksum);
+    eepromSession.read(eepromAddress + sizeof(checksum_type), reinterpret_cast<uint8_t *>(&data), length);
 
-    checksum_type empty = 0;
-    EEPROM.put(eepromAddress, empty);
-    EEPROM.commit();
-    EEPROM.end();
+    // A zeroed area would pass the byte sum
+    return expectedChecksum != 0 && calculateChecksum(&data, length) == expectedChecksum;
 }
 
+/**
+ * Keeps the header, so that the slot is still recognized as a (void) record of type T.
+ */
 template <typename T>
-int nextEepromSlot(int previousSlotStartAddress)
+void invalidateEepromData(const int eepromAddress, EepromCommitMode mode = EEPROM_COMMIT_NOW)
 {
-    // checksum + size of previous struct:
-    int address = sizeof(T) + sizeof(checksum_type);
-    // add offset:
-    address += previousSlotStartAddress;
-    return address;
+    RecordHeader header;
+    header.magic = RECORD_MAGIC;
+    header.typeId = RecordTraits<T>::typeId;
+    header.schemaVersion = RecordTraits<T>::schemaVersion;
+    header.length = 0;
+    header.crc = recordCrc(header, nullptr);
+    eepromSession.put(eepromAddress, header, mode);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -4,6 +4,9 @@
 #include <ESP8266WebServer.h>
 #include <Updater.h>
 
+#include "common_main.h"
+#include "globals.h"
+
 const int OTA_SERVER_PORT = 8888;
 ESP8266WebServer otaServer(OTA_SERVER_PORT);
 
@@ -17,8 +20,7 @@ void setupEsp8266OtaUpdate() {
 
     otaServer.on("/update", HTTP_POST, []() {
         otaServer.send(200, "text/plain", (Update.hasError()) ? "Update Failed" : "Update Success! Rebooting...");
-        delay(2000);
-        ESP.restart();
+        requestRestart(restartReplyDelayMillis);
     }, []() {
         HTTPUpload& upload = otaServer.upload();
         if (upload.status == UPLOAD_FILE_START) {
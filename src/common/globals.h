@@ -2,13 +2,16 @@
 #define GLOBALS_H
 
 #include <ESPAsyncWebServer.h>
+#include <atomic>
 #include <map>
 
 #include "common/device_configuration.h"
+#include "common/log.h"
 #include "common/memory_stats.h"
 #include "common/ota_handler.h"
 
 extern const uint8_t integratedLEDPin;
+extern const bool integratedLEDInvertedLogic;
 extern const uint ledFlashMinInterval;
 
 extern ESPGithubOtaUpdate *updater;
@@ -16,7 +19,6 @@ extern AsyncWebServer *webServer;
 
 extern std::map<String, String> routeDescriptions;
 
-extern int DEVICE_CONFIGURATION_EEPROM_ADDR;
 extern DeviceConfiguration *currentDeviceConfiguration;
 
 // Firmware
@@ -25,18 +27,17 @@ extern const char *BINARY_NAME;
 
 // Watchdog
 extern const int watchdogTimeout_s;
-void sendToLogsWebsocket(const String &message);
 
 // Config mode and Just Restarted
-extern bool configMode;
-extern bool bootLoopMode;
-extern int JUST_RESTARTED_EEPROM_ADDR;
+extern std::atomic<bool> configMode;
+extern std::atomic<bool> bootLoopMode;
 extern uint8_t minQuickRestartCountToEnterConfigMode;
 
 extern uint8_t quickRestartsCount;
 extern const uint16_t quickRestarMaxDurationMillis;
 extern const uint8_t bootLoopModeMinCount;
 extern const uint32_t configModeCheckEveryMillis;
+extern const uint32_t restartReplyDelayMillis;
 
 // Wifi
 extern const char *configModeSsid;
@@ -45,6 +46,19 @@ extern const uint32_t wifiConnectionStatusCheckMillis;
 extern const uint16_t wifiConnectionMaxMillis;
 extern const IPAddress dns;
 
+// Logs
+extern const uint32_t logDrainIntervalMillis;
+extern const uint32_t logWebsocketFlushIntervalMillis;
+extern const uint32_t logSyslogFlushIntervalMillis;
+extern const uint32_t logFileFlushIntervalMillis;
+extern const uint32_t logFileSyncIntervalMillis;
+extern const uint32_t vccLogIntervalMillis;
+
+// EEPROM
+extern const uint32_t eepromCommitDelayMillis;
+extern const uint32_t counterCommitDelayMillis;
+extern const uint32_t uptimeCounterIntervalMillis;
+
 // Logs WebSocket and Ram management
 extern AsyncWebSocket wsLogs;
 extern MemoryStats ramStats;
@@ -53,33 +67,26 @@ extern uint64_t ramStatsUpdateIntervalMillis;
 // GitHub
 extern const char *releaseRepo;
 extern const char *GITHUB_TOKEN;
+extern const uint32_t checkForSoftwareUpdateMillis;
+extern const uint32_t otaBootCheckDelayMillis;
+extern const uint32_t otaBootCheckRetryMillis;
+
+// Power Monitor
+extern const uint32_t vccCheckIntervalMillis;
+
+// Housekeeping task (ESP32)
+extern const uint8_t housekeepingTaskCore;
+extern const uint8_t housekeepingTaskPriority;
+extern const uint32_t housekeepingTaskStackSize;
+extern const uint32_t housekeepingMaxIdleMillis;
+
+// Logging: LOG_ERROR() ... LOG_TRACE(), LOG_PRINTLN() and DEBUG_PRINTLN(), see log.h
+
+// Comment out the following line to compile the loop latency profiler out entirely.
+#define LOOP_PROFILING
 
-// LOG to Serial and to WebSocket
-#define LOG_PRINT(str)                    \
-    {                                     \
-        Serial.print(str);                \
-        sendToLogsWebsocket(String(str)); \
-    }
-#define LOG_PRINTLN(str)                         \
-    {                                            \
-        Serial.println(str);                     \
-        sendToLogsWebsocket(String(str) + "\n"); \
-    }
-
-// Uncomment the following line to enable debug output.
-#define DEBUG
-#ifdef DEBUG
-#define DEBUG_PRINT(str) LOG_PRINT(str)
-#define DEBUG_PRINTLN(str) LOG_PRINTLN(str)
-#else
-#define DEBUG_PRINT(str)   \
-    {                      \
-        Serial.print(str); \
-    }
-#define DEBUG_PRINTLN(str)   \
-    {                        \
-        Serial.println(str); \
-    }
-#endif
+// ESP32 only: run common housekeeping on a dedicated FreeRTOS task (see common_config.cpp)
+// instead of the Arduino loop task. Comment out to run it from commonLoop() as on ESP8266.
+#define HOUSEKEEPING_TASK
 
 #endif // GLOBALS_H
\ No newline at end of file
@@ -0,0 +1,103 @@
+#define LOG_MODULE LOG_MODULE_LOGS
+
+#include "common/log.h"
+
+#include <ArduinoJson.h>
+
+static const char *const logLevelNames[] = {"none", "error", "warn", "info", "debug", "trace"};
+static const char logLevelLetters[] = "-EWIDT";
+static const char *const logModuleNames[] = {"main", "wifi", "server", "ota", "config", "storage", "logs", "project"};
+
+static_assert(sizeof(logModuleNames) / sizeof(logModuleNames[0]) == LOG_MODULE_COUNT, "one name per module");
+static_assert(LOG_MODULE_COUNT <= 32, "the module must fit the 5 high bits of a tag");
+
+// Read by every enabled LOG_xxx() statement: byte-sized, so the checks never lock
+std::atomic<uint8_t> logModuleLevels[LOG_MODULE_COUNT] = {
+    {LOG_DEFAULT_LEVEL}, {LOG_DEFAULT_LEVEL}, {LOG_DEFAULT_LEVEL}, {LOG_DEFAULT_LEVEL},
+    {LOG_DEFAULT_LEVEL}, {LOG_DEFAULT_LEVEL}, {LOG_DEFAULT_LEVEL}, {LOG_DEFAULT_LEVEL}};
+
+const char *logLevelName(uint8_t level)
+{
+    return level <= LOG_LEVEL_TRACE ? logLevelNames[level] : "?";
+}
+
+const char *logModuleName(uint8_t module)
+{
+    return module < LOG_MODULE_COUNT ? logModuleNames[module] : "?";
+}
+
+/**
+ * -1 if name is not a level. Numbers are accepted too.
+ */
+int logLevelFromName(const String &name)
+{
+    for (uint8_t level = LOG_LEVEL_NONE; level <= LOG_LEVEL_TRACE; level++)
+        if (name.equalsIgnoreCase(logLevelNames[level]) || name == String(level))
+            return level;
+    return -1;
+}
+
+int logModuleFromName(const String &name)
+{
+    for (uint8_t module = 0; module < LOG_MODULE_COUNT; module++)
+        if (name.equalsIgnoreCase(logModuleNames[module]))
+            return module;
+    return -1;
+}
+
+/**
+ * Writes "[W][wifi] " to prefix, returns its length.
+ */
+size_t formatLogPrefix(uint8_t tag, char *prefix, size_t size)
+{
+    uint8_t level = logTagLevel(tag);
+    char letter = level <= LOG_LEVEL_TRACE ? logLevelLetters[level] : '?';
+    int length = snprintf(prefix, size, "[%c][%s] ", letter, logModuleName(logTagModule(tag)));
+    if (length < 0)
+        return 0;
+    return (size_t)length < size ? length : size - 1;
+}
+
+/**
+ * Copies the text from flash into the ring: no RAM copy in between. Not for ISRs.
+ */
+void logWrite(uint8_t tag, const __FlashStringHelper *text, bool newline)
+{
+    PGM_P flashText = reinterpret_cast<PGM_P>(text);
+    logRing.push(tag, newline ? LogRing::FLAG_NEWLINE : 0, flashText, strlen_P(flashText), true);
+}
+
+/**
+ * Sets the runtime level of module, or of every module if it is "all". Levels above
+ * LOG_MIN_LEVEL are accepted, but their statements are not compiled in.
+ */
+bool setLogLevel(const String &module, const String &level)
+{
+    int newLevel = logLevelFromName(level);
+    if (newLevel < 0)
+        return false;
+    if (module == "all")
+    {
+        for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++)
+            logModuleLevels[i] = newLevel;
+        return true;
+    }
+    int index = logModuleFromName(module);
+    if (index < 0)
+        return false;
+    logModuleLevels[index] = newLevel;
+    return true;
+}
+
+String logLevelsToJson()
+{
+    JsonDocument doc;
+    doc["compiledLevel"] = logLevelName(LOG_MIN_LEVEL);
+    JsonObject modules = doc["modules"].to<JsonObject>();
+    for (uint8_t module = 0; module < LOG_MODULE_COUNT; module++)
+        modules[logModuleNames[module]] = logLevelName(logModuleLevels[module].load());
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
@@ -0,0 +1,201 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+
+#include "common/log_format.h"
+#include "common/log_ring.h"
+
+// Levels, as numbers for the preprocessor
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+// Statements above this level are compiled out, with their arguments. Set with a build flag.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Runtime level of every module at boot, see /logLevels
+#ifndef LOG_DEFAULT_LEVEL
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO
+#endif
+
+/**
+ * Log tags. A .cpp file picks its own with #define LOG_MODULE LOG_MODULE_xxx, before its includes.
+ */
+enum LogModule : uint8_t
+{
+    LOG_MODULE_MAIN,
+    LOG_MODULE_WIFI,
+    LOG_MODULE_SERVER,
+    LOG_MODULE_OTA,
+    LOG_MODULE_CONFIG,
+    LOG_MODULE_STORAGE,
+    LOG_MODULE_LOGS,
+    LOG_MODULE_PROJECT, // files that do not define LOG_MODULE
+    LOG_MODULE_COUNT
+};
+
+#ifndef LOG_MODULE
+#define LOG_MODULE LOG_MODULE_PROJECT
+#endif
+
+extern std::atomic<uint8_t> logModuleLevels[LOG_MODULE_COUNT];
+
+inline bool logLevelEnabled(uint8_t module, uint8_t level)
+{
+    return level <= logModuleLevels[module].load(std::memory_order_relaxed);
+}
+
+// Level in the 3 low bits, module above
+inline uint8_t logTag(uint8_t module, uint8_t level) { return module << 3 | level; }
+inline uint8_t logTagLevel(uint8_t tag) { return tag & 0x07; }
+inline uint8_t logTagModule(uint8_t tag) { return tag >> 3; }
+
+const char *logLevelName(uint8_t level);
+const char *logModuleName(uint8_t module);
+int logLevelFromName(const String &name);
+int logModuleFromName(const String &name);
+size_t formatLogPrefix(uint8_t tag, char *prefix, size_t size);
+bool setLogLevel(const String &module, const String &level);
+String logLevelsToJson();
+
+// Picked by the type of the message: F() and const char* text is copied straight into the
+// ring, from flash for F(). Only numbers are converted to a String first.
+void logWrite(uint8_t tag, const __FlashStringHelper *text, bool newline);
+inline void logWrite(uint8_t tag, const char *text, bool newline)
+{
+    logWrite(tag, text, text != nullptr ? strlen(text) : 0, newline);
+}
+inline void logWrite(uint8_t tag, const String &text, bool newline)
+{
+    logWrite(tag, text.c_str(), text.length(), newline);
+}
+template <typename T>
+typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type
+logWrite(uint8_t tag, T value, bool newline)
+{
+    String text(value);
+    logWrite(tag, text, newline);
+}
+
+// The arguments are only evaluated when the level is enabled
+#define LOG_AT(level, newline, str)                                                    \
+    do                                                                                 \
+    {                                                                                  \
+        if ((level) <= LOG_MIN_LEVEL && logLevelEnabled(LOG_MODULE, (level)))          \
+            logWrite(logTag(LOG_MODULE, (level)), (str), (newline));                   \
+    } while (0)
+
+#define LOG_DISABLED() \
+    do                 \
+    {                  \
+    } while (0)
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(str) LOG_AT(LOG_LEVEL_ERROR, true, str)
+#else
+#define LOG_ERROR(str) LOG_DISABLED()
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(str) LOG_AT(LOG_LEVEL_WARN, true, str)
+#else
+#define LOG_WARN(str) LOG_DISABLED()
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(str) LOG_AT(LOG_LEVEL_INFO, true, str)
+#define LOG_PRINT(str) LOG_AT(LOG_LEVEL_INFO, false, str)
+#define LOG_PRINTLN(str) LOG_AT(LOG_LEVEL_INFO, true, str)
+#else
+#define LOG_INFO(str) LOG_DISABLED()
+#define LOG_PRINT(str) LOG_DISABLED()
+#define LOG_PRINTLN(str) LOG_DISABLED()
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(str) LOG_AT(LOG_LEVEL_DEBUG, true, str)
+#define DEBUG_PRINT(str) LOG_AT(LOG_LEVEL_DEBUG, false, str)
+#define DEBUG_PRINTLN(str) LOG_AT(LOG_LEVEL_DEBUG, true, str)
+#else
+#define LOG_DEBUG(str) LOG_DISABLED()
+#define DEBUG_PRINT(str) LOG_DISABLED()
+#define DEBUG_PRINTLN(str) LOG_DISABLED()
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE(str) LOG_AT(LOG_LEVEL_TRACE, true, str)
+#else
+#define LOG_TRACE(str) LOG_DISABLED()
+#endif
+
+// Deferred-format variants, see log_format.h: LOGF_INFO("client #%u connected", id)
+#define LOGF_AT(level, format, ...)                                                             \
+    do                                                                                          \
+    {                                                                                           \
+        if ((level) <= LOG_MIN_LEVEL && logLevelEnabled(LOG_MODULE, (level)))                   \
+            logFormat(logTag(LOG_MODULE, (level)), PSTR(format), ##__VA_ARGS__);                \
+    } while (0)
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_ERROR
+#define LOGF_ERROR(format, ...) LOGF_AT(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#else
+#define LOGF_ERROR(format, ...) LOG_DISABLED()
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_WARN
+#define LOGF_WARN(format, ...) LOGF_AT(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#else
+#define LOGF_WARN(format, ...) LOG_DISABLED()
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_INFO
+#define LOGF_INFO(format, ...) LOGF_AT(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#else
+#define LOGF_INFO(format, ...) LOG_DISABLED()
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_DEBUG
+#define LOGF_DEBUG(format, ...) LOGF_AT(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#else
+#define LOGF_DEBUG(format, ...) LOG_DISABLED()
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_TRACE
+#define LOGF_TRACE(format, ...) LOGF_AT(LOG_LEVEL_TRACE, format, ##__VA_ARGS__)
+#else
+#define LOGF_TRACE(format, ...) LOG_DISABLED()
+#endif
+
+// Throttled variants for noisy call sites, e.g. LOG_EVERY_N(LOG_LEVEL_DEBUG, 100, "...")
+#define LOG_EVERY_N(level, n, str)                   \
+    do                                               \
+    {                                                \
+        static uint32_t logOccurrences = 0;          \
+        if (logOccurrences++ % (n) == 0)             \
+            LOG_AT(level, true, str);                \
+    } while (0)
+
+// At most once per intervalMillis
+#define LOG_EVERY_MILLIS(level, intervalMillis, str)                                   \
+    do                                                                                 \
+    {                                                                                  \
+        static uint32_t logLastMillis = 0;                                             \
+        static bool logLogged = false;                                                 \
+        uint32_t logNow = millis();                                                    \
+        if (!logLogged || logNow - logLastMillis >= (intervalMillis))                  \
+        {                                                                              \
+            logLogged = true;                                                          \
+            logLastMillis = logNow;                                                    \
+            LOG_AT(level, true, str);                                                  \
+        }                                                                              \
+    } while (0)
+
+#endif // LOG_H
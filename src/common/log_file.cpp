@@ -0,0 +1,459 @@
+#define LOG_MODULE LOG_MODULE_LOGS
+
+#include "common/log_file.h"
+
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <atomic>
+#include <functional>
+#include <new>
+
+#include "common/globals.h"
+#include "common/shared_state.h"
+#include "common/storage_backend.h"
+
+#if LOG_FILE
+
+static_assert(LOG_FILE_SEGMENT_SIZE % LOG_FILE_WRITE_SIZE == 0, "segments must end on a write boundary");
+
+const size_t logFileBufferSize = 2 * LOG_FILE_WRITE_SIZE;
+
+// Filled by drainLogs(), emptied by flushLogFile()
+char *logFileBuffer = nullptr; // nullptr: no log files
+size_t logFileBuffered = 0;
+std::atomic<bool> logFileSyncRequested(false);
+
+// Only used by whoever holds logFileBusy
+std::atomic<bool> logFileBusy(false);
+File logSegment;
+uint32_t logSegmentNumber = 0;
+size_t logSegmentSize = 0; // bytes written, synced or not
+uint32_t lastLogFileSyncMillis = 0;
+bool logSegmentUnsynced = false; // written since the last sync
+bool logCompressionPending = false; // a closed segment may need compressing
+
+struct LogSegmentCompression
+{
+    uint32_t number;
+    File input;
+    File output;
+    LogLzEncoder encoder;
+};
+LogSegmentCompression *logCompression = nullptr;
+
+struct LogFileStats
+{
+    uint32_t lines = 0;
+    uint32_t droppedLines = 0;
+    uint32_t writes = 0;
+    uint32_t syncs = 0; // metadata commits of the segment
+    uint32_t bytesWritten = 0;
+    uint32_t writeErrors = 0;
+    uint32_t segmentsClosed = 0;
+    uint32_t segmentsCompressed = 0;
+    uint32_t compressedInput = 0;
+    uint32_t compressedOutput = 0;
+} logFileStats;
+
+static String segmentPath(uint32_t number, const char *extension)
+{
+    char path[32];
+    snprintf(path, sizeof(path), LOG_FILE_DIRECTORY "/%08u.%s", (unsigned)number, extension);
+    return String(path);
+}
+
+/**
+ * Calls visit with each segment file: its number, extension and size.
+ */
+static void forEachSegmentFile(std::function<void(uint32_t, const char *, size_t)> visit)
+{
+    File directory = LittleFS.open(LOG_FILE_DIRECTORY, "r");
+    if (!directory || !directory.isDirectory())
+        return;
+    for (File file = directory.openNextFile(); file; file = directory.openNextFile())
+    {
+        const char *name = file.name();
+        const char *slash = strrchr(name, '/');
+        if (slash != nullptr)
+            name = slash + 1;
+        char *extension;
+        uint32_t number = strtoul(name, &extension, 10);
+        if (extension != name && *extension == '.')
+            visit(number, extension + 1, file.size());
+    }
+}
+
+static bool openSegment(uint32_t number)
+{
+    logSegment = LittleFS.open(segmentPath(number, "log"), "a");
+    if (!logSegment)
+        return false;
+    logSegmentNumber = number;
+    logSegmentSize = logSegment.size();
+    return true;
+}
+
+/**
+ * Deletes the oldest segments, down to LOG_FILE_MAX_SEGMENTS.
+ */
+static void deleteOldSegments()
+{
+    while (true)
+    {
+        uint32_t oldest = UINT32_MAX;
+        uint16_t count = 0;
+        forEachSegmentFile([&](uint32_t number, const char *extension, size_t)
+                           {
+            if (strcmp(extension, "log") != 0 && strcmp(extension, "lz") != 0)
+                return;
+            count++;
+            oldest = std::min(oldest, number); });
+        if (count <= LOG_FILE_MAX_SEGMENTS || oldest == logSegmentNumber)
+            return;
+        LittleFS.remove(segmentPath(oldest, "log"));
+        LittleFS.remove(segmentPath(oldest, "lz"));
+    }
+}
+
+/**
+ * Mounts LittleFS, and appends to the last segment if it is not full. Boot lines logged
+ * before are still in the log ring, and end up in the file too.
+ */
+bool beginLogFile()
+{
+    if (!mountLittleFs())
+    {
+        LOG_ERROR(F("log files: cannot mount LittleFS, log files off"));
+        return false;
+    }
+    if (!LittleFS.exists(LOG_FILE_DIRECTORY))
+        LittleFS.mkdir(LOG_FILE_DIRECTORY);
+
+    uint32_t newest = 0;
+    size_t newestSize = LOG_FILE_SEGMENT_SIZE; // closed
+    uint32_t interrupted[4]; // compressions interrupted by a reset
+    uint8_t interruptedCount = 0;
+    forEachSegmentFile([&](uint32_t number, const char *extension, size_t size)
+                       {
+        if (strcmp(extension, "tmp") == 0)
+        {
+            if (interruptedCount < sizeof(interrupted) / sizeof(interrupted[0]))
+                interrupted[interruptedCount++] = number;
+            return;
+        }
+        if (number > newest || (number == newest && strcmp(extension, "log") == 0))
+        {
+            newest = number;
+            newestSize = strcmp(extension, "log") == 0 ? size : LOG_FILE_SEGMENT_SIZE;
+        } });
+    for (uint8_t i = 0; i < interruptedCount; i++)
+        LittleFS.remove(segmentPath(interrupted[i], "tmp"));
+
+    uint32_t number = newestSize < LOG_FILE_SEGMENT_SIZE ? newest : newest + 1;
+    char *buffer = new (std::nothrow) char[logFileBufferSize];
+    if (buffer == nullptr || !openSegment(number))
+    {
+        delete[] buffer;
+        LOGF_ERROR("log files: cannot open segment %u", (unsigned)number);
+        return false;
+    }
+    deleteOldSegments();
+    logCompressionPending = true;
+    {
+        SharedStateLock lock;
+        logFileBuffer = buffer;
+    }
+    LOGF_INFO("log files: appending to segment %u, %u bytes", (unsigned)number, (unsigned)logSegmentSize);
+    return true;
+}
+
+bool logFileEnabled()
+{
+    return logFileBuffer != nullptr;
+}
+
+/**
+ * Called by drainLogs() with each line. Dropped, and counted, if the buffer is full.
+ */
+void writeLogFile(uint8_t tag, const char *line, size_t length)
+{
+    SharedStateLock lock;
+    if (logFileBuffer == nullptr)
+        return;
+    if (logFileBuffered + length > logFileBufferSize)
+    {
+        logFileStats.droppedLines++;
+        return;
+    }
+    memcpy(logFileBuffer + logFileBuffered, line, length);
+    logFileBuffered += length;
+    logFileStats.lines++;
+    if (logTagLevel(tag) == LOG_LEVEL_ERROR)
+        logFileSyncRequested = true; // a reset often follows
+}
+
+/**
+ * Writes the first length buffered bytes to the segment, not synced.
+ */
+static void writeBuffered(size_t length)
+{
+    // Without the lock: drainLogs() only appends after logFileBuffered
+    size_t written = logSegment.write(reinterpret_cast<const uint8_t *>(logFileBuffer), length);
+    logSegmentUnsynced = true;
+    logSegmentSize += written;
+    logFileStats.writes++;
+    logFileStats.bytesWritten += written;
+    if (written != length)
+        logFileStats.writeErrors++;
+
+    SharedStateLock lock;
+    memmove(logFileBuffer, logFileBuffer + length, logFileBuffered - length);
+    logFileBuffered -= length;
+}
+
+static void rotateSegment()
+{
+    logSegment.close(); // synced
+    logSegmentUnsynced = false;
+    logFileStats.segmentsClosed++;
+    if (!openSegment(logSegmentNumber + 1))
+    {
+        LOG_ERROR(F("log files: cannot start a new segment"));
+        SharedStateLock lock;
+        delete[] logFileBuffer;
+        logFileBuffer = nullptr;
+        return;
+    }
+    deleteOldSegments();
+    logCompressionPending = true;
+}
+
+/**
+ * Writes the whole pieces buffered, or everything and syncs the segment if sync.
+ */
+static void writeLogFileBuffer(bool sync)
+{
+    while (logFileBuffer != nullptr)
+    {
+        size_t buffered;
+        {
+            SharedStateLock lock;
+            buffered = logFileBuffered;
+        }
+        size_t toBoundary = LOG_FILE_WRITE_SIZE - logSegmentSize % LOG_FILE_WRITE_SIZE;
+        if (buffered >= toBoundary)
+        {
+            writeBuffered(toBoundary);
+        }
+        else
+        {
+            if (sync)
+            {
+                if (buffered > 0)
+                    writeBuffered(buffered); // the next write realigns
+                if (logSegmentUnsynced)
+                {
+                    logSegment.flush();
+                    logSegmentUnsynced = false;
+                    logFileStats.syncs++;
+                }
+                lastLogFileSyncMillis = millis();
+            }
+            return;
+        }
+        if (logSegmentSize >= LOG_FILE_SEGMENT_SIZE)
+            rotateSegment();
+    }
+}
+
+#if LOG_FILE_COMPRESSION
+/**
+ * Compresses the oldest closed segment not compressed yet, LOG_FILE_COMPRESSION_STEP bytes
+ * per call, into N.tmp, renamed N.lz once complete.
+ */
+static void compressStep()
+{
+    if (logCompression == nullptr)
+    {
+        if (!logCompressionPending)
+            return;
+        uint32_t oldest = UINT32_MAX;
+        forEachSegmentFile([&](uint32_t number, const char *extension, size_t)
+                           {
+            if (number != logSegmentNumber && strcmp(extension, "log") == 0)
+                oldest = std::min(oldest, number); });
+        if (oldest == UINT32_MAX)
+        {
+            logCompressionPending = false;
+            return;
+        }
+        if (LittleFS.exists(segmentPath(oldest, "lz")))
+        {
+            LittleFS.remove(segmentPath(oldest, "log")); // reset between the rename and the removal
+            return;
+        }
+        logCompression = new (std::nothrow) LogSegmentCompression();
+        if (logCompression == nullptr)
+            return; // next time
+        logCompression->number = oldest;
+        logCompression->input = LittleFS.open(segmentPath(oldest, "log"), "r");
+        logCompression->output = LittleFS.open(segmentPath(oldest, "tmp"), "w");
+        if (!logCompression->input || !logCompression->output)
+        {
+            LOGF_ERROR("log files: cannot compress segment %u", (unsigned)oldest);
+            delete logCompression;
+            logCompression = nullptr;
+            logCompressionPending = false;
+            return;
+        }
+        logCompression->encoder.begin(logCompression->output);
+    }
+
+    uint8_t chunk[256];
+    for (size_t step = 0; step < LOG_FILE_COMPRESSION_STEP; step += sizeof(chunk))
+    {
+        size_t length = logCompression->input.read(chunk, sizeof(chunk));
+        if (length > 0)
+        {
+            logCompression->encoder.write(chunk, length);
+            logFileStats.compressedInput += length;
+            continue;
+        }
+
+        logCompression->encoder.end();
+        logCompression->input.close();
+        logCompression->output.close();
+        uint32_t number = logCompression->number;
+        logFileStats.compressedOutput += logCompression->encoder.getWritten();
+        delete logCompression;
+        logCompression = nullptr;
+        if (LittleFS.rename(segmentPath(number, "tmp"), segmentPath(number, "lz")))
+        {
+            LittleFS.remove(segmentPath(number, "log"));
+            logFileStats.segmentsCompressed++;
+        }
+        return;
+    }
+}
+#endif
+
+/**
+ * Writes the buffered lines by whole pieces, rotates the segment when full, and compresses
+ * closed segments a step at a time.
+ */
+void flushLogFile()
+{
+    bool expected = false;
+    if (!logFileBusy.compare_exchange_strong(expected, true))
+        return;
+    bool sync = logFileSyncRequested.exchange(false) || millis() - lastLogFileSyncMillis >= logFileSyncIntervalMillis;
+    writeLogFileBuffer(sync);
+#if LOG_FILE_COMPRESSION
+    compressStep();
+#endif
+    logFileBusy = false;
+}
+
+/**
+ * Writes every buffered line now: before a restart, see flushLogs().
+ */
+void syncLogFile()
+{
+    uint32_t start = millis();
+    bool expected = false;
+    while (!logFileBusy.compare_exchange_strong(expected, true))
+    {
+        if (millis() - start > 1000)
+            return;
+        expected = false;
+        delay(1);
+    }
+    writeLogFileBuffer(true);
+    logFileBusy = false;
+}
+
+String logFilesToJson()
+{
+    JsonDocument doc;
+    doc["segmentSize"] = LOG_FILE_SEGMENT_SIZE;
+    doc["maxSegments"] = LOG_FILE_MAX_SEGMENTS;
+    doc["writeSize"] = LOG_FILE_WRITE_SIZE;
+    doc["current"] = logSegmentNumber;
+    {
+        SharedStateLock lock;
+        doc["buffered"] = logFileBuffered;
+        doc["lines"] = logFileStats.lines;
+        doc["droppedLines"] = logFileStats.droppedLines;
+    }
+    doc["writes"] = logFileStats.writes;
+    doc["syncs"] = logFileStats.syncs;
+    doc["bytesWritten"] = logFileStats.bytesWritten;
+    doc["writeErrors"] = logFileStats.writeErrors;
+    doc["segmentsClosed"] = logFileStats.segmentsClosed;
+    doc["segmentsCompressed"] = logFileStats.segmentsCompressed;
+    if (logFileStats.compressedOutput > 0)
+        doc["compressionRatio"] = (float)logFileStats.compressedInput / logFileStats.compressedOutput;
+
+    JsonArray segments = doc["segments"].to<JsonArray>();
+    forEachSegmentFile([&](uint32_t number, const char *extension, size_t size)
+                       {
+        if (strcmp(extension, "log") != 0 && strcmp(extension, "lz") != 0)
+            return;
+        JsonObject segment = segments.add<JsonObject>();
+        segment["number"] = number;
+        segment["size"] = size;
+        segment["compressed"] = strcmp(extension, "lz") == 0; });
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
+
+LogSegmentReader::~LogSegmentReader()
+{
+    delete decoder;
+}
+
+bool LogSegmentReader::open(uint32_t number)
+{
+    file = LittleFS.open(segmentPath(number, "lz"), "r");
+    if (!file)
+    {
+        file = LittleFS.open(segmentPath(number, "log"), "r");
+        return (bool)file;
+    }
+    uint8_t magic[4];
+    decoder = new (std::nothrow) LogLzDecoder();
+    if (decoder == nullptr || file.read(magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, "ELZ1", sizeof(magic)) != 0)
+        return false;
+    decoder->begin();
+    return true;
+}
+
+/**
+ * Up to size bytes of text, 0 at the end of the segment.
+ */
+size_t LogSegmentReader::read(uint8_t *output, size_t size)
+{
+    if (decoder == nullptr)
+        return file.read(output, size);
+
+    size_t total = 0;
+    while (total < size)
+    {
+        if (inputOffset == inputLength)
+        {
+            inputLength = file.read(input, sizeof(input));
+            inputOffset = 0;
+        }
+        size_t consumed;
+        size_t decoded = decoder->decode(input + inputOffset, inputLength - inputOffset, consumed, output + total, size - total);
+        inputOffset += consumed;
+        total += decoded;
+        if (decoded == 0 && consumed == 0)
+            break;
+    }
+    return total;
+}
+
+#endif // LOG_FILE
@@ -0,0 +1,99 @@
+#ifndef LOG_FILE_H
+#define LOG_FILE_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "common/log_lz.h"
+
+// Log files on LittleFS, selected with a build flag: -DLOG_FILE=1. Off by default
+#ifndef LOG_FILE
+#define LOG_FILE 0
+#endif
+
+#define LOG_FILE_DIRECTORY "/logs"
+
+// The segment being written is closed past that size, and a new one started
+#ifndef LOG_FILE_SEGMENT_SIZE
+#ifdef ESP32
+#define LOG_FILE_SEGMENT_SIZE (64 * 1024)
+#elif defined(ESP8266)
+#define LOG_FILE_SEGMENT_SIZE (32 * 1024)
+#endif
+#endif
+
+// Segments kept, the one being written included: the oldest ones are deleted
+#ifndef LOG_FILE_MAX_SEGMENTS
+#ifdef ESP32
+#define LOG_FILE_MAX_SEGMENTS 16
+#elif defined(ESP8266)
+#define LOG_FILE_MAX_SEGMENTS 8
+#endif
+#endif
+
+// Bytes handed to LittleFS per write, ending at a multiple of it in the segment
+#ifndef LOG_FILE_WRITE_SIZE
+#ifdef ESP32
+#define LOG_FILE_WRITE_SIZE 4096
+#elif defined(ESP8266)
+#define LOG_FILE_WRITE_SIZE 1024
+#endif
+#endif
+
+// Closed segments are LZ compressed (see log_lz.h), with 4.7KB of RAM while one is
+#ifndef LOG_FILE_COMPRESSION
+#ifdef ESP32
+#define LOG_FILE_COMPRESSION 1
+#elif defined(ESP8266)
+#define LOG_FILE_COMPRESSION 0
+#endif
+#endif
+
+// Segment bytes compressed per flushLogFile()
+#ifndef LOG_FILE_COMPRESSION_STEP
+#define LOG_FILE_COMPRESSION_STEP 2048
+#endif
+
+/*
+  Log lines kept on LittleFS across resets, in numbered segment files under /logs:
+  00000042.log while being written, 00000042.lz once closed and compressed.
+
+  drainLogs() copies each line into a RAM buffer of 2 * LOG_FILE_WRITE_SIZE. flushLogFile()
+  writes it in LOG_FILE_WRITE_SIZE pieces, each ending on a multiple of it in the segment,
+  so that LittleFS gets a few large writes instead of one per line. LittleFS lays the file
+  out in its own blocks (a segment's offsets do not map to flash pages) and programs them
+  as its cache fills, but they only survive a reset once the file is synced, which commits
+  its metadata. So the segment is synced, with the lines still in RAM, only when an error
+  is logged (a reset often follows), every logFileSyncIntervalMillis if anything was
+  written, when it is closed, and by flushLogs() before a restart. A reset loses at most
+  the lines of the last logFileSyncIntervalMillis.
+
+  LittleFS is never formatted here: if it does not mount, the log files are off.
+*/
+bool beginLogFile();
+bool logFileEnabled();
+void writeLogFile(uint8_t tag, const char *line, size_t length);
+void flushLogFile();
+void syncLogFile();
+String logFilesToJson();
+
+/**
+ * Reads a segment as text, uncompressed on the fly: a few hundred bytes of RAM, plus 2KB
+ * for a compressed one.
+ */
+class LogSegmentReader
+{
+private:
+    File file;
+    LogLzDecoder *decoder = nullptr; // compressed segments only
+    uint8_t input[256];
+    size_t inputLength = 0;
+    size_t inputOffset = 0;
+
+public:
+    ~LogSegmentReader();
+    bool open(uint32_t number);
+    size_t read(uint8_t *output, size_t size);
+};
+
+#endif // LOG_FILE_H
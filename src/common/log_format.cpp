@@ -0,0 +1,194 @@
+#include "common/log_format.h"
+
+void LogArgumentWriter::write(uint8_t type, const void *value, size_t valueLength)
+{
+    if (length + 1 + valueLength > size)
+        return;
+    buffer[length] = type;
+    memcpy(buffer + length + 1, value, valueLength);
+    length += 1 + valueLength;
+}
+
+void LogArgumentWriter::writeString(const char *text, size_t textLength, bool progmem)
+{
+    if (textLength > LOG_FORMAT_MAX_STRING)
+        textLength = LOG_FORMAT_MAX_STRING;
+    if (length + 2 > size)
+        return;
+    if (length + 2 + textLength > size)
+        textLength = size - length - 2;
+    buffer[length] = LOG_ARG_STRING;
+    buffer[length + 1] = textLength;
+    if (progmem)
+        memcpy_P(buffer + length + 2, text, textLength);
+    else
+        memcpy(buffer + length + 2, text, textLength);
+    length += 2 + textLength;
+}
+
+static bool isConversion(char c)
+{
+    return c != 0 && strchr("diouxXcsfFeEgGaAp", c) != nullptr;
+}
+
+// Appends one argument, converted according to its stored type. Returns the bytes it takes.
+static size_t appendArgument(const char *spec, char conversion, const uint8_t *argument, size_t remaining, String &text)
+{
+    char format[24];
+    char piece[LOG_FORMAT_MAX_STRING + 40];
+    int written = -1;
+    size_t used = 0;
+    switch (remaining > 0 ? argument[0] : 0)
+    {
+    case LOG_ARG_INT32:
+    case LOG_ARG_UINT32:
+    {
+        uint32_t value;
+        if (remaining < 1 + sizeof(value))
+            break;
+        memcpy(&value, argument + 1, sizeof(value));
+        used = 1 + sizeof(value);
+        if (conversion == 'c')
+        {
+            snprintf(format, sizeof(format), "%sc", spec);
+            written = snprintf(piece, sizeof(piece), format, (int)value);
+        }
+        else if (strchr("ouxX", conversion) != nullptr || (argument[0] == LOG_ARG_UINT32 && conversion != 'd' && conversion != 'i'))
+        {
+            snprintf(format, sizeof(format), "%sl%c", spec, strchr("ouxX", conversion) != nullptr ? conversion : 'u');
+            written = snprintf(piece, sizeof(piece), format, (unsigned long)value);
+        }
+        else
+        {
+            snprintf(format, sizeof(format), "%sld", spec);
+            written = snprintf(piece, sizeof(piece), format, argument[0] == LOG_ARG_INT32 ? (long)(int32_t)value : (long)value);
+        }
+        break;
+    }
+    case LOG_ARG_INT64:
+    case LOG_ARG_UINT64:
+    {
+        uint64_t value;
+        if (remaining < 1 + sizeof(value))
+            break;
+        memcpy(&value, argument + 1, sizeof(value));
+        used = 1 + sizeof(value);
+        if (strchr("ouxX", conversion) != nullptr || (argument[0] == LOG_ARG_UINT64 && conversion != 'd' && conversion != 'i'))
+        {
+            snprintf(format, sizeof(format), "%sll%c", spec, strchr("ouxX", conversion) != nullptr ? conversion : 'u');
+            written = snprintf(piece, sizeof(piece), format, (unsigned long long)value);
+        }
+        else
+        {
+            snprintf(format, sizeof(format), "%slld", spec);
+            written = snprintf(piece, sizeof(piece), format, (long long)(int64_t)value);
+        }
+        break;
+    }
+    case LOG_ARG_DOUBLE:
+    {
+        double value;
+        if (remaining < 1 + sizeof(value))
+            break;
+        memcpy(&value, argument + 1, sizeof(value));
+        used = 1 + sizeof(value);
+        snprintf(format, sizeof(format), "%s%c", spec, strchr("fFeEgGaA", conversion) != nullptr ? conversion : 'g');
+        written = snprintf(piece, sizeof(piece), format, value);
+        break;
+    }
+    case LOG_ARG_STRING:
+    {
+        if (remaining < 2 || remaining < 2u + argument[1])
+            break;
+        size_t length = argument[1];
+        used = 2 + length;
+        if (spec[1] == 0)
+        {
+            // Plain "%s": no copy
+            text.concat(reinterpret_cast<const char *>(argument + 2), length);
+            return used;
+        }
+        char value[LOG_FORMAT_MAX_STRING + 1];
+        memcpy(value, argument + 2, length);
+        value[length] = 0;
+        snprintf(format, sizeof(format), "%ss", spec);
+        written = snprintf(piece, sizeof(piece), format, value);
+        break;
+    }
+    default:
+        break;
+    }
+
+    if (used == 0)
+    {
+        // Fewer arguments than conversions, or a truncated record
+        text += F("<?>");
+        return remaining;
+    }
+    if (written > 0)
+        text.concat(piece, std::min<size_t>(written, sizeof(piece) - 1));
+    return used;
+}
+
+/**
+ * Appends format, read from flash, with its packed arguments. Only flags, width and
+ * precision of each conversion are used: the stored type decides how it is printed.
+ */
+void formatLogArguments(PGM_P format, const uint8_t *arguments, size_t length, String &text)
+{
+    size_t offset = 0;
+    size_t index = 0;
+    while (true)
+    {
+        char c = pgm_read_byte(format + index++);
+        if (c == 0)
+            break;
+        if (c != '%')
+        {
+            text += c;
+            continue;
+        }
+        if (pgm_read_byte(format + index) == '%')
+        {
+            text += '%';
+            index++;
+            continue;
+        }
+
+        // Flags, width and precision are kept, length modifiers are dropped
+        char spec[12] = "%";
+        size_t specLength = 1;
+        char conversion;
+        while (true)
+        {
+            conversion = pgm_read_byte(format + index);
+            if (conversion == 0 || isConversion(conversion))
+                break;
+            index++;
+            if (strchr("-+ #0123456789.", conversion) != nullptr && specLength < sizeof(spec) - 1)
+                spec[specLength++] = conversion;
+        }
+        spec[specLength] = 0;
+        if (conversion == 0)
+            break;
+        index++;
+        offset += appendArgument(spec, conversion, arguments + offset, length - offset, text);
+    }
+}
+
+/**
+ * Appends the text of a ring record payload, formatting it if it is a deferred-format one.
+ */
+void formatLogPayload(uint8_t flags, const uint8_t *payload, size_t length, String &text)
+{
+    if ((flags & LogRing::FLAG_FORMAT) == 0)
+    {
+        text.concat(reinterpret_cast<const char *>(payload), length);
+        return;
+    }
+    PGM_P format;
+    if (length < sizeof(format))
+        return;
+    memcpy(&format, payload, sizeof(format));
+    formatLogArguments(format, payload + sizeof(format), length - sizeof(format), text);
+}
@@ -0,0 +1,133 @@
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <Arduino.h>
+
+#include "common/log_ring.h"
+
+/*
+  Deferred-format log records: LOGF_INFO("client #%u from %s", id, name) stores the pointer
+  to its flash-resident format string and the raw argument values in the log ring, with
+  no String and no formatting. The record is formatted by its consumers (Serial, the logs
+  WebSocket, /logs), or on a computer by tools/decode_logs.py from a /logs?binary dump.
+
+  Arguments are stored as a type byte followed by the value, little-endian:
+    'i' int32, 'u' uint32, 'I' int64, 'U' uint64, 'd' double,
+    's' string: one length byte then the characters, truncated to LOG_FORMAT_MAX_STRING.
+  The conversion is picked from the stored type, so "%d" with an unsigned or "%s" with a
+  number still prints the value; the format only gives flags, width and precision.
+  Arguments are taken by reference: cast packed struct fields and static const members,
+  e.g. (unsigned)Traits::schemaVersion.
+*/
+
+// Bytes of packed arguments per record; the ones that do not fit are dropped
+#ifndef LOG_FORMAT_MAX_ARGUMENTS_SIZE
+#define LOG_FORMAT_MAX_ARGUMENTS_SIZE 128
+#endif
+#ifndef LOG_FORMAT_MAX_STRING
+#define LOG_FORMAT_MAX_STRING 48
+#endif
+
+static_assert(LOG_FORMAT_MAX_STRING <= UINT8_MAX, "string lengths are stored in one byte");
+
+enum LogArgumentType : uint8_t
+{
+    LOG_ARG_INT32 = 'i',
+    LOG_ARG_UINT32 = 'u',
+    LOG_ARG_INT64 = 'I',
+    LOG_ARG_UINT64 = 'U',
+    LOG_ARG_DOUBLE = 'd',
+    LOG_ARG_STRING = 's',
+};
+
+class LogArgumentWriter
+{
+private:
+    uint8_t *buffer;
+    size_t size;
+    size_t length = 0;
+
+public:
+    LogArgumentWriter(uint8_t *buffer_, size_t size_) : buffer(buffer_), size(size_) {}
+
+    void write(uint8_t type, const void *value, size_t valueLength);
+    void writeString(const char *text, size_t textLength, bool progmem);
+    size_t getLength() const { return length; }
+};
+
+inline void logPackSigned(LogArgumentWriter &writer, long long value, size_t size)
+{
+    if (size <= sizeof(int32_t))
+    {
+        int32_t stored = value;
+        writer.write(LOG_ARG_INT32, &stored, sizeof(stored));
+    }
+    else
+    {
+        int64_t stored = value;
+        writer.write(LOG_ARG_INT64, &stored, sizeof(stored));
+    }
+}
+
+inline void logPackUnsigned(LogArgumentWriter &writer, unsigned long long value, size_t size)
+{
+    if (size <= sizeof(uint32_t))
+    {
+        uint32_t stored = value;
+        writer.write(LOG_ARG_UINT32, &stored, sizeof(stored));
+    }
+    else
+    {
+        uint64_t stored = value;
+        writer.write(LOG_ARG_UINT64, &stored, sizeof(stored));
+    }
+}
+
+// bool, char and the small integers are promoted to int; any other type does not compile
+inline void logPackArgument(LogArgumentWriter &writer, int value) { logPackSigned(writer, value, sizeof(value)); }
+inline void logPackArgument(LogArgumentWriter &writer, long value) { logPackSigned(writer, value, sizeof(value)); }
+inline void logPackArgument(LogArgumentWriter &writer, long long value) { logPackSigned(writer, value, sizeof(value)); }
+inline void logPackArgument(LogArgumentWriter &writer, unsigned value) { logPackUnsigned(writer, value, sizeof(value)); }
+inline void logPackArgument(LogArgumentWriter &writer, unsigned long value) { logPackUnsigned(writer, value, sizeof(value)); }
+inline void logPackArgument(LogArgumentWriter &writer, unsigned long long value) { logPackUnsigned(writer, value, sizeof(value)); }
+inline void logPackArgument(LogArgumentWriter &writer, double value) { writer.write(LOG_ARG_DOUBLE, &value, sizeof(value)); }
+inline void logPackArgument(LogArgumentWriter &writer, const char *value)
+{
+    writer.writeString(value, value != nullptr ? strlen(value) : 0, false);
+}
+inline void logPackArgument(LogArgumentWriter &writer, const __FlashStringHelper *value)
+{
+    PGM_P text = reinterpret_cast<PGM_P>(value);
+    writer.writeString(text, strlen_P(text), true);
+}
+inline void logPackArgument(LogArgumentWriter &writer, const String &value)
+{
+    writer.writeString(value.c_str(), value.length(), false);
+}
+
+inline void logPackArguments(LogArgumentWriter &writer) { (void)writer; }
+
+template <typename T, typename... Rest>
+void logPackArguments(LogArgumentWriter &writer, const T &first, const Rest &...rest)
+{
+    logPackArgument(writer, first);
+    logPackArguments(writer, rest...);
+}
+
+/**
+ * What the LOGF_xxx() macros expand to. format must stay valid forever: a literal, or PSTR().
+ */
+template <typename... Args>
+void logFormat(uint8_t tag, PGM_P format, const Args &...args)
+{
+    uint8_t record[sizeof(format) + LOG_FORMAT_MAX_ARGUMENTS_SIZE];
+    memcpy(record, &format, sizeof(format));
+    LogArgumentWriter writer(record + sizeof(format), LOG_FORMAT_MAX_ARGUMENTS_SIZE);
+    logPackArguments(writer, args...);
+    logRing.push(tag, LogRing::FLAG_FORMAT | LogRing::FLAG_NEWLINE, record, sizeof(format) + writer.getLength());
+}
+
+void formatLogArguments(PGM_P format, const uint8_t *arguments, size_t length, String &text);
+void formatLogPayload(uint8_t flags, const uint8_t *payload, size_t length, String &text);
+
+#endif // LOG_FORMAT_H
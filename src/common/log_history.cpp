@@ -0,0 +1,89 @@
+#define LOG_MODULE LOG_MODULE_LOGS
+
+#include "common/log_history.h"
+
+#include "common/globals.h"
+#include "common/log_format.h"
+#include "common/shared_state.h"
+
+LogHistory logHistory;
+
+void LogHistory::copyIn(const void *data, size_t length)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < length; i++)
+        buffer[(head + i) % LOG_HISTORY_SIZE] = bytes[i];
+    head += length;
+}
+
+void LogHistory::append(uint8_t tag, uint8_t flags, const uint8_t *payload, size_t length)
+{
+    size_t entrySize = entryHeaderSize + length;
+    if (entrySize > LOG_HISTORY_SIZE)
+        return;
+
+    SharedStateLock lock;
+    // Drops the oldest entries until this one fits
+    while (head + entrySize - tail > LOG_HISTORY_SIZE)
+    {
+        uint16_t oldestLength = buffer[tail % LOG_HISTORY_SIZE] | buffer[(tail + 1) % LOG_HISTORY_SIZE] << 8;
+        tail += entryHeaderSize + oldestLength;
+    }
+    uint8_t header[entryHeaderSize] = {(uint8_t)length, (uint8_t)(length >> 8), flags, tag};
+    copyIn(header, sizeof(header));
+    copyIn(payload, length);
+}
+
+/**
+ * Copies the entries, oldest first, to a new[] buffer: the lock is only held for the copy.
+ */
+size_t LogHistory::snapshot(uint8_t *&entries) const
+{
+    SharedStateLock lock;
+    size_t length = head - tail;
+    entries = new uint8_t[length > 0 ? length : 1];
+    for (size_t i = 0; i < length; i++)
+        entries[i] = buffer[(tail + i) % LOG_HISTORY_SIZE];
+    return length;
+}
+
+/**
+ * Formats the entries as drainLogs() does.
+ */
+String LogHistory::toText() const
+{
+    uint8_t *entries;
+    size_t length = snapshot(entries);
+    String text;
+    bool atLineStart = true;
+    for (size_t offset = 0; offset + entryHeaderSize <= length;)
+    {
+        const uint8_t *entry = entries + offset;
+        size_t payloadLength = entry[0] | entry[1] << 8;
+        uint8_t flags = entry[2];
+        if (atLineStart)
+        {
+            char prefix[24];
+            text.concat(prefix, formatLogPrefix(entry[3], prefix, sizeof(prefix)));
+        }
+        formatLogPayload(flags, entry + entryHeaderSize, payloadLength, text);
+        atLineStart = flags & LogRing::FLAG_NEWLINE;
+        if (atLineStart)
+            text += '\n';
+        offset += entryHeaderSize + payloadLength;
+    }
+    delete[] entries;
+    return text;
+}
+
+void LogHistory::toBinary(Print &out) const
+{
+    uint8_t *entries;
+    size_t length = snapshot(entries);
+    size_t versionLength = std::min<size_t>(strlen(SW_VERSION), UINT8_MAX);
+    uint8_t header[] = {'E', 'L', 'O', 'G', 1, sizeof(const char *), (uint8_t)versionLength};
+    out.write(header, sizeof(header));
+    out.write(reinterpret_cast<const uint8_t *>(SW_VERSION), versionLength);
+    out.write(entries, length);
+    delete[] entries;
+}
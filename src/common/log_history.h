@@ -0,0 +1,45 @@
+#ifndef LOG_HISTORY_H
+#define LOG_HISTORY_H
+
+#include <Arduino.h>
+
+#ifndef LOG_HISTORY_SIZE
+#ifdef ESP32
+#define LOG_HISTORY_SIZE 4096
+#elif defined(ESP8266)
+#define LOG_HISTORY_SIZE 1024
+#endif
+#endif
+
+static_assert((LOG_HISTORY_SIZE & (LOG_HISTORY_SIZE - 1)) == 0, "LOG_HISTORY_SIZE must be a power of two");
+
+/*
+  The last drained log records, as stored in the ring: deferred-format ones stay unformatted
+  until /logs reads them. The oldest records are overwritten. Written by drainLogs() only.
+
+  /logs?binary dumps it for tools/decode_logs.py:
+    "ELOG", version (1), pointer size, version string length, the firmware version,
+    then the records, oldest first: length (uint16), flags, tag, payload.
+  Integers are little-endian.
+*/
+class LogHistory
+{
+private:
+    uint8_t buffer[LOG_HISTORY_SIZE];
+    uint32_t head = 0; // absolute positions, as in LogRing
+    uint32_t tail = 0;
+
+    void copyIn(const void *data, size_t length);
+    size_t snapshot(uint8_t *&entries) const;
+
+public:
+    static const uint8_t entryHeaderSize = 4;
+
+    void append(uint8_t tag, uint8_t flags, const uint8_t *payload, size_t length);
+    String toText() const;
+    void toBinary(Print &out) const;
+};
+
+extern LogHistory logHistory;
+
+#endif // LOG_HISTORY_H
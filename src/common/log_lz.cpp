@@ -0,0 +1,172 @@
+#include "common/log_lz.h"
+
+static const uint8_t logLzMagic[4] = {'E', 'L', 'Z', '1'};
+
+static_assert(LogLzEncoder::maxMatch - LogLzEncoder::minMatch < 32 && LogLzEncoder::windowSize <= 2048,
+              "a match is 5 bits of length and 11 bits of distance");
+
+void LogLzEncoder::begin(Print &output_)
+{
+    output = &output_;
+    filled = 0;
+    position = 0;
+    groupLength = 1;
+    groupItems = 0;
+    group[0] = 0;
+    memset(heads, 0, sizeof(heads));
+    written = output->write(logLzMagic, sizeof(logLzMagic));
+}
+
+void LogLzEncoder::writeGroup()
+{
+    written += output->write(group, groupLength);
+    group[0] = 0;
+    groupLength = 1;
+    groupItems = 0;
+}
+
+void LogLzEncoder::insertHash(size_t at)
+{
+    if (at + minMatch <= filled)
+        heads[hash(buffer + at)] = at + 1;
+}
+
+/**
+ * Encodes the buffered input up to end, with the longest match found through the hash table.
+ */
+void LogLzEncoder::encode(size_t end)
+{
+    while (position < end)
+    {
+        size_t length = 0;
+        size_t distance = 0;
+        if (position + minMatch <= filled)
+        {
+            uint16_t head = heads[hash(buffer + position)];
+            if (head != 0 && position - (head - 1) <= windowSize)
+            {
+                size_t candidate = head - 1;
+                size_t limit = std::min((size_t)maxMatch, filled - position);
+                while (length < limit && buffer[candidate + length] == buffer[position + length])
+                    length++;
+                distance = position - candidate;
+            }
+        }
+
+        if (length >= minMatch)
+        {
+            uint16_t token = (length - minMatch) << 11 | (distance - 1);
+            group[groupLength++] = token & 0xFF;
+            group[groupLength++] = token >> 8;
+            for (size_t i = 0; i < length; i++)
+                insertHash(position + i);
+            position += length;
+        }
+        else
+        {
+            group[0] |= 1 << groupItems;
+            group[groupLength++] = buffer[position];
+            insertHash(position);
+            position++;
+        }
+        if (++groupItems == 8)
+            writeGroup();
+    }
+}
+
+/**
+ * Encodes data, except the last maxMatch bytes, kept until more input comes or end().
+ */
+void LogLzEncoder::write(const uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        if (filled == sizeof(buffer))
+        {
+            // Slides the window: only the last windowSize bytes before position are kept
+            size_t shift = position - windowSize;
+            memmove(buffer, buffer + shift, filled - shift);
+            filled -= shift;
+            position -= shift;
+            for (uint16_t &head : heads)
+                head = head > shift ? head - shift : 0;
+        }
+        size_t chunk = std::min(length, sizeof(buffer) - filled);
+        memcpy(buffer + filled, data, chunk);
+        filled += chunk;
+        data += chunk;
+        length -= chunk;
+        if (filled > maxMatch)
+            encode(filled - maxMatch);
+    }
+}
+
+void LogLzEncoder::end()
+{
+    encode(filled);
+    if (groupItems > 0)
+        writeGroup();
+}
+
+void LogLzDecoder::begin()
+{
+    windowPosition = 0;
+    flagBits = 0;
+    hasTokenLow = false;
+    matchRemaining = 0;
+}
+
+inline void LogLzDecoder::emit(uint8_t byte, uint8_t *output, size_t &written)
+{
+    window[windowPosition] = byte;
+    windowPosition = (windowPosition + 1) % LogLzEncoder::windowSize;
+    output[written++] = byte;
+}
+
+/**
+ * Decodes input into output, until either is exhausted: resumable, calls can split the input
+ * and the output anywhere. Returns the bytes written, consumed is set to the bytes read.
+ * The stream's magic must be skipped by the caller.
+ */
+size_t LogLzDecoder::decode(const uint8_t *input, size_t inputLength, size_t &consumed, uint8_t *output, size_t outputSize)
+{
+    size_t written = 0;
+    consumed = 0;
+    while (written < outputSize)
+    {
+        if (matchRemaining > 0)
+        {
+            emit(window[(windowPosition + LogLzEncoder::windowSize - matchDistance) % LogLzEncoder::windowSize], output, written);
+            matchRemaining--;
+            continue;
+        }
+        if (consumed == inputLength)
+            break;
+        if (flagBits == 0)
+        {
+            flags = input[consumed++];
+            flagBits = 8;
+            continue;
+        }
+        if (flags & 1)
+        {
+            emit(input[consumed++], output, written);
+            flags >>= 1;
+            flagBits--;
+            continue;
+        }
+        if (!hasTokenLow)
+        {
+            tokenLow = input[consumed++];
+            hasTokenLow = true;
+            continue;
+        }
+        uint16_t token = tokenLow | input[consumed++] << 8;
+        hasTokenLow = false;
+        matchDistance = (token & 0x7FF) + 1;
+        matchRemaining = (token >> 11) + LogLzEncoder::minMatch;
+        flags >>= 1;
+        flagBits--;
+    }
+    return written;
+}
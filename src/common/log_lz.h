@@ -0,0 +1,68 @@
+#ifndef LOG_LZ_H
+#define LOG_LZ_H
+
+#include <Arduino.h>
+
+/*
+  LZSS compression of the closed log segments (see log_file.h), in the spirit of heatshrink:
+  streaming, a few KB of RAM, no dependency.
+
+  A stream starts with "ELZ1", then groups of 8 items, each group a flag byte followed by its
+  items, from its lowest bit: 1 is a literal byte, 0 a match of 2 bytes, little-endian,
+  (length - 3) << 11 | (distance - 1): the length bytes seen distance bytes back, 3..34
+  bytes up to 2048 back. The stream ends with the file: the last group may be incomplete.
+*/
+class LogLzEncoder
+{
+public:
+    static const size_t windowSize = 2048;
+    static const size_t minMatch = 3;
+    static const size_t maxMatch = 34;
+
+private:
+    static const size_t blockSize = 512; // input encoded per slide of the window
+    static const size_t hashSize = 1024;
+
+    uint8_t buffer[windowSize + blockSize]; // history, then the input not encoded yet
+    size_t filled = 0;
+    size_t position = 0; // next byte to encode
+    uint16_t heads[hashSize]; // last position + 1 of each 3 bytes hash, 0: none
+
+    Print *output = nullptr;
+    uint8_t group[1 + 8 * 2];
+    size_t groupLength = 0;
+    uint8_t groupItems = 0;
+    uint32_t written = 0;
+
+    static uint16_t hash(const uint8_t *data) { return ((data[0] << 6) ^ (data[1] << 3) ^ data[2]) & (hashSize - 1); }
+    void encode(size_t end);
+    void insertHash(size_t at);
+    void writeGroup();
+
+public:
+    void begin(Print &output_);
+    void write(const uint8_t *data, size_t length);
+    void end();
+    uint32_t getWritten() const { return written; }
+};
+
+class LogLzDecoder
+{
+private:
+    uint8_t window[LogLzEncoder::windowSize];
+    size_t windowPosition = 0;
+    uint8_t flags = 0;
+    uint8_t flagBits = 0; // items of the group still to read
+    uint8_t tokenLow = 0;
+    bool hasTokenLow = false; // first byte of a match read, waiting for the second
+    uint16_t matchDistance = 0;
+    uint8_t matchRemaining = 0; // bytes of the current match not output yet
+
+    void emit(uint8_t byte, uint8_t *output, size_t &written);
+
+public:
+    void begin();
+    size_t decode(const uint8_t *input, size_t inputLength, size_t &consumed, uint8_t *output, size_t outputSize);
+};
+
+#endif // LOG_LZ_H
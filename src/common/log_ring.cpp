@@ -0,0 +1,228 @@
+#define LOG_MODULE LOG_MODULE_LOGS
+
+#include "common/log.h"
+
+#include <ArduinoJson.h>
+
+#include "common/globals.h"
+#include "common/log_file.h"
+#include "common/log_format.h"
+#include "common/log_history.h"
+#include "common/log_syslog.h"
+#include "common/log_websocket.h"
+
+static_assert(sizeof(LogRing::RecordHeader) == 8, "records are 8 bytes aligned");
+
+LogRing logRing;
+
+// Longer lines are truncated, so that one line never takes most of the ring
+const size_t logRingMaxLineLength = LOG_RING_SIZE / 4 - sizeof(LogRing::RecordHeader);
+
+inline uint32_t logRecordSize(size_t length)
+{
+    return (sizeof(LogRing::RecordHeader) + length + 7) & ~7u;
+}
+
+/**
+ * Safe from any task or ISR, except with a progmem payload. Returns false, and counts the
+ * line as dropped, if the ring is full.
+ */
+bool IRAM_ATTR LogRing::push(uint8_t tag, uint8_t flags, const void *payload, size_t length, bool progmem)
+{
+    if (length > logRingMaxLineLength)
+        length = logRingMaxLineLength;
+    uint32_t recordSize = logRecordSize(length);
+
+    uint32_t position = head.load(std::memory_order_relaxed);
+    uint32_t padding;
+    do
+    {
+        // A record never wraps: the end of the buffer is skipped when it does not fit
+        uint32_t toEnd = LOG_RING_SIZE - position % LOG_RING_SIZE;
+        padding = recordSize > toEnd ? toEnd : 0;
+        if (position + padding + recordSize - tail.load(std::memory_order_acquire) > LOG_RING_SIZE)
+        {
+            droppedLines++;
+            droppedBytes += length;
+            return false;
+        }
+    } while (!head.compare_exchange_weak(position, position + padding + recordSize,
+                                         std::memory_order_acq_rel, std::memory_order_relaxed));
+
+    if (padding != 0)
+    {
+        RecordHeader *paddingRecord = headerAt(position);
+        paddingRecord->length = 0;
+        paddingRecord->flags = FLAG_PADDING;
+        paddingRecord->position.store(position, std::memory_order_release);
+        position += padding;
+    }
+    RecordHeader *record = headerAt(position);
+    record->length = length;
+    record->flags = flags;
+    record->tag = tag;
+    if (progmem)
+        memcpy_P(reinterpret_cast<uint8_t *>(record + 1), payload, length);
+    else
+        memcpy(reinterpret_cast<uint8_t *>(record + 1), payload, length);
+    record->position.store(position, std::memory_order_release);
+
+    pushedLines++;
+    uint32_t usedBytes = position + recordSize - tail.load(std::memory_order_relaxed);
+    if (usedBytes > highWater)
+        highWater = usedBytes;
+    return true;
+}
+
+const LogRing::RecordHeader *LogRing::peek()
+{
+    while (true)
+    {
+        uint32_t position = tail.load(std::memory_order_relaxed);
+        if (position == head.load(std::memory_order_acquire))
+            return nullptr;
+        RecordHeader *record = headerAt(position);
+        // Reserved, but still being written
+        if (record->position.load(std::memory_order_acquire) != position)
+            return nullptr;
+        if ((record->flags & FLAG_PADDING) == 0)
+            return record;
+        pop();
+    }
+}
+
+void LogRing::pop()
+{
+    uint32_t position = tail.load(std::memory_order_relaxed);
+    RecordHeader *record = headerAt(position);
+    uint32_t recordSize = (record->flags & FLAG_PADDING) ? LOG_RING_SIZE - position % LOG_RING_SIZE : logRecordSize(record->length);
+    tail.store(position + recordSize, std::memory_order_release);
+}
+
+String LogRing::statsToJson() const
+{
+    JsonDocument doc;
+    doc["size"] = LOG_RING_SIZE;
+    doc["used"] = used();
+    doc["highWater"] = highWater;
+    doc["lines"] = pushedLines;
+    doc["droppedLines"] = droppedLines.load();
+    doc["droppedBytes"] = droppedBytes.load();
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
+
+/**
+ * What the LOG_xxx() macros expand to: never blocks, see drainLogs().
+ */
+void logWrite(uint8_t tag, const char *text, size_t length, bool newline)
+{
+    logRing.push(tag, newline ? LogRing::FLAG_NEWLINE : 0, text, length);
+}
+
+// Single consumer: drainLogs() can be called from several tasks, only one drains at a time
+std::atomic<bool> logDraining(false);
+String drainLine;               // the oldest record, rendered: prefix, text, newline; kept, so it no longer allocates once grown
+bool drainLineRendered = false; // drainLine holds the oldest record, already sent to the other outputs
+size_t serialOffset = 0;        // bytes of drainLine already written to Serial
+bool atLineStart = true; // the previous record ended its line: the next one gets a prefix
+uint32_t reportedDroppedLines = 0;
+
+/**
+ * Writes published lines to Serial, as far as its buffer allows without blocking, and queues
+ * them for the logs WebSocket clients (see log_websocket.h), the log collector (see
+ * log_syslog.h) and the log files (see log_file.h). What does not fit in the UART is left
+ * for the next drain.
+ */
+void drainLogs()
+{
+    bool expected = false;
+    if (!logDraining.compare_exchange_strong(expected, true))
+        return;
+
+    bool toWebsocket = logWebsocketHasClients();
+    bool toSyslog = logSyslogEnabled();
+#if LOG_FILE
+    bool toFile = logFileEnabled();
+#endif
+    const LogRing::RecordHeader *record;
+    while ((record = logRing.peek()) != nullptr)
+    {
+        // First time this record is seen: rendered once, formatted if deferred, even when the
+        // UART takes none of it for several drains
+        if (!drainLineRendered)
+        {
+            drainLine = "";
+            // "[W][wifi] " in front of each line, not of the rest of a LOG_PRINT() line
+            size_t prefixLength = 0;
+            if (atLineStart)
+            {
+                char prefix[24];
+                prefixLength = formatLogPrefix(record->tag, prefix, sizeof(prefix));
+                drainLine.concat(prefix, prefixLength);
+            }
+            formatLogPayload(record->flags, logRing.payloadOf(record), record->length, drainLine);
+            if (record->flags & LogRing::FLAG_NEWLINE)
+                drainLine += '\n';
+            if (toWebsocket)
+                writeLogWebsocket(record->tag, drainLine.c_str(), drainLine.length());
+            // Syslog carries the level and module in its own fields
+            if (toSyslog)
+                writeLogSyslog(record->tag, atLineStart, drainLine.c_str() + prefixLength, drainLine.length() - prefixLength);
+#if LOG_FILE
+            if (toFile)
+                writeLogFile(record->tag, drainLine.c_str(), drainLine.length());
+#endif
+            logHistory.append(record->tag, record->flags, logRing.payloadOf(record), record->length);
+            drainLineRendered = true;
+        }
+
+        while (serialOffset < drainLine.length())
+        {
+            int room = Serial.availableForWrite();
+            if (room <= 0)
+                break;
+            size_t written = Serial.write(reinterpret_cast<const uint8_t *>(drainLine.c_str()) + serialOffset,
+                                          std::min<size_t>(room, drainLine.length() - serialOffset));
+            if (written == 0)
+                break;
+            serialOffset += written;
+        }
+        if (serialOffset < drainLine.length())
+            break; // the UART is busy
+
+        serialOffset = 0;
+        drainLineRendered = false;
+        atLineStart = record->flags & LogRing::FLAG_NEWLINE;
+        logRing.pop();
+    }
+
+    uint32_t droppedLines = logRing.dropped();
+    if (droppedLines != reportedDroppedLines)
+    {
+        String notice = String(droppedLines - reportedDroppedLines) + " log lines dropped";
+        if (logRing.push(logTag(LOG_MODULE, LOG_LEVEL_WARN), LogRing::FLAG_NEWLINE, notice.c_str(), notice.length()))
+            reportedDroppedLines = droppedLines;
+    }
+    logDraining = false;
+}
+
+/**
+ * Drains until the ring is empty, or timeoutMillis, and writes the log file's buffer.
+ * Meant for the last lines before a restart, on the housekeeping task: see requestRestart().
+ */
+void flushLogs(uint32_t timeoutMillis)
+{
+    uint32_t start = millis();
+    while (logRing.used() > 0 && millis() - start < timeoutMillis)
+    {
+        drainLogs();
+        delay(1);
+    }
+#if LOG_FILE
+    syncLogFile();
+#endif
+    Serial.flush();
+}
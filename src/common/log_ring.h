@@ -0,0 +1,68 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#ifndef LOG_RING_SIZE
+#ifdef ESP32
+#define LOG_RING_SIZE 4096
+#elif defined(ESP8266)
+#define LOG_RING_SIZE 2048
+#endif
+#endif
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+
+/*
+  Lock-free ring of log lines, with many producers (tasks, ISRs) and a single consumer.
+  A producer reserves room with a compare-and-swap on head, copies its line, then publishes
+  it by storing the record's position in its header. The consumer stops at the first record
+  not published yet. Positions are absolute byte counts, so a stale header from a previous
+  lap never looks published. When there is no room, the line is dropped and counted: a
+  producer never waits.
+*/
+class LogRing
+{
+public:
+    struct RecordHeader
+    {
+        std::atomic<uint32_t> position; // published once it equals the record's position
+        uint16_t length;                // of the payload: text, or format pointer and arguments
+        uint8_t flags;
+        uint8_t tag; // level and module, see logTag()
+    };
+    static const uint8_t FLAG_PADDING = 1; // fills the end of the buffer, the record is at the start
+    static const uint8_t FLAG_NEWLINE = 2; // "\n" follows the text
+    static const uint8_t FLAG_FORMAT = 4;  // deferred-format record, see log_format.h
+
+private:
+    alignas(8) uint8_t buffer[LOG_RING_SIZE];
+    std::atomic<uint32_t> head{0}; // next position to reserve
+    std::atomic<uint32_t> tail{0}; // next position to consume
+    std::atomic<uint32_t> droppedLines{0};
+    std::atomic<uint32_t> droppedBytes{0};
+    uint32_t pushedLines = 0; // approximated under contention, stats only
+    uint32_t highWater = 0;
+
+    RecordHeader *headerAt(uint32_t position) { return reinterpret_cast<RecordHeader *>(buffer + position % LOG_RING_SIZE); }
+
+public:
+    bool push(uint8_t tag, uint8_t flags, const void *payload, size_t length, bool progmem = false);
+    // Consumer side: the oldest published record, nullptr if there is none
+    const RecordHeader *peek();
+    const uint8_t *payloadOf(const RecordHeader *record) const { return reinterpret_cast<const uint8_t *>(record + 1); }
+    void pop();
+
+    uint32_t used() const { return head.load() - tail.load(); }
+    uint32_t dropped() const { return droppedLines.load(); }
+    String statsToJson() const;
+};
+
+extern LogRing logRing;
+
+void logWrite(uint8_t tag, const char *text, size_t length, bool newline);
+void drainLogs();
+void flushLogs(uint32_t timeoutMillis = 1000);
+
+#endif // LOG_RING_H
@@ -0,0 +1,417 @@
+#define LOG_MODULE LOG_MODULE_LOGS
+
+#include "common/log_syslog.h"
+
+#include <ArduinoJson.h>
+#ifdef ESP32
+#include <WiFi.h>
+#elif defined(ESP8266)
+#include <ESP8266WiFi.h>
+#endif
+#include <WiFiUdp.h>
+#include <atomic>
+#include <lwip/dns.h>
+#include <new>
+
+#include "common/globals.h"
+#include "common/shared_state.h"
+
+#pragma pack(push, 1)
+// In front of each line in the queue
+struct LogSyslogEntry
+{
+    uint32_t sequence;
+    uint32_t uptimeMillis;
+    uint8_t tag;
+    uint16_t length; // of the text that follows
+};
+#pragma pack(pop)
+
+static_assert(LOG_SYSLOG_QUEUE_SIZE >= sizeof(LogSyslogEntry) + LOG_SYSLOG_MAX_LINE, "the queue must hold the longest line");
+static_assert(LOG_SYSLOG_DATAGRAM_SIZE >= 256, "a datagram must hold the message header and some text");
+
+// Collector, copied out of the device configuration by flushLogSyslog()
+struct LogSyslogTarget
+{
+    char host[sizeof(DeviceConfiguration::syslogHost) + 1] = "";
+    uint16_t port = 0;
+    uint8_t format = LOG_SYSLOG_RFC5424;
+    char hostname[sizeof(DeviceConfiguration::hostname) + 1] = "";
+};
+
+struct LogSyslogSink
+{
+    char *queue = nullptr; // nullptr: no collector configured
+    size_t length = 0;
+    size_t lastEntry = SIZE_MAX; // offset of the newest entry, that the rest of a LOG_PRINT() line extends
+    uint8_t *datagram = nullptr;
+    uint32_t nextSequence = 1;
+
+    uint32_t lines = 0;
+    uint32_t droppedLines = 0;
+    uint32_t sentLines = 0;
+    uint32_t datagrams = 0;
+    uint32_t sentBytes = 0;
+    uint32_t sendErrors = 0;
+};
+
+LogSyslogTarget syslogTarget;
+LogSyslogSink syslogSink;
+std::atomic<bool> syslogActive(false);
+// The collector's address, completed by the lwIP task: guarded by SharedStateLock
+IPAddress syslogAddress;
+bool syslogResolved = false;
+bool syslogResolving = false;         // a lookup is in progress
+bool syslogResolveFailed = false;     // the last lookup found nothing, not reported yet
+uintptr_t syslogResolveGeneration = 0; // bumped when the collector changes: older lookups are ignored
+// Only used by flushLogSyslog()
+bool syslogResolveTried = false;
+uint32_t syslogResolveMillis = 0;
+WiFiUDP syslogUdp;
+
+bool logSyslogEnabled()
+{
+    return syslogActive;
+}
+
+static LogSyslogEntry entryAt(size_t offset)
+{
+    LogSyslogEntry entry;
+    memcpy(&entry, syslogSink.queue + offset, sizeof(entry));
+    return entry;
+}
+
+static void removeOldest(size_t bytes)
+{
+    memmove(syslogSink.queue, syslogSink.queue + bytes, syslogSink.length - bytes);
+    syslogSink.length -= bytes;
+    if (syslogSink.lastEntry != SIZE_MAX)
+        syslogSink.lastEntry = syslogSink.lastEntry >= bytes ? syslogSink.lastEntry - bytes : SIZE_MAX;
+}
+
+/**
+ * Called by drainLogs() with each record, without its prefix. lineStart is false for the
+ * rest of a LOG_PRINT() line: it is appended to the line it continues.
+ */
+void writeLogSyslog(uint8_t tag, bool lineStart, const char *text, size_t length)
+{
+    if (length > 0 && text[length - 1] == '\n')
+        length--;
+    SharedStateLock lock;
+    if (syslogSink.queue == nullptr)
+        return;
+
+    if (!lineStart && syslogSink.lastEntry != SIZE_MAX)
+    {
+        LogSyslogEntry entry = entryAt(syslogSink.lastEntry);
+        length = std::min<size_t>(length, LOG_SYSLOG_MAX_LINE - entry.length);
+        length = std::min<size_t>(length, LOG_SYSLOG_QUEUE_SIZE - syslogSink.length);
+        memcpy(syslogSink.queue + syslogSink.length, text, length);
+        syslogSink.length += length;
+        entry.length += length;
+        memcpy(syslogSink.queue + syslogSink.lastEntry, &entry, sizeof(entry));
+        return;
+    }
+
+    if (length > LOG_SYSLOG_MAX_LINE)
+        length = LOG_SYSLOG_MAX_LINE;
+    // Full: the oldest lines make room
+    size_t dropped = 0;
+    while (syslogSink.length - dropped + sizeof(LogSyslogEntry) + length > LOG_SYSLOG_QUEUE_SIZE)
+    {
+        dropped += sizeof(LogSyslogEntry) + entryAt(dropped).length;
+        syslogSink.droppedLines++;
+    }
+    removeOldest(dropped);
+
+    LogSyslogEntry entry;
+    entry.sequence = syslogSink.nextSequence++;
+    entry.uptimeMillis = millis();
+    entry.tag = tag;
+    entry.length = length;
+    syslogSink.lastEntry = syslogSink.length;
+    memcpy(syslogSink.queue + syslogSink.length, &entry, sizeof(entry));
+    memcpy(syslogSink.queue + syslogSink.length + sizeof(entry), text, length);
+    syslogSink.length += sizeof(entry) + length;
+    syslogSink.lines++;
+}
+
+/**
+ * Writes the line to out, as an RFC 5424 message, its text cut to fit in room.
+ */
+static size_t writeRfc5424Message(uint8_t *out, size_t room, const LogSyslogEntry &entry, const char *text)
+{
+    // By log level: none (unused), error, warning, informational, debug, debug
+    static const uint8_t severities[] = {7, 3, 4, 6, 7, 7};
+    const uint8_t facilityLocal0 = 16;
+    uint8_t level = logTagLevel(entry.tag);
+    unsigned priority = facilityLocal0 * 8 + (level <= LOG_LEVEL_TRACE ? severities[level] : 7);
+
+    int headerLength = snprintf(reinterpret_cast<char *>(out), room, "<%u>1 - %s %s - - [meta sequenceId=\"%u\" sysUpTime=\"%u\"] ",
+                                priority, syslogTarget.hostname[0] != '\0' ? syslogTarget.hostname : "-",
+                                logModuleName(logTagModule(entry.tag)), (unsigned)entry.sequence, (unsigned)(entry.uptimeMillis / 10));
+    if (headerLength < 0 || (size_t)headerLength >= room)
+        return 0;
+    size_t textLength = std::min<size_t>(entry.length, room - headerLength);
+    memcpy(out + headerLength, text, textLength);
+    return headerLength + textLength;
+}
+
+/**
+ * Appends the line to out, framed. 0 if it does not fit in room, unless truncate.
+ */
+static size_t appendFramedLine(uint8_t *out, size_t room, const LogSyslogEntry &entry, const char *text, bool truncate)
+{
+    const size_t headerLength = sizeof(entry.uptimeMillis) + sizeof(entry.tag) + sizeof(entry.length);
+    uint16_t textLength = entry.length;
+    if (headerLength + textLength > room)
+    {
+        if (!truncate || room < headerLength)
+            return 0;
+        textLength = room - headerLength;
+    }
+    memcpy(out, &entry.uptimeMillis, sizeof(entry.uptimeMillis));
+    out[4] = entry.tag;
+    memcpy(out + 5, &textLength, sizeof(textLength));
+    memcpy(out + headerLength, text, textLength);
+    return headerLength + textLength;
+}
+
+/**
+ * Moves the oldest queued lines into the datagram: as many as it holds when framed, the
+ * oldest one in RFC 5424. Returns its length.
+ */
+static size_t buildDatagram()
+{
+    uint8_t *out = syslogSink.datagram;
+    if (syslogTarget.format != LOG_SYSLOG_FRAMED)
+    {
+        LogSyslogEntry entry = entryAt(0);
+        size_t length = writeRfc5424Message(out, LOG_SYSLOG_DATAGRAM_SIZE, entry, syslogSink.queue + sizeof(entry));
+        removeOldest(sizeof(entry) + entry.length);
+        syslogSink.sentLines++;
+        return length;
+    }
+
+    uint8_t hostnameLength = strlen(syslogTarget.hostname);
+    uint32_t firstSequence = entryAt(0).sequence;
+    memcpy(out, "ELGU", 4);
+    out[4] = 1; // version
+    out[5] = hostnameLength;
+    memcpy(out + 6, syslogTarget.hostname, hostnameLength);
+    size_t length = 6 + hostnameLength;
+    memcpy(out + length, &firstSequence, sizeof(firstSequence));
+    memcpy(out + length + 4, &syslogSink.droppedLines, sizeof(syslogSink.droppedLines));
+    size_t countOffset = length + 8;
+    length = countOffset + sizeof(uint16_t);
+
+    uint16_t count = 0;
+    size_t consumed = 0;
+    while (consumed < syslogSink.length)
+    {
+        LogSyslogEntry entry = entryAt(consumed);
+        const char *text = syslogSink.queue + consumed + sizeof(entry);
+        size_t added = appendFramedLine(out + length, LOG_SYSLOG_DATAGRAM_SIZE - length, entry, text, count == 0);
+        if (added == 0)
+            break;
+        length += added;
+        consumed += sizeof(entry) + entry.length;
+        count++;
+    }
+    memcpy(out + countOffset, &count, sizeof(count));
+    removeOldest(consumed);
+    syslogSink.sentLines += count;
+    return length;
+}
+
+/**
+ * Picks up a change of the collector in the device configuration: the queue is allocated
+ * when one is set, and freed when it is removed. Returns whether logs are shipped.
+ */
+static bool refreshTarget()
+{
+    LogSyslogTarget configured;
+    {
+        SharedStateLock lock;
+        if (currentDeviceConfiguration != nullptr)
+        {
+            strlcpy(configured.host, currentDeviceConfiguration->syslogHost, std::min(sizeof(configured.host), sizeof(currentDeviceConfiguration->syslogHost) + 1));
+            configured.port = currentDeviceConfiguration->syslogPort;
+            configured.format = currentDeviceConfiguration->syslogFormat;
+            strlcpy(configured.hostname, currentDeviceConfiguration->hostname, std::min(sizeof(configured.hostname), sizeof(currentDeviceConfiguration->hostname) + 1));
+        }
+    }
+    if (strcmp(configured.host, syslogTarget.host) == 0 && configured.port == syslogTarget.port &&
+        configured.format == syslogTarget.format && strcmp(configured.hostname, syslogTarget.hostname) == 0)
+        return syslogActive;
+
+    {
+        SharedStateLock lock;
+        syslogTarget = configured;
+        syslogResolved = false;
+        syslogResolving = false;
+        syslogResolveFailed = false;
+        syslogResolveGeneration++;
+        syslogResolveTried = false;
+        delete[] syslogSink.queue;
+        delete[] syslogSink.datagram;
+        syslogSink.queue = nullptr;
+        syslogSink.datagram = nullptr;
+        syslogSink.length = 0;
+        syslogSink.lastEntry = SIZE_MAX;
+        if (syslogTarget.host[0] != '\0')
+        {
+            syslogSink.queue = new (std::nothrow) char[LOG_SYSLOG_QUEUE_SIZE];
+            syslogSink.datagram = new (std::nothrow) uint8_t[LOG_SYSLOG_DATAGRAM_SIZE];
+            if (syslogSink.queue == nullptr || syslogSink.datagram == nullptr)
+            {
+                delete[] syslogSink.queue;
+                delete[] syslogSink.datagram;
+                syslogSink.queue = nullptr;
+                syslogSink.datagram = nullptr;
+            }
+        }
+        syslogActive = syslogSink.queue != nullptr;
+    }
+
+    if (syslogActive)
+        LOGF_INFO("shipping logs to %s:%u", syslogTarget.host, (unsigned)syslogTarget.port);
+    else if (syslogTarget.host[0] != '\0')
+        LOGF_ERROR("no memory to ship logs to %s", syslogTarget.host);
+    return syslogActive;
+}
+
+/**
+ * Completes a lookup started by resolveTarget(), on the lwIP task. ipaddr is nullptr if the
+ * host name was not found.
+ */
+static void syslogHostFound(const char *name, const ip_addr_t *ipaddr, void *generation)
+{
+    (void)name;
+    SharedStateLock lock;
+    if (reinterpret_cast<uintptr_t>(generation) != syslogResolveGeneration)
+        return; // the collector changed meanwhile
+    syslogResolving = false;
+    if (ipaddr == nullptr || !IP_IS_V4(ipaddr))
+    {
+        syslogResolveFailed = true;
+        return;
+    }
+    syslogAddress = IPAddress(ip_2_ip4(ipaddr)->addr);
+    syslogResolved = true;
+}
+
+/**
+ * Whether the collector has an address. Starts a lookup of its host name in the background
+ * when it has none, at most once every LOG_SYSLOG_RESOLVE_RETRY_MILLIS, and refreshes it every
+ * LOG_SYSLOG_RESOLVE_REFRESH_MILLIS. An address given as the host is taken as is.
+ */
+static bool resolveTarget()
+{
+    bool resolved;
+    bool failed;
+    uintptr_t generation;
+    {
+        SharedStateLock lock;
+        if (syslogResolving)
+            return syslogResolved;
+        resolved = syslogResolved;
+        failed = syslogResolveFailed;
+        syslogResolveFailed = false;
+        generation = syslogResolveGeneration;
+    }
+    if (failed)
+        LOGF_WARN("cannot resolve log collector %s", syslogTarget.host);
+    uint32_t interval = resolved ? LOG_SYSLOG_RESOLVE_REFRESH_MILLIS : LOG_SYSLOG_RESOLVE_RETRY_MILLIS;
+    if (syslogResolveTried && millis() - syslogResolveMillis < interval)
+        return resolved;
+    syslogResolveTried = true;
+    syslogResolveMillis = millis();
+
+    IPAddress address;
+    if (address.fromString(syslogTarget.host))
+    {
+        SharedStateLock lock;
+        syslogAddress = address;
+        syslogResolved = true;
+        return true;
+    }
+
+    {
+        SharedStateLock lock;
+        syslogResolving = true;
+    }
+    ip_addr_t found;
+    void *callbackArgument = reinterpret_cast<void *>(generation);
+    err_t result = dns_gethostbyname(syslogTarget.host, &found, syslogHostFound, callbackArgument);
+    // Otherwise answered from lwIP's cache, or failed: the callback is not called
+    if (result != ERR_INPROGRESS)
+        syslogHostFound(syslogTarget.host, result == ERR_OK ? &found : nullptr, callbackArgument);
+
+    SharedStateLock lock;
+    return syslogResolved;
+}
+
+/**
+ * Sends the oldest queued lines: one datagram framed, up to LOG_SYSLOG_MESSAGES_PER_FLUSH in
+ * RFC 5424. Until WiFi is connected and the collector resolved, lines wait in the queue, and
+ * the oldest ones get dropped.
+ * Only called from the scheduler: the target and the datagram are not shared with other tasks.
+ */
+void flushLogSyslog()
+{
+    if (!refreshTarget())
+        return;
+    if (WiFi.status() != WL_CONNECTED)
+        return;
+    if (!resolveTarget())
+        return;
+
+    uint8_t datagrams = syslogTarget.format == LOG_SYSLOG_FRAMED ? 1 : LOG_SYSLOG_MESSAGES_PER_FLUSH;
+    for (uint8_t datagram = 0; datagram < datagrams; datagram++)
+    {
+        size_t length;
+        {
+            SharedStateLock lock;
+            if (syslogSink.length == 0)
+                return;
+            length = buildDatagram();
+        }
+        bool sent = syslogUdp.beginPacket(syslogAddress, syslogTarget.port) &&
+                    syslogUdp.write(syslogSink.datagram, length) == length &&
+                    syslogUdp.endPacket();
+
+        SharedStateLock lock;
+        if (!sent)
+        {
+            syslogSink.sendErrors++;
+            return;
+        }
+        syslogSink.datagrams++;
+        syslogSink.sentBytes += length;
+    }
+}
+
+String logSyslogStatsToJson()
+{
+    JsonDocument doc;
+    {
+        SharedStateLock lock;
+        doc["host"] = syslogTarget.host;
+        doc["port"] = syslogTarget.port;
+        doc["format"] = syslogTarget.format == LOG_SYSLOG_FRAMED ? "framed" : "rfc5424";
+        doc["address"] = syslogResolved ? syslogAddress.toString() : String();
+        doc["queueSize"] = LOG_SYSLOG_QUEUE_SIZE;
+        doc["queued"] = syslogSink.length;
+        doc["lines"] = syslogSink.lines;
+        doc["droppedLines"] = syslogSink.droppedLines;
+        doc["sentLines"] = syslogSink.sentLines;
+        doc["datagrams"] = syslogSink.datagrams;
+        doc["bytes"] = syslogSink.sentBytes;
+        doc["sendErrors"] = syslogSink.sendErrors;
+    }
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
@@ -0,0 +1,73 @@
+#ifndef LOG_SYSLOG_H
+#define LOG_SYSLOG_H
+
+#include <Arduino.h>
+
+// Bytes of lines waiting for the next datagram, allocated when a collector is configured
+#ifndef LOG_SYSLOG_QUEUE_SIZE
+#ifdef ESP32
+#define LOG_SYSLOG_QUEUE_SIZE 4096
+#elif defined(ESP8266)
+#define LOG_SYSLOG_QUEUE_SIZE 1536
+#endif
+#endif
+
+// Payload of one datagram: a 1500 bytes MTU carries it unfragmented
+#ifndef LOG_SYSLOG_DATAGRAM_SIZE
+#define LOG_SYSLOG_DATAGRAM_SIZE 1400
+#endif
+
+// RFC 5424 datagrams sent per flush at most, one message each (RFC 5426)
+#ifndef LOG_SYSLOG_MESSAGES_PER_FLUSH
+#define LOG_SYSLOG_MESSAGES_PER_FLUSH 8
+#endif
+
+// Characters kept per line
+#ifndef LOG_SYSLOG_MAX_LINE
+#define LOG_SYSLOG_MAX_LINE 256
+#endif
+
+// Between two tries to resolve the collector's host name
+#ifndef LOG_SYSLOG_RESOLVE_RETRY_MILLIS
+#define LOG_SYSLOG_RESOLVE_RETRY_MILLIS 30000
+#endif
+
+// Between two resolutions of a resolved host name, in case its address changed
+#ifndef LOG_SYSLOG_RESOLVE_REFRESH_MILLIS
+#define LOG_SYSLOG_RESOLVE_REFRESH_MILLIS (60 * 60 * 1000)
+#endif
+
+/*
+  Ships the log lines to a collector over UDP, set by the syslogHost, syslogPort and
+  syslogFormat fields of the device configuration. drainLogs() copies each line into a
+  bounded queue, which drops its oldest lines when full. Every logSyslogFlushIntervalMillis,
+  the framed format sends at most one datagram, with as many queued lines as it holds; RFC
+  5424 sends one datagram per line, as collectors expect (RFC 5426), up to
+  LOG_SYSLOG_MESSAGES_PER_FLUSH of them.
+  The collector's host name is resolved by lwIP in the background, the flush never waits for
+  the DNS server: lines stay queued until the first answer, and a refresh keeps using the
+  cached address meanwhile.
+
+  Every line gets a sequence number when queued: a gap on the collector's side is a line
+  lost, in the queue or on the network. Two formats:
+  - LOG_SYSLOG_RFC5424: one RFC 5424 message per line and per datagram, facility local0:
+      <132>1 - hostname wifi - - [meta sequenceId="42" sysUpTime="12345"] text
+    No timestamp (the device has no clock): sysUpTime is in hundredths of second.
+  - LOG_SYSLOG_FRAMED: binary, little-endian:
+      "ELGU", version 1, hostname length (1 byte), hostname,
+      first sequence number (4), lines dropped so far (4), line count (2),
+      then per line: uptime in ms (4), tag (1), text length (2), text.
+  tools/log_listener.py receives both and measures the loss.
+*/
+enum LogSyslogFormat : uint8_t
+{
+    LOG_SYSLOG_RFC5424 = 0,
+    LOG_SYSLOG_FRAMED = 1,
+};
+
+bool logSyslogEnabled();
+void writeLogSyslog(uint8_t tag, bool lineStart, const char *text, size_t length);
+void flushLogSyslog();
+String logSyslogStatsToJson();
+
+#endif // LOG_SYSLOG_H
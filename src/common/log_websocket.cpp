@@ -0,0 +1,298 @@
+#define LOG_MODULE LOG_MODULE_LOGS
+
+#include "common/log_websocket.h"
+
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "common/globals.h"
+#include "common/shared_state.h"
+
+struct LogWebsocketClient
+{
+    uint32_t id = 0;
+    char *queue = nullptr; // nullptr: free slot
+    size_t length = 0;
+    // Subscription
+    uint8_t minLevel = LOG_LEVEL_TRACE;
+    uint32_t modules = UINT32_MAX; // bit per LogModule
+    char filter[LOG_WEBSOCKET_FILTER_SIZE + 1] = "";
+
+    uint32_t filteredLines = 0;
+    uint32_t droppedLines = 0;
+    uint32_t droppedBytes = 0;
+    uint32_t frames = 0;
+    uint32_t sentBytes = 0;
+};
+
+LogWebsocketClient logWebsocketClients[LOG_WEBSOCKET_MAX_CLIENTS];
+std::atomic<uint8_t> logWebsocketClientCount(0);
+uint32_t framesBuilt = 0; // fewer than the frames sent when clients share them
+
+/**
+ * Gives the client a queue. False if LOG_WEBSOCKET_MAX_CLIENTS are connected already.
+ */
+bool addLogWebsocketClient(uint32_t id)
+{
+    SharedStateLock lock;
+    for (LogWebsocketClient &client : logWebsocketClients)
+    {
+        if (client.queue != nullptr)
+            continue;
+        client = LogWebsocketClient();
+        client.queue = new (std::nothrow) char[LOG_WEBSOCKET_QUEUE_SIZE];
+        if (client.queue == nullptr)
+            return false;
+        client.id = id;
+        logWebsocketClientCount++;
+        return true;
+    }
+    return false;
+}
+
+void removeLogWebsocketClient(uint32_t id)
+{
+    SharedStateLock lock;
+    for (LogWebsocketClient &client : logWebsocketClients)
+    {
+        if (client.queue == nullptr || client.id != id)
+            continue;
+        delete[] client.queue;
+        client.queue = nullptr;
+        logWebsocketClientCount--;
+    }
+}
+
+bool logWebsocketHasClients()
+{
+    return logWebsocketClientCount > 0;
+}
+
+/**
+ * Appends the line to the queue, dropping its oldest lines to make room.
+ */
+static void enqueueLine(LogWebsocketClient &client, const char *line, size_t length)
+{
+    if (length > LOG_WEBSOCKET_QUEUE_SIZE)
+    {
+        line += length - LOG_WEBSOCKET_QUEUE_SIZE;
+        length = LOG_WEBSOCKET_QUEUE_SIZE;
+    }
+    if (client.length + length > LOG_WEBSOCKET_QUEUE_SIZE)
+    {
+        // Whole lines: up to the end of the line that frees enough room
+        size_t needed = client.length + length - LOG_WEBSOCKET_QUEUE_SIZE;
+        const char *lineEnd = static_cast<const char *>(memchr(client.queue + needed - 1, '\n', client.length - needed + 1));
+        size_t dropped = lineEnd != nullptr ? lineEnd + 1 - client.queue : client.length;
+        for (const char *c = client.queue; (c = static_cast<const char *>(memchr(c, '\n', client.queue + dropped - c))) != nullptr; c++)
+            client.droppedLines++;
+        client.droppedBytes += dropped;
+        memmove(client.queue, client.queue + dropped, client.length - dropped);
+        client.length -= dropped;
+    }
+    memcpy(client.queue + client.length, line, length);
+    client.length += length;
+}
+
+/**
+ * Replaces the subscription of the client with the one in message, see log_websocket.h.
+ * Returns the reply to send it: the subscription now in effect, or an error.
+ */
+String subscribeLogWebsocket(uint32_t id, const uint8_t *message, size_t length)
+{
+    JsonDocument request;
+    JsonDocument reply;
+    if (deserializeJson(request, message, length) != DeserializationError::Ok || !request.is<JsonObject>())
+    {
+        reply["error"] = "expected {\"level\": \"warn\", \"modules\": [\"wifi\"], \"filter\": \"text\"}";
+        String json;
+        serializeJson(reply, json);
+        return json;
+    }
+
+    int minLevel = LOG_LEVEL_TRACE;
+    if (request["level"].is<const char *>())
+        minLevel = logLevelFromName(request["level"].as<const char *>());
+    uint32_t modules = UINT32_MAX;
+    if (request["modules"].is<JsonArrayConst>())
+    {
+        modules = 0;
+        for (JsonVariantConst name : request["modules"].as<JsonArrayConst>())
+        {
+            int module = logModuleFromName(name.as<const char *>());
+            if (module < 0)
+            {
+                minLevel = -1;
+                break;
+            }
+            modules |= 1u << module;
+        }
+    }
+    const char *filter = request["filter"] | "";
+    if (minLevel < 0 || strlen(filter) > LOG_WEBSOCKET_FILTER_SIZE)
+    {
+        reply["error"] = "unknown level or module, or filter too long";
+        String json;
+        serializeJson(reply, json);
+        return json;
+    }
+
+    bool found = false;
+    {
+        SharedStateLock lock;
+        for (LogWebsocketClient &client : logWebsocketClients)
+        {
+            if (client.queue == nullptr || client.id != id)
+                continue;
+            client.minLevel = minLevel;
+            client.modules = modules;
+            strcpy(client.filter, filter);
+            found = true;
+        }
+    }
+    if (!found)
+    {
+        reply["error"] = "not a log client";
+    }
+    else
+    {
+        JsonObject subscription = reply["subscription"].to<JsonObject>();
+        subscription["level"] = logLevelName(minLevel);
+        JsonArray names = subscription["modules"].to<JsonArray>();
+        for (uint8_t module = 0; module < LOG_MODULE_COUNT; module++)
+            if (modules & (1u << module))
+                names.add(logModuleName(module));
+        subscription["filter"] = filter;
+    }
+    String json;
+    serializeJson(reply, json);
+    return json;
+}
+
+static bool containsText(const char *text, size_t length, const char *pattern)
+{
+    size_t patternLength = strlen(pattern);
+    if (patternLength == 0)
+        return true;
+    for (const char *end = text + length; (size_t)(end - text) >= patternLength; text++)
+    {
+        text = static_cast<const char *>(memchr(text, pattern[0], end - text - patternLength + 1));
+        if (text == nullptr)
+            return false;
+        if (memcmp(text, pattern, patternLength) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Called by drainLogs() with each line: copied to the queue of every client subscribed to it.
+ */
+void writeLogWebsocket(uint8_t tag, const char *line, size_t length)
+{
+    uint8_t level = logTagLevel(tag);
+    uint32_t module = 1u << logTagModule(tag);
+    SharedStateLock lock;
+    for (LogWebsocketClient &client : logWebsocketClients)
+    {
+        if (client.queue == nullptr)
+            continue;
+        if (level > client.minLevel || (client.modules & module) == 0 || !containsText(line, length, client.filter))
+        {
+            client.filteredLines++;
+            continue;
+        }
+        enqueueLine(client, line, length);
+    }
+}
+
+/**
+ * Sends each client's queue as one frame, unless it still has frames in flight.
+ * Clients whose queues hold the same lines, the usual case, share one frame: it is built
+ * once, and AsyncWebSocket frees it when the last of them has sent it.
+ * AsyncWebSocket is only called without the lock, and by client id: the client may be gone
+ * meanwhile, closed by the async_tcp task, and AsyncWebSocket looks it up under its own lock.
+ */
+void flushLogWebsocket()
+{
+    wsLogs.cleanupClients();
+
+    AsyncWebSocketSharedBuffer frames[LOG_WEBSOCKET_MAX_CLIENTS];
+    size_t frameCount = 0;
+    for (LogWebsocketClient &client : logWebsocketClients)
+    {
+        uint32_t id;
+        {
+            SharedStateLock lock;
+            if (client.queue == nullptr || client.length == 0)
+                continue;
+            id = client.id;
+        }
+        if (!wsLogs.availableForWrite(id))
+            continue; // backpressure: the lines wait, the oldest ones get dropped
+
+        AsyncWebSocketSharedBuffer frame;
+        size_t length;
+        {
+            SharedStateLock lock;
+            if (client.queue == nullptr || client.id != id)
+                continue; // disconnected meanwhile
+            length = client.length;
+            for (size_t i = 0; i < frameCount && !frame; i++)
+                if (frames[i]->size() == length && memcmp(frames[i]->data(), client.queue, length) == 0)
+                    frame = frames[i];
+            if (!frame)
+            {
+                const uint8_t *queue = reinterpret_cast<const uint8_t *>(client.queue);
+                frame = std::make_shared<std::vector<uint8_t>>(queue, queue + length);
+                frames[frameCount++] = frame;
+                framesBuilt++;
+            }
+            client.length = 0;
+        }
+        if (!wsLogs.text(id, frame))
+            continue; // gone meanwhile: removeLogWebsocketClient() follows
+
+        SharedStateLock lock;
+        if (client.id == id)
+        {
+            client.frames++;
+            client.sentBytes += length;
+        }
+    }
+}
+
+String logWebsocketStatsToJson()
+{
+    JsonDocument doc;
+    doc["maxClients"] = LOG_WEBSOCKET_MAX_CLIENTS;
+    doc["queueSize"] = LOG_WEBSOCKET_QUEUE_SIZE;
+    doc["framesBuilt"] = framesBuilt;
+    JsonArray clients = doc["clients"].to<JsonArray>();
+    {
+        SharedStateLock lock;
+        for (const LogWebsocketClient &client : logWebsocketClients)
+        {
+            if (client.queue == nullptr)
+                continue;
+            JsonObject entry = clients.add<JsonObject>();
+            entry["id"] = client.id;
+            entry["queued"] = client.length;
+            entry["level"] = logLevelName(client.minLevel);
+            entry["filter"] = client.filter;
+            entry["filteredLines"] = client.filteredLines;
+            entry["droppedLines"] = client.droppedLines;
+            entry["droppedBytes"] = client.droppedBytes;
+            entry["frames"] = client.frames;
+            entry["bytes"] = client.sentBytes;
+        }
+    }
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
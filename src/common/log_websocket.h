@@ -0,0 +1,50 @@
+#ifndef LOG_WEBSOCKET_H
+#define LOG_WEBSOCKET_H
+
+#include <Arduino.h>
+
+#ifndef LOG_WEBSOCKET_MAX_CLIENTS
+#ifdef ESP32
+#define LOG_WEBSOCKET_MAX_CLIENTS 4
+#elif defined(ESP8266)
+#define LOG_WEBSOCKET_MAX_CLIENTS 2
+#endif
+#endif
+
+// Bytes queued per client between two flushes, allocated when it connects
+#ifndef LOG_WEBSOCKET_QUEUE_SIZE
+#ifdef ESP32
+#define LOG_WEBSOCKET_QUEUE_SIZE 2048
+#elif defined(ESP8266)
+#define LOG_WEBSOCKET_QUEUE_SIZE 1024
+#endif
+#endif
+
+// Characters of a subscription's substring filter
+#ifndef LOG_WEBSOCKET_FILTER_SIZE
+#define LOG_WEBSOCKET_FILTER_SIZE 32
+#endif
+
+/*
+  Fan-out of the log lines to the /wsLogs clients. drainLogs() copies each line into a
+  bounded queue per client; every logWebsocketFlushIntervalMillis, each queue is sent as
+  one frame. A client that does not keep up (AsyncWebSocket holds WS_MAX_QUEUED_MESSAGES
+  frames not sent yet) gets nothing new: its queue fills up and its oldest lines are
+  dropped, and counted. So a slow client costs its queue plus WS_MAX_QUEUED_MESSAGES frames.
+
+  A client can subscribe to part of the lines by sending, as a text message:
+    {"level": "warn", "modules": ["wifi", "ota"], "filter": "CRC"}
+  Each field is optional, and a message replaces the previous subscription. The filter is
+  matched, case-sensitive, against each rendered record, "[W][wifi] " prefix included.
+  A line is checked before it is copied into a queue, so lines a client does not want
+  cost it nothing. Lines below the module's runtime level (/logLevels) are never drained.
+*/
+bool addLogWebsocketClient(uint32_t id);
+void removeLogWebsocketClient(uint32_t id);
+bool logWebsocketHasClients();
+String subscribeLogWebsocket(uint32_t id, const uint8_t *message, size_t length);
+void writeLogWebsocket(uint8_t tag, const char *line, size_t length);
+void flushLogWebsocket();
+String logWebsocketStatsToJson();
+
+#endif // LOG_WEBSOCKET_H
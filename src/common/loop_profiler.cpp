@@ -0,0 +1,168 @@
+#include "common/loop_profiler.h"
+
+#include "common/utils.h"
+
+const char *loopStageName(LoopStage stage)
+{
+    switch (stage)
+    {
+    case STAGE_HOUSEKEEPING:
+        return "housekeeping";
+    case STAGE_WATCHDOG:
+        return "watchdog";
+    case STAGE_WIFI:
+        return "wifi";
+    case STAGE_OTA:
+        return "ota";
+    case STAGE_VCC:
+        return "vcc";
+    case STAGE_ALIVE_LED:
+        return "aliveLed";
+    case STAGE_QUICK_RESTARTS:
+        return "quickRestarts";
+    case STAGE_CONFIG_MODE:
+        return "configMode";
+    case STAGE_WIFI_CHECK:
+        return "wifiCheck";
+    case STAGE_OTA_CHECK:
+        return "otaCheck";
+    case STAGE_MEMORY_STATS:
+        return "memoryStats";
+    case STAGE_LOG_DRAIN:
+        return "logDrain";
+    case STAGE_LOG_WEBSOCKET:
+        return "logWebsocket";
+    case STAGE_LOG_SYSLOG:
+        return "logSyslog";
+    case STAGE_LOG_FILE:
+        return "logFile";
+    default:
+        return "unknown";
+    }
+}
+
+#ifdef LOOP_PROFILING
+
+#include <ArduinoJson.h>
+
+LatencyHistogram stageHistograms[STAGE_COUNT];
+LatencyHistogram loopPeriodHistogram;
+uint64_t lastLoopStartMicros = 0;
+uint32_t lastLoopPeriodMicros = 0;
+uint32_t loopJitter16 = 0; // interarrival jitter (RFC 3550), scaled by 16
+
+uint8_t LatencyHistogram::bucketOf(uint32_t micros)
+{
+    if (micros < 2)
+        return micros;
+    uint8_t msb = 31 - __builtin_clz(micros);
+    return 2 * msb + ((micros >> (msb - 1)) & 1);
+}
+
+uint32_t LatencyHistogram::bucketUpperBound(uint8_t bucket)
+{
+    if (bucket < 2)
+        return bucket;
+    uint8_t msb = bucket / 2;
+    uint32_t halfOctave = 1UL << (msb - 1);
+    uint32_t lowerBound = (1UL << msb) | ((bucket & 1) ? halfOctave : 0);
+    return lowerBound + (halfOctave - 1);
+}
+
+void LatencyHistogram::add(uint32_t micros)
+{
+    uint8_t bucket = bucketOf(micros);
+    if (buckets[bucket] == UINT16_MAX)
+    {
+        for (uint8_t i = 0; i < bucketCount; i++)
+            buckets[i] /= 2;
+    }
+    buckets[bucket]++;
+
+    count++;
+    sumMicros += micros;
+    if (micros > maxMicros)
+        maxMicros = micros;
+}
+
+/**
+ * Upper bound of the bucket holding the given percentile, capped at the max seen.
+ */
+uint32_t LatencyHistogram::percentile(uint8_t percent) const
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < bucketCount; i++)
+        total += buckets[i];
+    if (total == 0)
+        return 0;
+
+    uint32_t rank = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < bucketCount; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return std::min(bucketUpperBound(i), maxMicros);
+    }
+    return maxMicros;
+}
+
+LoopStageTimer::LoopStageTimer(LoopStage stage_) : stage(stage_), startMicros(monotonicMicros()) {}
+
+LoopStageTimer::~LoopStageTimer()
+{
+    stageHistograms[stage].add(monotonicMicros() - startMicros);
+}
+
+/**
+ * Records the loop period and jitter. Called at the start of every commonLoop() pass.
+ */
+void profileLoopStart()
+{
+    uint64_t now = monotonicMicros();
+    if (lastLoopStartMicros != 0)
+    {
+        uint32_t period = now - lastLoopStartMicros;
+        loopPeriodHistogram.add(period);
+
+        if (lastLoopPeriodMicros != 0)
+        {
+            uint32_t delta = period > lastLoopPeriodMicros ? period - lastLoopPeriodMicros : lastLoopPeriodMicros - period;
+            loopJitter16 += delta - ((loopJitter16 + 8) >> 4);
+        }
+        lastLoopPeriodMicros = period;
+    }
+    lastLoopStartMicros = now;
+}
+
+void histogramToJson(const LatencyHistogram &histogram, JsonObject json)
+{
+    json["count"] = histogram.count;
+    json["meanMicros"] = histogram.count ? (uint32_t)(histogram.sumMicros / histogram.count) : 0;
+    json["p50Micros"] = histogram.percentile(50);
+    json["p99Micros"] = histogram.percentile(99);
+    json["maxMicros"] = histogram.maxMicros;
+}
+
+String loopStatsToJson()
+{
+    JsonDocument doc;
+
+    JsonObject loop = doc["loopPeriod"].to<JsonObject>();
+    histogramToJson(loopPeriodHistogram, loop);
+    loop["jitterMicros"] = loopJitter16 >> 4;
+
+    JsonObject stages = doc["stages"].to<JsonObject>();
+    for (uint8_t stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        if (stageHistograms[stage].count == 0)
+            continue;
+        histogramToJson(stageHistograms[stage], stages[loopStageName((LoopStage)stage)].to<JsonObject>());
+    }
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
+
+#endif // LOOP_PROFILING
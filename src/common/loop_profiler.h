@@ -0,0 +1,87 @@
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#include <Arduino.h>
+
+#include "common/globals.h"
+#include "common/reset_breadcrumbs.h"
+
+/**
+ * Housekeeping stages of commonLoop(), as tracked by the loop profiler.
+ */
+enum LoopStage : uint8_t
+{
+    STAGE_HOUSEKEEPING, // whole commonLoop() pass
+    STAGE_WATCHDOG,
+    STAGE_WIFI,
+    STAGE_OTA,
+    STAGE_VCC,
+    STAGE_ALIVE_LED,
+    STAGE_QUICK_RESTARTS,
+    STAGE_CONFIG_MODE,
+    STAGE_WIFI_CHECK,
+    STAGE_OTA_CHECK,
+    STAGE_MEMORY_STATS,
+    STAGE_LOG_DRAIN,
+    STAGE_LOG_WEBSOCKET,
+    STAGE_LOG_SYSLOG,
+    STAGE_LOG_FILE,
+    STAGE_COUNT
+};
+
+const char *loopStageName(LoopStage stage);
+
+#ifdef LOOP_PROFILING
+
+/*
+  Latency histogram with two buckets per power of two (half-octaves) of microseconds,
+  covering 0us..~71min in 64 buckets.
+  Bucket counters are 16 bits: when one saturates, all are halved, so old samples decay.
+*/
+struct LatencyHistogram
+{
+    static const uint8_t bucketCount = 64;
+
+    uint16_t buckets[bucketCount] = {0};
+    uint32_t count = 0;
+    uint32_t maxMicros = 0;
+    uint64_t sumMicros = 0;
+
+    void add(uint32_t micros);
+    uint32_t percentile(uint8_t percent) const;
+
+    static uint8_t bucketOf(uint32_t micros);
+    static uint32_t bucketUpperBound(uint8_t bucket);
+};
+
+/**
+ * Times the enclosing scope and records it under the given stage.
+ */
+class LoopStageTimer
+{
+private:
+    LoopStage stage;
+    uint64_t startMicros;
+
+public:
+    LoopStageTimer(LoopStage stage_);
+    ~LoopStageTimer();
+};
+
+void profileLoopStart();
+String loopStatsToJson();
+
+// Stages are always recorded as reset breadcrumbs, and timed when profiling
+#define PROFILE_STAGE(stage)                    \
+    LoopStageBreadcrumb loopStageBreadcrumb(stage); \
+    LoopStageTimer loopStageTimer(stage)
+#define PROFILE_LOOP_START() profileLoopStart()
+
+#else
+
+#define PROFILE_STAGE(stage) LoopStageBreadcrumb loopStageBreadcrumb(stage)
+#define PROFILE_LOOP_START()
+
+#endif // LOOP_PROFILING
+
+#endif // LOOP_PROFILER_H
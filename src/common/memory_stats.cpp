@@ -2,12 +2,12 @@
 #include "common/globals.h"
 
 MemoryStats ramStats;
-uint64_t memStatsLastUpdatedMillis = 0;
 
+/**
+ * Samples heap usage. Run every ramStatsUpdateIntervalMillis by the scheduler.
+ */
 void updateMemoryStats()
 {
-    if (millis() - memStatsLastUpdatedMillis < ramStatsUpdateIntervalMillis)
-        return;
 #ifdef ESP32
     uint32_t freeHeap = esp_get_free_heap_size();
     ramStats.addSample(freeHeap);
@@ -1,4 +1,8 @@
+#define LOG_MODULE LOG_MODULE_OTA
+
 #include "ota_handler.h"
+#include "common_main.h"
+#include "counter_store.h"
 #include "globals.h"
 
 #include <ArduinoJson.h>
@@ -16,9 +20,6 @@
 #include <ESP8266WiFi.h>
 #endif
 
-uint32_t checkForSoftwareUpdateMillis = 60 * 60 * 1000; // check for software update every 1 hour
-uint64_t lastCheckForUpdateMillis = 0;
-
 WiFiClientSecure getSecureClient()
 {
     WiFiClientSecure secureClient;
@@ -51,7 +52,7 @@ void ESPGithubOtaUpdate::getLatestReleaseInfo(String &version, String &updateURL
     String url = String(apiEndpoint) + "/repos/" + releaseRepo + "/releases/latest";
     String payload;
 
-    DEBUG_PRINTLN(String("Requesting ") + url);
+    LOGF_DEBUG("Requesting %s", url);
 
     if (!httpClient.begin(secureClient, url))
     {
@@ -83,7 +84,7 @@ void ESPGithubOtaUpdate::getLatestReleaseInfo(String &version, String &updateURL
         return; // Guard will cleanup
     }
 
-    DEBUG_PRINTLN(String("Got response from ") + url);
+    LOGF_DEBUG("Got response from %s", url);
     payload = httpClient.getString();
 
     JsonDocument doc;
@@ -183,6 +184,9 @@ void ESPGithubOtaUpdate::upgradeSoftware(const char *updateURL)
         return;
     }
 
+    // Committed right away, a successful update reboots before a deferred commit
+    persistentCounters.add(COUNTER_OTA_ATTEMPTS, 1, EEPROM_COMMIT_NOW);
+
     WiFiClientSecure secureClient = getSecureClient();
 
 #ifdef ESP32
@@ -191,7 +195,7 @@ void ESPGithubOtaUpdate::upgradeSoftware(const char *updateURL)
     httpUpdate.onProgress([](int current, int total) {
         esp_task_wdt_reset();  // Feed watchdog during update
         if (current % (total / 10) == 0) {  // Print every 10%
-            Serial.printf("OTA Progress: %d%%\n", (current * 100) / total);
+            LOGF_INFO("OTA Progress: %d%%", (current * 100) / total);
         }
     });
     t_httpUpdate_return ret = httpUpdate.update(secureClient, updateURL, currentVersion);
@@ -201,7 +205,7 @@ void ESPGithubOtaUpdate::upgradeSoftware(const char *updateURL)
     ESPhttpUpdate.onProgress([](int current, int total) {
         ESP.wdtFeed();  // Feed watchdog during update
         if (current % (total / 10) == 0) {  // Print every 10%
-            Serial.printf("OTA Progress: %d%%\n", (current * 100) / total);
+            LOGF_INFO("OTA Progress: %d%%", (current * 100) / total);
         }
     });
     t_httpUpdate_return ret = ESPhttpUpdate.update(secureClient, updateURL, currentVersion);
@@ -210,30 +214,36 @@ void ESPGithubOtaUpdate::upgradeSoftware(const char *updateURL)
     if (ret == HTTP_UPDATE_OK)
     {
         LOG_PRINTLN("OTA: Update successful, rebooting...");
-        ESP.restart();
+        requestRestart(0);
     }
     else
     {
         // If the update fails, print the error code and message
 #ifdef ESP32
-        LOG_PRINTLN("OTA: Update failed error (" + String(httpUpdate.getLastError()) + "): " + httpUpdate.getLastErrorString());
+        LOGF_ERROR("OTA: Update failed error (%d): %s", httpUpdate.getLastError(), httpUpdate.getLastErrorString());
 #elif defined(ESP8266)
-        LOG_PRINTLN("OTA: Update failed error (" + String(ESPhttpUpdate.getLastError()) + "): " + ESPhttpUpdate.getLastErrorString());
+        LOGF_ERROR("OTA: Update failed error (%d): %s", ESPhttpUpdate.getLastError(), ESPhttpUpdate.getLastErrorString());
 #endif
     }
 }
 
-void ESPGithubOtaUpdate::checkForSoftwareUpdate()
+/**
+ * Services the firmware upload server. Must be called on every loop pass.
+ */
+void ESPGithubOtaUpdate::loop()
 {
 #ifdef ESP8266
     handleEsp8266OtaUpdate();
 #endif
-    if (millis() - lastCheckForUpdateMillis > checkForSoftwareUpdateMillis)
-    {
-        lastCheckForUpdateMillis = millis();
+}
 
-        upgradeSoftware();
-    }
+/**
+ * Checks github for a newer release and installs it.
+ * Meant to be run every checkForSoftwareUpdateMillis.
+ */
+void ESPGithubOtaUpdate::checkForSoftwareUpdate()
+{
+    upgradeSoftware();
 }
 
 void ESPGithubOtaUpdate::registerFirmwareUploadRoutes(AsyncWebServer *webServer, std::map<String, String> *routeDescriptions)
@@ -266,7 +276,7 @@ void ESPGithubOtaUpdate::registerFirmwareUploadRoutes(AsyncWebServer *webServer,
         if (!index)
         {
             uploadError = false;
-            LOG_PRINTLN("Firmware upload started: " + filename);
+            LOGF_INFO("Firmware upload started: %s", filename);
 
             // Validate filename
             if (!filename.endsWith(".bin"))
@@ -312,10 +322,9 @@ void ESPGithubOtaUpdate::registerFirmwareUploadRoutes(AsyncWebServer *webServer,
         {
             if (Update.end(true))
             {
-                LOG_PRINTLN("Firmware upload complete: " + String(index + len) + " bytes");
+                LOGF_INFO("Firmware upload complete: %u bytes", index + len);
                 request->send(200, "text/plain", "Upload complete, device will restart.");
-                delay(3000); // Short delay to ensure the response is sent before reboot
-                ESP.restart();
+                requestRestart(restartReplyDelayMillis);
             }
             else
             {
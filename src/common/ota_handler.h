@@ -20,6 +20,7 @@ private:
 
 public:
     ESPGithubOtaUpdate(const char *, const char *, const char *, const char *, const char * = "https://api.github.com");
+    void loop();
     void checkForSoftwareUpdate();
     void upgradeSoftware();
     void upgradeSoftware(const char *);
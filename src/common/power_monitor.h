@@ -9,8 +9,7 @@ ADC_MODE(ADC_VCC); // Required for ESP8266, must be before setup()
 #endif
 
 // Store last voltage to detect sudden drops
-static float lastVoltage = 3.3;       // Initialize to a safe value
-static unsigned long lastLogTime = 0; // Last time a warning was logged
+static float lastVoltage = 3.3; // Initialize to a safe value
 
 /**
  * Reads VCC voltage.
@@ -30,34 +29,20 @@ inline float readVCC()
 
 /**
  * Logs the VCC voltage, warns if it's too low, and detects sudden power drops.
+ * Each warning is logged at most once every vccLogIntervalMillis.
  */
 inline void logVCC()
 {
     float voltage = readVCC();
-    unsigned long currentTime = millis();
 
-    // Only print warnings at most once every 5 seconds (5000 ms)
-    if (currentTime - lastLogTime >= 5000)
-    {
-        if (voltage > 0 && voltage < 3.2)
-        {
-            LOG_PRINT(F("VCC Voltage: "));
-            LOG_PRINTLN(String(voltage) + "V");
-
-            LOG_PRINTLN(F("⚠️ WARNING: Low voltage detected! Potential power issue."));
-        }
-
-        // Detect sudden drops (e.g., 0.2V drop in 1 cycle)
-        if (lastVoltage - voltage > 0.2)
-        {
-            LOG_PRINT(F("VCC Voltage: "));
-            LOG_PRINTLN(String(voltage) + "V");
+    if (voltage > 0 && voltage < 3.2)
+        LOG_EVERY_MILLIS(LOG_LEVEL_WARN, vccLogIntervalMillis,
+                         "VCC Voltage: " + String(voltage) + F("V. Low voltage detected! Potential power issue."));
 
-            LOG_PRINTLN(F("🚨 CRITICAL POWER DROP DETECTED! Check power supply."));
-        }
-
-        lastLogTime = currentTime;
-    }
+    // Detect sudden drops (e.g., 0.2V drop in 1 cycle)
+    if (lastVoltage - voltage > 0.2)
+        LOG_EVERY_MILLIS(LOG_LEVEL_ERROR, vccLogIntervalMillis,
+                         "VCC Voltage: " + String(voltage) + F("V. Critical power drop detected! Check power supply."));
 
     lastVoltage = voltage; // Update last voltage for next check
 }
@@ -81,10 +66,10 @@ inline void checkResetCause()
         LOG_PRINTLN(F("Power-on Reset"));
         break;
     case ESP_RST_BROWNOUT:
-        LOG_PRINTLN(F("⚠️ Brownout Reset: Possible power issue!"));
+        LOG_WARN(F("Brownout Reset: Possible power issue!"));
         break;
     case ESP_RST_PANIC:
-        LOG_PRINTLN(F("⚠️ Crash/Panic Reset"));
+        LOG_WARN(F("Crash/Panic Reset"));
         break;
     case ESP_RST_SW:
         LOG_PRINTLN(F("Software Reset"));
@@ -0,0 +1,33 @@
+#include "common/record_store.h"
+
+#include <stddef.h>
+#ifdef ESP32
+#include <esp32/rom/crc.h>
+#elif defined(ESP8266)
+#include <coredecls.h>
+#endif
+
+/**
+ * CRC32 computed by the ROM routine on ESP32, and by the core's table-less routine on ESP8266.
+ * Both can be chained over several buffers.
+ */
+uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t length)
+{
+#ifdef ESP32
+    return crc32_le(crc, data, length);
+#elif defined(ESP8266)
+    return crc32(data, length, crc);
+#endif
+}
+
+uint32_t recordCrc(const RecordHeader &header, const uint8_t *payload)
+{
+#ifdef ESP32
+    uint32_t crc = 0;
+#elif defined(ESP8266)
+    uint32_t crc = 0xFFFFFFFF;
+#endif
+    // typeId, schemaVersion and length are contiguous
+    crc = crc32Update(crc, &header.typeId, offsetof(RecordHeader, crc) - offsetof(RecordHeader, typeId));
+    return crc32Update(crc, payload, header.length);
+}
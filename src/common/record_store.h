@@ -0,0 +1,62 @@
+#ifndef RECORD_STORE_H
+#define RECORD_STORE_H
+
+#include <Arduino.h>
+
+#pragma pack(push, 1)
+
+/**
+ * Stored in front of every EEPROM record.
+ * The CRC covers typeId, schemaVersion, length and the payload.
+ */
+struct RecordHeader
+{
+    uint16_t magic;
+    uint8_t typeId;
+    uint8_t schemaVersion;
+    uint16_t length; // payload bytes, 0 for an invalidated record
+    uint32_t crc;
+};
+
+#pragma pack(pop)
+
+const uint16_t RECORD_MAGIC = 0x5245;
+
+/*
+  Every type stored in EEPROM registers its record traits, by specializing RecordTraits:
+  - typeId: unique id of the type (1-15 common, 16+ project)
+  - schemaVersion: bumped whenever the layout of the struct changes
+  - capacity: bytes reserved for the payload, so that the struct can grow without moving the next slots
+  - migrate(fromVersion, stored, storedLength, data): fills data from a payload stored with an older
+    schema version (0 for the legacy, headerless layout). Returns false if it cannot be migrated.
+
+  template <>
+  struct RecordTraits<MyStruct> : AppendOnlyMigration<MyStruct>
+  {
+      static const uint8_t typeId = 16;
+      static const uint8_t schemaVersion = 1;
+      static const uint16_t capacity = 32;
+  };
+*/
+template <typename T>
+struct RecordTraits;
+
+/**
+ * Default migration, for structs whose fields are only ever appended:
+ * the stored prefix is kept, and new fields keep the values set by the default constructor.
+ */
+template <typename T>
+struct AppendOnlyMigration
+{
+    static bool migrate(uint8_t fromVersion, const uint8_t *stored, uint16_t storedLength, T &data)
+    {
+        (void)fromVersion;
+        memcpy(reinterpret_cast<uint8_t *>(&data), stored, storedLength < sizeof(T) ? storedLength : sizeof(T));
+        return true;
+    }
+};
+
+uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t length);
+uint32_t recordCrc(const RecordHeader &header, const uint8_t *payload);
+
+#endif // RECORD_STORE_H
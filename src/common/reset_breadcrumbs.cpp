@@ -0,0 +1,178 @@
+#define LOG_MODULE LOG_MODULE_MAIN
+
+#include "common/reset_breadcrumbs.h"
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#ifdef ESP32
+#include <esp_system.h>
+#endif
+
+#include "common/globals.h"
+#include "common/loop_profiler.h"
+#include "common/utils.h"
+
+const uint32_t resetBreadcrumbsMagic = 0xB5EADC70;
+
+static_assert(sizeof(ResetBreadcrumbs) % 4 == 0, "RTC memory is written in 4 bytes blocks");
+static_assert(offsetof(ResetBreadcrumbs, uptimeMillis) % 4 == 0, "RTC memory is written in 4 bytes blocks");
+
+#ifdef ESP32
+// Not initialized at boot, so it keeps the previous boot's content across warm resets
+RTC_NOINIT_ATTR ResetBreadcrumbs breadcrumbs;
+#elif defined(ESP8266)
+// RAM copy, written through to RTC user memory
+static_assert(rtcBreadcrumbsBlock * 4 + sizeof(ResetBreadcrumbs) <= rtcQuickRestartsBlock * 4, "breadcrumbs overlap the quick restarts");
+ResetBreadcrumbs breadcrumbs;
+#endif
+
+ResetBreadcrumbs previousBoot;
+bool previousBootValid = false;
+
+/**
+ * Makes the given part of breadcrumbs persistent. Offset and size must be multiples of 4.
+ */
+void persistBreadcrumbs(size_t offset, size_t size)
+{
+#ifdef ESP8266
+    ESP.rtcUserMemoryWrite(rtcBreadcrumbsBlock + offset / 4, (uint32_t *)((uint8_t *)&breadcrumbs + offset), size);
+#else
+    // Written in place on ESP32
+    (void)offset;
+    (void)size;
+#endif
+}
+
+/**
+ * Whether the supply was lost (power-on or brownout): RTC memory content cannot be trusted then.
+ */
+bool isPowerOnReset()
+{
+#ifdef ESP32
+    esp_reset_reason_t reason = esp_reset_reason();
+    return reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT;
+#elif defined(ESP8266)
+    return ESP.getResetInfoPtr()->reason == REASON_DEFAULT_RST;
+#endif
+}
+
+/**
+ * Keeps the previous boot's breadcrumbs, then starts recording this boot's.
+ * Must be called first thing in commonSetup().
+ */
+void loadResetBreadcrumbs()
+{
+#ifdef ESP32
+    previousBoot = breadcrumbs;
+#elif defined(ESP8266)
+    ESP.rtcUserMemoryRead(rtcBreadcrumbsBlock, (uint32_t *)&previousBoot, sizeof(previousBoot));
+#endif
+    // RTC memory holds garbage after a power-on
+    previousBootValid = !isPowerOnReset() && previousBoot.magic == resetBreadcrumbsMagic;
+
+    memset(&breadcrumbs, 0, sizeof(breadcrumbs));
+    breadcrumbs.magic = resetBreadcrumbsMagic;
+    breadcrumbs.lastStage = NO_LOOP_STAGE;
+    breadcrumbs.activeStage = NO_LOOP_STAGE;
+    persistBreadcrumbs(0, sizeof(breadcrumbs));
+}
+
+void recordBootPhaseBreadcrumb(BootPhase phase, uint32_t atMillis)
+{
+    if (phase >= BOOT_PHASE_COUNT)
+        return;
+    breadcrumbs.bootPhaseMillis[phase] = atMillis;
+    persistBreadcrumbs(offsetof(ResetBreadcrumbs, bootPhaseMillis) + phase * sizeof(uint32_t), sizeof(uint32_t));
+}
+
+LoopStageBreadcrumb::LoopStageBreadcrumb(uint8_t stage) : previousStage(breadcrumbs.activeStage)
+{
+    breadcrumbs.uptimeMillis = monotonicMillis();
+    breadcrumbs.lastStage = stage;
+    breadcrumbs.activeStage = stage;
+    persistBreadcrumbs(offsetof(ResetBreadcrumbs, uptimeMillis), 2 * sizeof(uint32_t));
+}
+
+LoopStageBreadcrumb::~LoopStageBreadcrumb()
+{
+    breadcrumbs.uptimeMillis = monotonicMillis();
+    breadcrumbs.activeStage = previousStage;
+    persistBreadcrumbs(offsetof(ResetBreadcrumbs, uptimeMillis), 2 * sizeof(uint32_t));
+}
+
+const char *breadcrumbStageName(uint8_t stage)
+{
+    return stage == NO_LOOP_STAGE ? "none" : loopStageName((LoopStage)stage);
+}
+
+/**
+ * Logs where the previous boot stopped. Meant to be called once Serial is up.
+ */
+void logResetBreadcrumbs()
+{
+    if (!previousBootValid)
+        return;
+
+    LOGF_INFO("Previous boot was up %s, last stage: %s, active stage: %s", millisToTimeStr(previousBoot.uptimeMillis),
+              breadcrumbStageName(previousBoot.lastStage), breadcrumbStageName(previousBoot.activeStage));
+}
+
+String resetReasonString()
+{
+#ifdef ESP8266
+    return ESP.getResetReason();
+#elif defined(ESP32)
+    switch (esp_reset_reason())
+    {
+    case ESP_RST_POWERON:
+        return F("Power-on");
+    case ESP_RST_EXT:
+        return F("External pin");
+    case ESP_RST_SW:
+        return F("Software");
+    case ESP_RST_PANIC:
+        return F("Panic");
+    case ESP_RST_INT_WDT:
+        return F("Interrupt watchdog");
+    case ESP_RST_TASK_WDT:
+        return F("Task watchdog");
+    case ESP_RST_WDT:
+        return F("Other watchdog");
+    case ESP_RST_DEEPSLEEP:
+        return F("Deep sleep wake-up");
+    case ESP_RST_BROWNOUT:
+        return F("Brownout");
+    case ESP_RST_SDIO:
+        return F("SDIO");
+    default:
+        return F("Unknown");
+    }
+#endif
+}
+
+/**
+ * Reset reason, and the previous boot's breadcrumbs when they survived the reset.
+ */
+String lastResetToJson()
+{
+    JsonDocument doc;
+    doc["resetReason"] = resetReasonString();
+    doc["breadcrumbsValid"] = previousBootValid;
+    if (previousBootValid)
+    {
+        doc["uptimeMillis"] = previousBoot.uptimeMillis;
+        doc["lastStage"] = breadcrumbStageName(previousBoot.lastStage);
+        doc["activeStage"] = breadcrumbStageName(previousBoot.activeStage);
+
+        JsonObject phases = doc["bootPhases"].to<JsonObject>();
+        for (uint8_t phase = 0; phase < BOOT_PHASE_COUNT; phase++)
+        {
+            if (previousBoot.bootPhaseMillis[phase] != 0)
+                phases[bootPhaseName((BootPhase)phase)] = previousBoot.bootPhaseMillis[phase];
+        }
+    }
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
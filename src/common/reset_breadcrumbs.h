@@ -0,0 +1,51 @@
+#ifndef RESET_BREADCRUMBS_H
+#define RESET_BREADCRUMBS_H
+
+#include <Arduino.h>
+
+#include "common/boot_timeline.h"
+
+// ESP8266 RTC user memory layout, in 4 bytes blocks. Blocks 0-31 are used by eboot during OTA updates.
+const uint8_t rtcBreadcrumbsBlock = 32;
+const uint8_t rtcQuickRestartsBlock = 48;
+
+// Value of a stage field when no housekeeping stage was entered (LoopStage values otherwise)
+const uint8_t NO_LOOP_STAGE = 0xFF;
+
+/*
+  Breadcrumbs of the current boot, kept in RTC memory that is not cleared on warm resets
+  (software, panic, watchdog), so the next boot can tell where the previous one stopped.
+  RTC memory is RAM: updating it causes no flash wear.
+*/
+struct ResetBreadcrumbs
+{
+    uint32_t magic;
+    uint32_t bootPhaseMillis[BOOT_PHASE_COUNT]; // see boot_timeline.h, 0 if not reached
+    // Updated on every housekeeping stage entry/exit, written together
+    uint32_t uptimeMillis; // at the last stage entry/exit
+    uint8_t lastStage;     // last stage entered
+    uint8_t activeStage;   // stage being run, NO_LOOP_STAGE if outside of housekeeping
+    uint16_t reserved;
+};
+
+bool isPowerOnReset();
+void loadResetBreadcrumbs();
+void logResetBreadcrumbs();
+void recordBootPhaseBreadcrumb(BootPhase phase, uint32_t atMillis);
+String resetReasonString();
+String lastResetToJson();
+
+/**
+ * Records a housekeeping stage as active for the enclosing scope, see PROFILE_STAGE().
+ */
+class LoopStageBreadcrumb
+{
+private:
+    uint8_t previousStage;
+
+public:
+    LoopStageBreadcrumb(uint8_t stage);
+    ~LoopStageBreadcrumb();
+};
+
+#endif // RESET_BREADCRUMBS_H
@@ -0,0 +1,238 @@
+#include "common/scheduler.h"
+
+#include <ArduinoJson.h>
+
+#include "common/shared_state.h"
+#include "common/utils.h"
+
+TaskScheduler scheduler;
+
+// Task currently executing its callback; its slot must not be reused until the callback returns
+static TaskId runningTask = INVALID_TASK_ID;
+
+TaskId TaskScheduler::addTask(const char *name, uint32_t delayMillis, uint32_t intervalMillis, std::function<void()> callback)
+{
+    SharedStateLock lock;
+    for (TaskId id = 0; id < SCHEDULER_MAX_TASKS; id++)
+    {
+        ScheduledTask &task = tasks[id];
+        if (task.active || id == runningTask)
+            continue;
+
+        task = ScheduledTask();
+        task.name = name;
+        task.callback = callback;
+        task.intervalMillis = intervalMillis;
+        task.nextRunMillis = monotonicMillis() + delayMillis;
+        task.active = true;
+        push(id);
+        return id;
+    }
+    return INVALID_TASK_ID;
+}
+
+TaskId TaskScheduler::scheduleEvery(const char *name, uint32_t intervalMillis, std::function<void()> callback, uint32_t initialDelayMillis)
+{
+    // An interval of 0 would make the task one-shot
+    return addTask(name, initialDelayMillis, intervalMillis > 0 ? intervalMillis : 1, callback);
+}
+
+TaskId TaskScheduler::scheduleOnce(const char *name, uint32_t delayMillis, std::function<void()> callback)
+{
+    return addTask(name, delayMillis, 0, callback);
+}
+
+/**
+ * Moves the next deadline of a task. Can be called from within the task's own callback.
+ */
+void TaskScheduler::reschedule(TaskId id, uint32_t delayMillis)
+{
+    SharedStateLock lock;
+    if (id < 0 || id >= SCHEDULER_MAX_TASKS || !tasks[id].active)
+        return;
+
+    if (tasks[id].queued)
+        remove(id);
+    tasks[id].nextRunMillis = monotonicMillis() + delayMillis;
+    push(id);
+}
+
+void TaskScheduler::cancel(TaskId id)
+{
+    SharedStateLock lock;
+    if (id < 0 || id >= SCHEDULER_MAX_TASKS || !tasks[id].active)
+        return;
+
+    if (tasks[id].queued)
+        remove(id);
+    tasks[id].active = false;
+}
+
+bool TaskScheduler::isScheduled(TaskId id) const
+{
+    SharedStateLock lock;
+    return id >= 0 && id < SCHEDULER_MAX_TASKS && tasks[id].active;
+}
+
+/**
+ * Runs every task whose deadline has passed.
+ * Callbacks run without holding the shared state lock, so they may (re)schedule tasks.
+ * Returns the number of milliseconds the caller may idle before the next deadline.
+ */
+uint32_t TaskScheduler::runDueTasks()
+{
+    uint64_t now = monotonicMillis();
+
+    // Bounded, so a task that keeps rescheduling itself immediately cannot starve the caller
+    for (uint8_t runs = 0; runs < SCHEDULER_MAX_TASKS; runs++)
+    {
+        TaskId id;
+        {
+            SharedStateLock lock;
+            if (heapSize == 0 || tasks[heap[0]].nextRunMillis > now)
+                break;
+            id = heap[0];
+            remove(id);
+            runningTask = id;
+        }
+
+        ScheduledTask &task = tasks[id];
+        uint64_t startMicros = monotonicMicros();
+        task.callback();
+        uint32_t runtimeMicros = monotonicMicros() - startMicros;
+
+        SharedStateLock lock;
+        runningTask = INVALID_TASK_ID;
+        task.runCount++;
+        task.lastRuntimeMicros = runtimeMicros;
+        if (runtimeMicros > task.maxRuntimeMicros)
+            task.maxRuntimeMicros = runtimeMicros;
+
+        // Cancelled or rescheduled from within the callback
+        if (!task.active || task.queued)
+            continue;
+
+        if (task.intervalMillis == 0)
+        {
+            task.active = false;
+            continue;
+        }
+
+        // Keep the period stable, but don't try to catch up on missed runs
+        task.nextRunMillis += task.intervalMillis;
+        if (task.nextRunMillis <= now)
+            task.nextRunMillis = now + task.intervalMillis;
+        push(id);
+    }
+
+    return millisUntilNextDeadline();
+}
+
+uint32_t TaskScheduler::millisUntilNextDeadline() const
+{
+    SharedStateLock lock;
+    if (heapSize == 0)
+        return UINT32_MAX;
+
+    uint64_t now = monotonicMillis();
+    uint64_t deadline = tasks[heap[0]].nextRunMillis;
+    if (deadline <= now)
+        return 0;
+    uint64_t remaining = deadline - now;
+    return remaining > UINT32_MAX ? UINT32_MAX : (uint32_t)remaining;
+}
+
+const ScheduledTask *TaskScheduler::getTask(TaskId id) const
+{
+    SharedStateLock lock;
+    if (id < 0 || id >= SCHEDULER_MAX_TASKS || !tasks[id].active)
+        return nullptr;
+    return &tasks[id];
+}
+
+String TaskScheduler::statsToJson() const
+{
+    SharedStateLock lock;
+    JsonDocument doc;
+    JsonArray jsonTasks = doc["tasks"].to<JsonArray>();
+    for (TaskId id = 0; id < SCHEDULER_MAX_TASKS; id++)
+    {
+        const ScheduledTask &task = tasks[id];
+        if (!task.active)
+            continue;
+
+        JsonObject jsonTask = jsonTasks.add<JsonObject>();
+        jsonTask["name"] = task.name;
+        jsonTask["intervalMillis"] = task.intervalMillis;
+        jsonTask["runCount"] = task.runCount;
+        jsonTask["lastRuntimeMicros"] = task.lastRuntimeMicros;
+        jsonTask["maxRuntimeMicros"] = task.maxRuntimeMicros;
+    }
+    doc["millisUntilNextDeadline"] = millisUntilNextDeadline();
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
+
+// Min-heap of task ids, ordered by deadline //
+
+bool TaskScheduler::isEarlier(TaskId a, TaskId b) const
+{
+    return tasks[a].nextRunMillis < tasks[b].nextRunMillis;
+}
+
+void TaskScheduler::push(TaskId id)
+{
+    heap[heapSize] = id;
+    tasks[id].queued = true;
+    siftUp(heapSize++);
+}
+
+void TaskScheduler::remove(TaskId id)
+{
+    for (uint8_t position = 0; position < heapSize; position++)
+    {
+        if (heap[position] != id)
+            continue;
+
+        tasks[id].queued = false;
+        heap[position] = heap[--heapSize];
+        if (position < heapSize)
+        {
+            siftUp(position);
+            siftDown(position);
+        }
+        return;
+    }
+}
+
+void TaskScheduler::siftUp(uint8_t position)
+{
+    while (position > 0)
+    {
+        uint8_t parent = (position - 1) / 2;
+        if (!isEarlier(heap[position], heap[parent]))
+            break;
+        std::swap(heap[position], heap[parent]);
+        position = parent;
+    }
+}
+
+void TaskScheduler::siftDown(uint8_t position)
+{
+    while (true)
+    {
+        uint8_t earliest = position;
+        uint8_t left = 2 * position + 1;
+        uint8_t right = left + 1;
+        if (left < heapSize && isEarlier(heap[left], heap[earliest]))
+            earliest = left;
+        if (right < heapSize && isEarlier(heap[right], heap[earliest]))
+            earliest = right;
+        if (earliest == position)
+            break;
+        std::swap(heap[position], heap[earliest]);
+        position = earliest;
+    }
+}
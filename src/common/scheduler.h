@@ -0,0 +1,66 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <functional>
+
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 20 // 15 common tasks at most, the rest for the project
+#endif
+
+typedef int8_t TaskId;
+const TaskId INVALID_TASK_ID = -1;
+
+/**
+ * A periodic or one-shot task. Deadlines are kept on the 64-bit monotonic clock.
+ */
+struct ScheduledTask
+{
+    const char *name = nullptr;
+    std::function<void()> callback;
+    uint32_t intervalMillis = 0; // 0 for one-shot tasks
+    uint64_t nextRunMillis = 0;
+    bool active = false;
+    bool queued = false; // whether the task is currently in the deadline heap
+
+    // Stats
+    uint32_t runCount = 0;
+    uint32_t lastRuntimeMicros = 0;
+    uint32_t maxRuntimeMicros = 0;
+};
+
+/**
+ * Cooperative scheduler: keeps a min-heap of deadlines and runs only the tasks that are due.
+ * Tasks are stored in a fixed-size table, so (re)scheduling never allocates.
+ */
+class TaskScheduler
+{
+private:
+    ScheduledTask tasks[SCHEDULER_MAX_TASKS];
+    TaskId heap[SCHEDULER_MAX_TASKS];
+    uint8_t heapSize = 0;
+
+    TaskId addTask(const char *name, uint32_t delayMillis, uint32_t intervalMillis, std::function<void()> callback);
+    void push(TaskId id);
+    void remove(TaskId id);
+    bool isEarlier(TaskId a, TaskId b) const;
+    void siftUp(uint8_t position);
+    void siftDown(uint8_t position);
+
+public:
+    TaskId scheduleEvery(const char *name, uint32_t intervalMillis, std::function<void()> callback, uint32_t initialDelayMillis = 0);
+    TaskId scheduleOnce(const char *name, uint32_t delayMillis, std::function<void()> callback);
+    void reschedule(TaskId id, uint32_t delayMillis);
+    void cancel(TaskId id);
+    bool isScheduled(TaskId id) const;
+
+    uint32_t runDueTasks();
+    uint32_t millisUntilNextDeadline() const;
+
+    const ScheduledTask *getTask(TaskId id) const;
+    String statsToJson() const;
+};
+
+extern TaskScheduler scheduler;
+
+#endif // SCHEDULER_H
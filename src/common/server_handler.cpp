@@ -7,7 +7,10 @@
 #include <ESP8266WiFi.h>
 #endif
 
+#include "common/boot_timeline.h"
 #include "common/globals.h"
+#include "common/log_file.h"
+#include "common/scheduler.h"
 
 AsyncWebServer *webServer;
 std::map<String, String> routeDescriptions;
@@ -16,6 +19,12 @@ void setupServer()
 {
     webServer = new AsyncWebServer(80);
 
+    // Time to first response, see /bootStats
+    webServer->addMiddleware([](AsyncWebServerRequest *request, ArMiddlewareNext next)
+                             {
+        markBootPhase(BOOT_PHASE_FIRST_REQUEST);
+        next(); });
+
     // Default routes
     webServer->on("/reboot", HTTP_GET, [](AsyncWebServerRequest *request)
                   { rootReboot(request); });
@@ -41,6 +50,57 @@ void setupServer()
                   { routeLogsStream(request); });
     routeDescriptions["/logsStream"] = "Get a logs streaming for remote debugging";
 
+    webServer->on("/logStats", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeLogStats(request); });
+    routeDescriptions["/logStats"] = "Log ring usage and dropped lines (json)";
+    webServer->on("/logs", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeLogs(request); });
+    routeDescriptions["/logs"] = "Last log lines, ?binary for tools/decode_logs.py";
+    webServer->on("/logWebsocketStats", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeLogWebsocketStats(request); });
+    routeDescriptions["/logWebsocketStats"] = "Logs WebSocket clients: queued, dropped and sent lines (json)";
+    webServer->on("/logSyslogStats", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeLogSyslogStats(request); });
+    routeDescriptions["/logSyslogStats"] = "Log collector: address, queued, dropped and sent lines (json)";
+#if LOG_FILE
+    webServer->on("/logFiles", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeLogFiles(request); });
+    routeDescriptions["/logFiles"] = "Log segments kept on flash (json), ?segment=N for one, as text";
+#endif
+    webServer->on("/logLevels", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeLogLevels(request); });
+    routeDescriptions["/logLevels"] = "Runtime log level per module, ?module=wifi&level=debug to set (json)";
+
+    webServer->on("/scheduler", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeSchedulerStats(request); });
+    routeDescriptions["/scheduler"] = "Housekeeping tasks run counts and runtimes (json)";
+
+    webServer->on("/eepromStats", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeEepromStats(request); });
+    routeDescriptions["/eepromStats"] = "EEPROM flash commits and bytes written (json)";
+
+    webServer->on("/storageBenchmark", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeStorageBenchmark(request); });
+    routeDescriptions["/storageBenchmark"] = "Commit and read latency of each storage backend, ?run to start (json)";
+
+    webServer->on("/counters", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeCounters(request); });
+    routeDescriptions["/counters"] = "Persistent counters: uptime hours, WiFi reconnects, OTA attempts (json)";
+
+    webServer->on("/bootStats", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeBootStats(request); });
+    routeDescriptions["/bootStats"] = "Time at which each boot phase was reached (json)";
+
+    webServer->on("/lastReset", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeLastReset(request); });
+    routeDescriptions["/lastReset"] = "Reset reason, and the stage the previous boot was running when it reset (json)";
+
+#ifdef LOOP_PROFILING
+    webServer->on("/loopStats", HTTP_GET, [](AsyncWebServerRequest *request)
+                  { routeLoopStats(request); });
+    routeDescriptions["/loopStats"] = "Loop period, jitter and per-stage latency percentiles (json)";
+#endif
+
     // Add more routes here
     // if (!configMode)
     // {
@@ -13,6 +13,19 @@ void routeSaveConfiguration(AsyncWebServerRequest *request);
 void routeInvaldateConfig(AsyncWebServerRequest *request);
 void routeCheckUpdate(AsyncWebServerRequest *request);
 void routeLogsStream(AsyncWebServerRequest *request);
+void routeLogStats(AsyncWebServerRequest *request);
+void routeLogLevels(AsyncWebServerRequest *request);
+void routeLogs(AsyncWebServerRequest *request);
+void routeLogWebsocketStats(AsyncWebServerRequest *request);
+void routeLogSyslogStats(AsyncWebServerRequest *request);
+void routeLogFiles(AsyncWebServerRequest *request);
+void routeSchedulerStats(AsyncWebServerRequest *request);
+void routeEepromStats(AsyncWebServerRequest *request);
+void routeStorageBenchmark(AsyncWebServerRequest *request);
+void routeCounters(AsyncWebServerRequest *request);
+void routeBootStats(AsyncWebServerRequest *request);
+void routeLastReset(AsyncWebServerRequest *request);
+void routeLoopStats(AsyncWebServerRequest *request);
 
 void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type,
              void *arg, uint8_t *data, size_t len);
@@ -1,9 +1,25 @@
+#define LOG_MODULE LOG_MODULE_SERVER
+
 #include "Arduino.h"
+#include <memory>
 
 #include "server_handler.h"
 #include "common/globals.h"
+#include "common/shared_state.h"
 
+#include "boot_timeline.h"
+#include "common_main.h"
+#include "counter_store.h"
 #include "device_configuration.h"
+#include "eeprom_session.h"
+#include "log_file.h"
+#include "log_history.h"
+#include "log_syslog.h"
+#include "log_websocket.h"
+#include "loop_profiler.h"
+#include "reset_breadcrumbs.h"
+#include "scheduler.h"
+#include "storage_benchmark.h"
 #include "wifi_handler.h"
 
 void rootReboot(AsyncWebServerRequest *request)
@@ -11,8 +27,7 @@ void rootReboot(AsyncWebServerRequest *request)
     DEBUG_PRINTLN("rootReboot");
 
     request->send(200, "text/plain", F("Rebooting now."));
-    delay(3000);
-    ESP.restart();
+    requestRestart(restartReplyDelayMillis);
 }
 
 void routeInvaldateConfig(AsyncWebServerRequest *request)
@@ -21,7 +36,7 @@ void routeInvaldateConfig(AsyncWebServerRequest *request)
 
     invalidateDeviceConfigurationOnEeprom();
     request->send(200, "text/plain", F("Device configuration voided. Configure at /configureDevice. Rebooting now."));
-    ESP.restart();
+    requestRestart(restartReplyDelayMillis);
 }
 
 void routeCheckUpdate(AsyncWebServerRequest *request)
@@ -29,53 +44,194 @@ void routeCheckUpdate(AsyncWebServerRequest *request)
     DEBUG_PRINTLN("routeCheckUpdate");
 
     request->send(200, "text/html", F("Checking for new firmware on github. This might take a few seconds..."));
-    updater->upgradeSoftware();
+    requestOtaCheck();
+}
+
+void routeLogStats(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLogStats");
+    request->send(200, "application/json", logRing.statsToJson());
+}
+
+void routeLogs(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLogs");
+    if (request->hasParam("binary"))
+    {
+        // Unformatted, for tools/decode_logs.py
+        AsyncResponseStream *response = request->beginResponseStream("application/octet-stream");
+        logHistory.toBinary(*response);
+        request->send(response);
+        return;
+    }
+    request->send(200, "text/plain", logHistory.toText());
 }
 
-String formatDeviceConfigurationHtmlTemplate()
+void routeLogWebsocketStats(AsyncWebServerRequest *request)
 {
-    String ssid_str = currentDeviceConfiguration == nullptr ? "" : currentDeviceConfiguration->ssid;
-    String password_str = currentDeviceConfiguration == nullptr ? "" : currentDeviceConfiguration->password;
-    String hostname_str = currentDeviceConfiguration == nullptr ? "" : currentDeviceConfiguration->hostname;
-    String deviceName_str = currentDeviceConfiguration == nullptr ? "" : currentDeviceConfiguration->deviceName;
-    String githubAuthToken_str = currentDeviceConfiguration == nullptr ? "" : currentDeviceConfiguration->githubAuthToken;
-    bool aliveSignalEnabled = currentDeviceConfiguration == nullptr ? true : currentDeviceConfiguration->isAliveSignalEnabled;
-
-    return String("<!DOCTYPE html> \
-    <html><head><meta charset=\"utf-8\"><title>Configuration</title></head><body> \
-    <form method=\"post\" action=\"/saveConfiguration\"> \
-<label for=\"ssid\">WiFi SSID:</label>\
-                        <input type =\"text\" id=\"ssid\" name=\"ssid\" value=\"" +
-                  ssid_str + "\">\
-<br><br>\
-<label for=\"password\">WiFi Password:</label> \
-<input type=\"password\" id=\"password\" name=\"password\" value=\"" +
-                  password_str + "\">\
-<br><br>\
-<label for=\"hostname\">Hostname</label>\
-<input type=\"text\" id=\"hostname\" name=\"hostname\" value=\"" +
-                  hostname_str + "\">\
-<br><br>\
-<label for=\"device_name\">Device name</label>\
-<input type=\"text\" id=\"device_name\" name=\"device_name\" value=\"" +
-                  deviceName_str + "\"> \
-<br><br>\
-<label for=\"auth_token\">Github Auth Token</label>\
-<input type=\"text\" id=\"auth_token\" name=\"auth_token\" value=\"" +
-                  githubAuthToken_str + "\">\
-<br><br>\
-<label for=\"alive_signal\">LED Alive Signal (Heartbeat):</label>\
-<input type=\"checkbox\" id=\"alive_signal\" name=\"alive_signal\" value=\"1\"" +
-                  String(aliveSignalEnabled ? " checked" : "") + "> \
-<br><br>\
-\
-<input type=\"submit\" value=\"Save\"></form></body></html>");
+    DEBUG_PRINTLN("routeLogWebsocketStats");
+    request->send(200, "application/json", logWebsocketStatsToJson());
+}
+
+void routeLogSyslogStats(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLogSyslogStats");
+    request->send(200, "application/json", logSyslogStatsToJson());
+}
+
+#if LOG_FILE
+/**
+ * The list of log segments, or with ?segment=N that segment as text, uncompressed while
+ * it is sent: chunk by chunk, never whole in RAM.
+ */
+void routeLogFiles(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLogFiles");
+    if (!request->hasParam("segment"))
+    {
+        request->send(200, "application/json", logFilesToJson());
+        return;
+    }
+    std::shared_ptr<LogSegmentReader> reader = std::make_shared<LogSegmentReader>();
+    if (!reader->open(request->getParam("segment")->value().toInt()))
+    {
+        request->send(404, "text/plain", F("No such log segment"));
+        return;
+    }
+    request->send(request->beginChunkedResponse("text/plain", [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                {
+        (void)index;
+        return reader->read(buffer, maxLen); }));
+}
+#endif
+
+void routeLogLevels(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLogLevels");
+    if (request->hasParam("level"))
+    {
+        String module = request->hasParam("module") ? request->getParam("module")->value() : String("all");
+        if (!setLogLevel(module, request->getParam("level")->value()))
+        {
+            request->send(400, "text/plain", F("Unknown module or level"));
+            return;
+        }
+    }
+    request->send(200, "application/json", logLevelsToJson());
+}
+
+void routeSchedulerStats(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeSchedulerStats");
+    request->send(200, "application/json", scheduler.statsToJson());
+}
+
+void routeEepromStats(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeEepromStats");
+    request->send(200, "application/json", eepromSession.statsToJson());
+}
+
+void routeStorageBenchmark(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeStorageBenchmark");
+    // Commits take tens of milliseconds each: the benchmark runs from the loop
+    if (request->hasParam("run"))
+        scheduleStorageBenchmark();
+    request->send(200, "application/json", storageBenchmarkToJson());
+}
+
+void routeCounters(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeCounters");
+    request->send(200, "application/json", persistentCounters.toJson());
+}
+
+void routeBootStats(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeBootStats");
+    request->send(200, "application/json", bootTimelineToJson());
+}
+
+void routeLastReset(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLastReset");
+    request->send(200, "application/json", lastResetToJson());
+}
+
+#ifdef LOOP_PROFILING
+void routeLoopStats(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLoopStats");
+    request->send(200, "application/json", loopStatsToJson());
+}
+#endif
+
+// Sent straight from flash, see deviceConfigurationValue() for the %PLACEHOLDERS%
+static const char deviceConfigurationPage[] PROGMEM = R"(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>Configuration</title></head><body>
+<form method="post" action="/saveConfiguration">
+<label for="ssid">WiFi SSID:</label>
+<input type="text" id="ssid" name="ssid" value="%SSID%">
+<br><br>
+<label for="password">WiFi Password:</label>
+<input type="password" id="password" name="password" value="%PASSWORD%">
+<br><br>
+<label for="hostname">Hostname</label>
+<input type="text" id="hostname" name="hostname" value="%HOSTNAME%">
+<br><br>
+<label for="device_name">Device name</label>
+<input type="text" id="device_name" name="device_name" value="%DEVICE_NAME%">
+<br><br>
+<label for="auth_token">Github Auth Token</label>
+<input type="text" id="auth_token" name="auth_token" value="%AUTH_TOKEN%">
+<br><br>
+<label for="alive_signal">LED Alive Signal (Heartbeat):</label>
+<input type="checkbox" id="alive_signal" name="alive_signal" value="1"%ALIVE_SIGNAL%>
+<br><br>
+<label for="syslog_host">Log collector (host or IP, empty: off)</label>
+<input type="text" id="syslog_host" name="syslog_host" maxlength="39" value="%SYSLOG_HOST%">
+<input type="number" id="syslog_port" name="syslog_port" min="1" max="65535" value="%SYSLOG_PORT%">
+<select id="syslog_format" name="syslog_format">
+<option value="0">RFC 5424 syslog</option>
+<option value="1"%SYSLOG_FRAMED%>Framed (tools/log_listener.py)</option>
+</select>
+<br><br>
+<input type="submit" value="Save"></form></body></html>
+)";
+
+/**
+ * The value of one of deviceConfigurationPage's placeholders, called while the page is sent.
+ */
+String deviceConfigurationValue(const String &name)
+{
+    SharedStateLock lock;
+    const DeviceConfiguration *config = currentDeviceConfiguration;
+    if (name == "SSID")
+        return config == nullptr ? "" : config->ssid;
+    if (name == "PASSWORD")
+        return config == nullptr ? "" : config->password;
+    if (name == "HOSTNAME")
+        return config == nullptr ? "" : config->hostname;
+    if (name == "DEVICE_NAME")
+        return config == nullptr ? "" : config->deviceName;
+    if (name == "AUTH_TOKEN")
+        return config == nullptr ? "" : config->githubAuthToken;
+    if (name == "ALIVE_SIGNAL")
+        return config == nullptr || config->isAliveSignalEnabled ? " checked" : "";
+    if (name == "SYSLOG_HOST")
+        return config == nullptr ? "" : config->syslogHost;
+    if (name == "SYSLOG_PORT")
+        return String(config == nullptr ? 514 : config->syslogPort);
+    if (name == "SYSLOG_FRAMED")
+        return config != nullptr && config->syslogFormat == LOG_SYSLOG_FRAMED ? " selected" : "";
+    return String();
 }
 
 void routeConfigure(AsyncWebServerRequest *request)
 {
     DEBUG_PRINTLN("routeConfigure");
-    request->send(200, "text/html", formatDeviceConfigurationHtmlTemplate());
+    request->send_P(200, "text/html", deviceConfigurationPage, deviceConfigurationValue);
 }
 
 void routeSaveConfiguration(AsyncWebServerRequest *request)
@@ -88,45 +244,27 @@ void routeSaveConfiguration(AsyncWebServerRequest *request)
     String deviceName = request->arg("device_name");
     String authToken = request->arg("auth_token");
     bool aliveSignalEnabled = request->hasArg("alive_signal"); // Checkbox is only sent if checked
+    String syslogHost = request->arg("syslog_host");
+    long syslogPort = request->arg("syslog_port").toInt();
+    uint8_t syslogFormat = request->arg("syslog_format") == "1" ? LOG_SYSLOG_FRAMED : LOG_SYSLOG_RFC5424;
 
     if (hostName == "")
         hostName = configModeHostname;
+    if (syslogPort <= 0 || syslogPort > 65535)
+        syslogPort = 514;
+    syslogHost.trim();
+    syslogHost = syslogHost.substring(0, sizeof(DeviceConfiguration::syslogHost) - 1); // kept null-terminated
 
-    DeviceConfiguration *newConfig = new DeviceConfiguration(ssid.c_str(), password.c_str(), hostName.c_str(), deviceName.c_str(), authToken.c_str(), aliveSignalEnabled);
-
-    // Send a response to the client
-    request->send(200, "text/plain", F("Configuration received. Will attempt connection to WiFi with provided credentials. Will save configuration if successful."));
-    delay(250);
-
-    // Backup current config in case connection fails
-    DeviceConfiguration *previousConfig = currentDeviceConfiguration;
-    currentDeviceConfiguration = newConfig;
-    configMode = false;  // Force STA mode to test the new credentials
+    DeviceConfiguration newConfig(ssid.c_str(), password.c_str(), hostName.c_str(), deviceName.c_str(), authToken.c_str(), aliveSignalEnabled,
+                                  syslogHost.c_str(), syslogPort, syslogFormat);
 
-    // Test the connection FIRST (before saving)
-    if (setupWifi())
-    {
-        // Connection successful - save to EEPROM
-        saveDeviceConfigurationToEeprom();
-        LOG_PRINTLN(F("Configuration accepted and saved."));
-        if (previousConfig != nullptr)
-            delete previousConfig;  // Free old config
-    }
-    else
-    {
-        // Connection failed - restore previous config and return to AP mode
-        LOG_PRINTLN(F("Unable to connect to WiFi, configuration discarded."));
-        currentDeviceConfiguration = previousConfig;
-        delete newConfig;  // Free new config
-        configMode = true;  // Return to AP mode
-        setupWifi();  // Restart AP mode
-    }
+    // The connection is tested on the housekeeping task, the configuration saved if it succeeds
+    requestWifiConfigurationTest(newConfig);
+    request->send(200, "text/plain", F("Configuration received. Will attempt connection to WiFi with provided credentials. Will save configuration if successful."));
 }
 
-void routeLogsStream(AsyncWebServerRequest *request)
-{
-    DEBUG_PRINTLN("routeLogsStream");
-    String html = R"(<!DOCTYPE html>
+// Sent straight from flash: not a template, its % are literal
+static const char logsStreamPage[] PROGMEM = R"(<!DOCTYPE html>
 <html>
 <head>
     <style>
@@ -232,20 +370,23 @@ void routeLogsStream(AsyncWebServerRequest *request)
 </body>
 </html>
 )";
-    request->send(200, "text/html", html);
+
+void routeLogsStream(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLogsStream");
+    request->send_P(200, "text/html", logsStreamPage);
 }
 
 
 AsyncWebSocket wsLogs("/wsLogs");
-void handleWebSocketMessage(void *arg, uint8_t *data, size_t len)
+/**
+ * A log client's subscription, see log_websocket.h. The reply goes to that client only.
+ */
+void handleWebSocketMessage(AsyncWebSocketClient *client, void *arg, uint8_t *data, size_t len)
 {
     AwsFrameInfo *info = (AwsFrameInfo *)arg;
     if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT)
-    {
-        data[len] = 0; // Null-terminate the data (if text)
-        String message = "WebSocket message: " + String((char *)data);
-        LOG_PRINTLN(message);
-    }
+        client->text(subscribeLogWebsocket(client->id(), data, len));
 }
 
 void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type,
@@ -254,24 +395,22 @@ void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType
     switch (type)
     {
     case WS_EVT_CONNECT:
-        LOG_PRINTLN("WebSocket " + String(server->url()) + " client #" + String(client->id()) +
-                    " connected from " + client->remoteIP().toString());
+        LOGF_INFO("WebSocket %s client #%u connected from %s", server->url(), client->id(),
+                  client->remoteIP().toString());
+        if (!addLogWebsocketClient(client->id()))
+        {
+            LOGF_WARN("WebSocket %s client #%u refused: too many clients", server->url(), client->id());
+            client->close();
+        }
         break;
     case WS_EVT_DISCONNECT:
-        LOG_PRINTLN("WebSocket " + String(server->url()) + " client #" + String(client->id()) +
-                    " disconnected");
+        LOGF_INFO("WebSocket %s client #%u disconnected", server->url(), client->id());
+        removeLogWebsocketClient(client->id());
         break;
     case WS_EVT_DATA:
-        handleWebSocketMessage(arg, data, len);
+        handleWebSocketMessage(client, arg, data, len);
         break;
     default:
         break;
     }
 }
-
-void sendToLogsWebsocket(const String &message)
-{
-    // Check if there are WebSocket clients connected
-    if (wsLogs.count() > 0)
-        wsLogs.textAll(message); // Send message to all connected log WebSocket clients
-}
@@ -0,0 +1,21 @@
+#ifdef ESP32
+
+#include "common/shared_state.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Created during static initialization, before any task can take it
+SemaphoreHandle_t sharedStateMutex = xSemaphoreCreateRecursiveMutex();
+
+SharedStateLock::SharedStateLock()
+{
+    xSemaphoreTakeRecursive(sharedStateMutex, portMAX_DELAY);
+}
+
+SharedStateLock::~SharedStateLock()
+{
+    xSemaphoreGiveRecursive(sharedStateMutex);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+/**
+ * Scoped lock guarding state shared between the housekeeping task, the loop task
+ * and the web server task (currentDeviceConfiguration, the scheduler).
+ * Recursive, so a holder can call code that takes it again.
+ * Keep it held only for short copies or pointer swaps, never across network I/O.
+ * On ESP8266 everything runs on a single task, so it compiles to nothing.
+ */
+class SharedStateLock
+{
+public:
+#ifdef ESP32
+    SharedStateLock();
+    ~SharedStateLock();
+#else
+    SharedStateLock() {}
+#endif
+    SharedStateLock(const SharedStateLock &) = delete;
+    SharedStateLock &operator=(const SharedStateLock &) = delete;
+};
+
+#endif // SHARED_STATE_H
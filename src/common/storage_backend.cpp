@@ -0,0 +1,489 @@
+#define LOG_MODULE LOG_MODULE_STORAGE
+
+#include "common/storage_backend.h"
+
+#include <EEPROM.h>
+#include <LittleFS.h>
+
+#include "common/globals.h"
+#include "common/record_store.h"
+
+// Flash erase unit on both platforms
+const uint32_t flashSectorSize = 4096;
+const uint32_t storageSectorMagic = 0x53544F52;
+
+uint32_t storageImageCrc(uint32_t generation, const uint8_t *image, size_t size)
+{
+    uint32_t crc = crc32Update(0, reinterpret_cast<const uint8_t *>(&generation), sizeof(generation));
+    return crc32Update(crc, image, size);
+}
+
+/**
+ * Mounts LittleFS, never formatting it: a partition that does not mount may still hold data
+ * a firmware can recover, the callers do without LittleFS instead.
+ */
+bool mountLittleFs()
+{
+#ifdef ESP32
+    return LittleFS.begin(false);
+#elif defined(ESP8266)
+    LittleFS.setConfig(LittleFSConfig(false)); // begin() formats by default
+    return LittleFS.begin();
+#endif
+}
+
+/**
+ * Replaces the file at path with data: written to a temporary file, then renamed over it.
+ * LittleFS renames atomically, so a power cut leaves either the previous content or the new one.
+ */
+bool replaceFile(const char *path, const uint8_t *data, size_t length)
+{
+    char temporaryPath[40];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+    File file = LittleFS.open(temporaryPath, "w");
+    if (!file)
+        return false;
+    bool written = file.write(data, length) == length;
+    file.close();
+    return written && LittleFS.rename(temporaryPath, path);
+}
+
+#ifdef ESP8266
+const char *eepromBackupPath = "/storage.bak";
+
+/**
+ * Replaces the sector with the backup if the backup is whole and newer.
+ * The backup is checked while streamed, then read into the mirror: nothing is allocated.
+ */
+void EepromStorageBackend::restoreBackup()
+{
+    File backup = LittleFS.open(eepromBackupPath, "r");
+    if (!backup)
+        return;
+    StorageSectorHeader trailer;
+    if (backup.size() != size + sizeof(trailer) || !backup.seek(size) ||
+        backup.read(reinterpret_cast<uint8_t *>(&trailer), sizeof(trailer)) != sizeof(trailer) ||
+        trailer.magic != storageSectorMagic || trailer.generation <= generation)
+    {
+        backup.close();
+        return;
+    }
+
+    uint8_t chunk[64];
+    uint32_t crc = crc32Update(0, reinterpret_cast<const uint8_t *>(&trailer.generation), sizeof(trailer.generation));
+    backup.seek(0);
+    for (size_t offset = 0; offset < size; offset += sizeof(chunk))
+    {
+        size_t length = std::min(sizeof(chunk), size - offset);
+        if (backup.read(chunk, length) != length)
+            break;
+        crc = crc32Update(crc, chunk, length);
+    }
+    if (crc != trailer.crc)
+    {
+        backup.close();
+        return;
+    }
+
+    LOGF_WARN("EEPROM sector older than its backup (generation %u), restored", trailer.generation);
+    uint8_t *image = EEPROM.getDataPtr();
+    backup.seek(0);
+    backup.read(image, size + sizeof(trailer));
+    backup.close();
+    generation = trailer.generation;
+    EEPROM.commit();
+}
+#endif
+
+bool EepromStorageBackend::begin(size_t storageSize)
+{
+    size = storageSize;
+#ifdef ESP32
+    return EEPROM.begin(storageSize);
+#elif defined(ESP8266)
+    EEPROM.begin(storageSize + sizeof(StorageSectorHeader));
+    const uint8_t *image = EEPROM.getConstDataPtr();
+    StorageSectorHeader trailer;
+    memcpy(&trailer, image + size, sizeof(trailer));
+    // No valid trailer: a torn commit, a blank sector or an earlier firmware's image, kept as is unless restored
+    bool whole = trailer.magic == storageSectorMagic && trailer.crc == storageImageCrc(trailer.generation, image, size);
+    generation = whole ? trailer.generation : 0;
+
+    backupAvailable = mountLittleFs();
+    if (backupAvailable)
+        restoreBackup();
+    else
+        LOG_WARN(F("LittleFS unavailable: EEPROM commits are not protected against power cuts"));
+    return true;
+#endif
+}
+
+void EepromStorageBackend::end()
+{
+    EEPROM.end();
+    size = 0;
+}
+
+uint8_t *EepromStorageBackend::writeData()
+{
+    return EEPROM.getDataPtr();
+}
+
+/**
+ * On ESP8266, the backup is replaced first: until the sector is whole again, it holds the new image.
+ */
+bool EepromStorageBackend::commit(size_t from, size_t to)
+{
+    (void)from;
+    (void)to;
+    // The image is written through the pointer: getDataPtr() flags it dirty, or commit() would skip it
+    uint8_t *image = EEPROM.getDataPtr();
+#ifdef ESP8266
+    StorageSectorHeader trailer;
+    trailer.magic = storageSectorMagic;
+    trailer.generation = generation + 1;
+    trailer.crc = storageImageCrc(trailer.generation, image, size);
+    trailer.reserved = 0xFFFFFFFF;
+    memcpy(image + size, &trailer, sizeof(trailer));
+    if (backupAvailable && !replaceFile(eepromBackupPath, image, size + sizeof(trailer)))
+        LOG_WARN(F("cannot write the EEPROM backup"));
+    if (!EEPROM.commit())
+        return false;
+    generation = trailer.generation;
+    return true;
+#else
+    (void)image;
+    return EEPROM.commit();
+#endif
+}
+
+uint32_t EepromStorageBackend::bytesErasedPerCommit(size_t from, size_t to) const
+{
+    (void)from;
+    (void)to;
+#ifdef ESP32
+    // The whole image is rewritten as one NVS blob, NVS pages are erased once filled up
+    return size;
+#elif defined(ESP8266)
+    // The sector is erased and rewritten on every commit, after the backup file (see LittleFsStorageBackend)
+    size_t backupBlocks = (size + sizeof(StorageSectorHeader) + LittleFsStorageBackend::blockSize - 1) / LittleFsStorageBackend::blockSize;
+    return flashSectorSize + (backupAvailable ? (backupBlocks + 1) * LittleFsStorageBackend::blockSize : 0);
+#endif
+}
+
+#ifdef ESP32
+// Defined out of line too, so that passing them by reference (std::min(), ?:) links at any -O level
+const size_t NvsStorageBackend::pageSize;
+const size_t NvsStorageBackend::maxPages;
+
+size_t NvsStorageBackend::pageLength(size_t page) const
+{
+    size_t remaining = size - page * pageSize;
+    return remaining < pageSize ? remaining : pageSize;
+}
+
+void NvsStorageBackend::pageKey(size_t page, bool second, char *key, size_t keySize) const
+{
+    snprintf(key, keySize, "%c%u", second ? 'q' : 'p', (unsigned)page);
+}
+
+bool NvsStorageBackend::readHead(uint8_t slot, NvsStorageHead &head)
+{
+    const char *key = slot == 0 ? "h0" : "h1";
+    return preferences.getBytes(key, &head, sizeof(head)) == sizeof(head) &&
+           head.crc == crc32Update(0, reinterpret_cast<const uint8_t *>(&head), offsetof(NvsStorageHead, crc));
+}
+
+/**
+ * Reads each page from the key the newest valid head selects.
+ */
+bool NvsStorageBackend::begin(size_t storageSize)
+{
+    end();
+    if (storageSize > maxPages * pageSize || !preferences.begin(nvsNamespace, false))
+        return false;
+    secondKeyPages = 0;
+    generation = 0;
+    for (uint8_t slot = 0; slot < 2; slot++)
+    {
+        NvsStorageHead head;
+        if (readHead(slot, head) && head.generation > generation)
+        {
+            secondKeyPages = head.secondKeyPages;
+            generation = head.generation;
+        }
+    }
+
+    image = new uint8_t[storageSize];
+    size = storageSize;
+    // Pages never written read as erased EEPROM
+    memset(image, 0xFF, size);
+    char key[8];
+    for (size_t page = 0; page * pageSize < size; page++)
+    {
+        pageKey(page, secondKeyPages >> page & 1, key, sizeof(key));
+        preferences.getBytes(key, image + page * pageSize, pageLength(page));
+    }
+    return true;
+}
+
+void NvsStorageBackend::end()
+{
+    if (image == nullptr)
+        return;
+    preferences.end();
+    delete[] image;
+    image = nullptr;
+    size = 0;
+}
+
+/**
+ * The keys in use are not written: the image stays the previous one until the head is.
+ */
+bool NvsStorageBackend::commit(size_t from, size_t to)
+{
+    if (image == nullptr)
+        return false;
+    NvsStorageHead head;
+    head.secondKeyPages = secondKeyPages;
+    head.generation = generation + 1;
+    char key[8];
+    for (size_t page = from / pageSize; page * pageSize < to; page++)
+    {
+        size_t length = pageLength(page);
+        head.secondKeyPages ^= (uint64_t)1 << page;
+        pageKey(page, head.secondKeyPages >> page & 1, key, sizeof(key));
+        if (preferences.putBytes(key, image + page * pageSize, length) != length)
+            return false;
+    }
+
+    head.crc = crc32Update(0, reinterpret_cast<const uint8_t *>(&head), offsetof(NvsStorageHead, crc));
+    if (preferences.putBytes(head.generation & 1 ? "h1" : "h0", &head, sizeof(head)) != sizeof(head))
+        return false;
+    secondKeyPages = head.secondKeyPages;
+    generation = head.generation;
+    return true;
+}
+
+uint32_t NvsStorageBackend::bytesErasedPerCommit(size_t from, size_t to) const
+{
+    // Entries are appended to NVS pages, erased once filled up: each touched page costs its blob plus a 32 bytes entry header,
+    // and the head two entries
+    size_t pages = (to + pageSize - 1) / pageSize - from / pageSize;
+    return pages * (pageSize + 32) + 2 * 32;
+}
+#endif
+
+const size_t LittleFsStorageBackend::blockSize;
+
+bool LittleFsStorageBackend::begin(size_t storageSize)
+{
+    end();
+    if (!mountLittleFs())
+    {
+        LOG_ERROR(F("cannot mount LittleFS, not formatting it"));
+        return false;
+    }
+    image = new uint8_t[storageSize];
+    size = storageSize;
+    memset(image, 0xFF, size);
+    File file = LittleFS.open(path, "r");
+    if (file)
+    {
+        file.read(image, size);
+        file.close();
+    }
+    return true;
+}
+
+void LittleFsStorageBackend::end()
+{
+    // LittleFS stays mounted, other modules may use it
+    delete[] image;
+    image = nullptr;
+    size = 0;
+}
+
+/**
+ * The file is rewritten whole, aside, then renamed over the previous one: see replaceFile().
+ */
+bool LittleFsStorageBackend::commit(size_t from, size_t to)
+{
+    (void)from;
+    (void)to;
+    if (image == nullptr)
+        return false;
+    return replaceFile(path, image, size);
+}
+
+uint32_t LittleFsStorageBackend::bytesErasedPerCommit(size_t from, size_t to) const
+{
+    (void)from;
+    (void)to;
+    // Copy-on-write: each block of the new file is written elsewhere, plus the metadata block
+    size_t blocks = (size + blockSize - 1) / blockSize;
+    return (blocks + 1) * blockSize;
+}
+
+#ifdef ESP32
+const uint8_t PartitionStorageBackend::partitionSubtype;
+const uint8_t PartitionStorageBackend::counterLogSectors;
+
+bool PartitionStorageBackend::map()
+{
+    const void *pointer;
+    if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &pointer, &mapHandle) != ESP_OK)
+        return false;
+    mapped = static_cast<const uint8_t *>(pointer);
+    return true;
+}
+
+void PartitionStorageBackend::unmap()
+{
+    if (mapped == nullptr)
+        return;
+    spi_flash_munmap(mapHandle);
+    mapped = nullptr;
+}
+
+const uint8_t *PartitionStorageBackend::sectorImage(uint8_t sector) const
+{
+    if (mapped == nullptr)
+        return nullptr;
+    return mapped + sector * SPI_FLASH_SEC_SIZE + sizeof(StorageSectorHeader);
+}
+
+/**
+ * Picks the valid sector with the highest generation. Fails if there is no such partition:
+ * see fallbackStorageBackend().
+ */
+bool PartitionStorageBackend::begin(size_t storageSize)
+{
+    end();
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)partitionSubtype, label);
+    // Needs two journal sectors at least, so that the previous image survives a commit
+    if (partition == nullptr || storageSize + sizeof(StorageSectorHeader) > SPI_FLASH_SEC_SIZE ||
+        partition->size < (2 + counterLogSectors) * SPI_FLASH_SEC_SIZE)
+    {
+        partition = nullptr;
+        return false;
+    }
+    size = storageSize;
+    uint8_t partitionSectors = std::min<uint32_t>(partition->size / SPI_FLASH_SEC_SIZE, UINT8_MAX);
+    sectors = partitionSectors - counterLogSectors;
+    if (!map())
+        return false;
+
+    // A blank partition reads as the erased sector 0. The counter log sectors are looked at as
+    // well: earlier firmware had the journal over the whole partition
+    activeSector = 0;
+    generation = 0;
+    for (uint8_t sector = 0; sector < partitionSectors; sector++)
+    {
+        StorageSectorHeader header;
+        memcpy(&header, mapped + sector * SPI_FLASH_SEC_SIZE, sizeof(header));
+        if (header.magic != storageSectorMagic || header.generation <= generation)
+            continue;
+        if (header.crc != storageImageCrc(header.generation, sectorImage(sector), size))
+            continue; // torn commit
+        activeSector = sector;
+        generation = header.generation;
+    }
+    if (activeSector >= sectors)
+    {
+        // Moved into the journal before the counter log erases it
+        LOG_INFO(F("moving the storage image out of the counter log sectors"));
+        writeData();
+        return commit(0, size);
+    }
+    return true;
+}
+
+void PartitionStorageBackend::end()
+{
+    unmap();
+    delete[] pending;
+    pending = nullptr;
+    partition = nullptr;
+    size = 0;
+}
+
+uint8_t *PartitionStorageBackend::writeData()
+{
+    const uint8_t *image = sectorImage(activeSector);
+    if (pending == nullptr && image != nullptr)
+    {
+        pending = new uint8_t[size];
+        memcpy(pending, image, size);
+    }
+    return pending;
+}
+
+/**
+ * Writes the image to the sector after the active one: the header goes last, and makes it the
+ * active one. Until then, the active sector is untouched.
+ */
+bool PartitionStorageBackend::commit(size_t from, size_t to)
+{
+    (void)from;
+    (void)to;
+    if (pending == nullptr)
+        return true;
+
+    uint8_t nextSector = (activeSector + 1) % sectors;
+    size_t sectorOffset = nextSector * SPI_FLASH_SEC_SIZE;
+    StorageSectorHeader header;
+    header.magic = storageSectorMagic;
+    header.generation = generation + 1;
+    header.crc = storageImageCrc(header.generation, pending, size);
+    header.reserved = 0xFFFFFFFF;
+    if (esp_partition_erase_range(partition, sectorOffset, SPI_FLASH_SEC_SIZE) != ESP_OK ||
+        esp_partition_write(partition, sectorOffset + sizeof(header), pending, size) != ESP_OK ||
+        esp_partition_write(partition, sectorOffset, &header, sizeof(header)) != ESP_OK)
+        return false; // the writes are kept in RAM, for the next commit
+
+    activeSector = nextSector;
+    generation = header.generation;
+    // Mapped again, so that no stale cache line is read
+    unmap();
+    bool remapped = map();
+    delete[] pending;
+    pending = nullptr;
+    return remapped;
+}
+
+uint32_t PartitionStorageBackend::bytesErasedPerCommit(size_t from, size_t to) const
+{
+    (void)from;
+    (void)to;
+    return SPI_FLASH_SEC_SIZE;
+}
+#endif
+
+/**
+ * The backend eepromSession uses, see STORAGE_BACKEND.
+ */
+StorageBackend &defaultStorageBackend()
+{
+#if STORAGE_BACKEND == STORAGE_BACKEND_NVS
+    static NvsStorageBackend backend("storage");
+#elif STORAGE_BACKEND == STORAGE_BACKEND_PARTITION
+    static PartitionStorageBackend backend("config");
+#elif STORAGE_BACKEND == STORAGE_BACKEND_LITTLEFS
+    static LittleFsStorageBackend backend("/storage.bin");
+#else
+    // The same instance: eepromSession must not import the storage from itself
+    StorageBackend &backend = fallbackStorageBackend();
+#endif
+    return backend;
+}
+
+/**
+ * Used when the default backend cannot start, e.g. a firmware built for the partition
+ * backend flashed over the air onto a device with the stock partition table.
+ */
+StorageBackend &fallbackStorageBackend()
+{
+    static EepromStorageBackend backend;
+    return backend;
+}
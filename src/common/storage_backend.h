@@ -0,0 +1,225 @@
+#ifndef STORAGE_BACKEND_H
+#define STORAGE_BACKEND_H
+
+#include <Arduino.h>
+#ifdef ESP32
+#include <Preferences.h>
+#include <esp_partition.h>
+#endif
+
+// Values of STORAGE_BACKEND, selected with a build flag, e.g. -DSTORAGE_BACKEND=STORAGE_BACKEND_NVS
+#define STORAGE_BACKEND_EEPROM 0   // EEPROM library: one flash sector (ESP8266), one NVS blob (ESP32)
+#define STORAGE_BACKEND_NVS 1      // ESP32 only: Preferences, one NVS key per page
+#define STORAGE_BACKEND_LITTLEFS 2 // one LittleFS file
+#define STORAGE_BACKEND_PARTITION 3 // ESP32 only: "config" data partition, memory-mapped
+
+#ifndef STORAGE_BACKEND
+#define STORAGE_BACKEND STORAGE_BACKEND_EEPROM
+#endif
+
+#if (STORAGE_BACKEND == STORAGE_BACKEND_NVS || STORAGE_BACKEND == STORAGE_BACKEND_PARTITION) && !defined(ESP32)
+#error "The NVS and partition storage backends are only available on ESP32"
+#endif
+
+// Bytes appended after EEPROM_SIZE, not used by records: the storage benchmark writes there
+const size_t STORAGE_SCRATCH_SIZE = 16;
+
+/*
+  Where the records end up. A backend exposes the whole storage as an image: eepromSession
+  reads and writes it, and decides when to commit, which persists ranges of it.
+  Most backends load the image into RAM at begin(); a memory-mapped one serves reads from
+  flash and only holds a RAM copy while there are uncommitted writes.
+  Switching backend starts from an empty storage.
+*/
+class StorageBackend
+{
+protected:
+    size_t size = 0;
+
+public:
+    virtual ~StorageBackend() {}
+
+    virtual const char *name() const = 0;
+    virtual bool begin(size_t storageSize) = 0;
+    virtual void end() {}
+    // Image of the storage, valid after begin() until the next writeData() or commit()
+    virtual const uint8_t *readData() = 0;
+    // Writable image of the storage, valid after begin() until the next commit()
+    virtual uint8_t *writeData() = 0;
+    // Persists [from, to) of the writable image. A backend may write more than that.
+    virtual bool commit(size_t from, size_t to) = 0;
+    // Flash bytes a commit of [from, to) erases, amortized: an estimate, flash wear is not observable
+    virtual uint32_t bytesErasedPerCommit(size_t from, size_t to) const = 0;
+
+    size_t getSize() const { return size; }
+};
+
+/**
+ * Tells a whole image from a torn one: starts each sector of the partition storage journal
+ * (see PartitionStorageBackend), and ends the ESP8266 EEPROM sector (see EepromStorageBackend).
+ */
+struct StorageSectorHeader
+{
+    uint32_t magic;
+    uint32_t generation; // incremented on every commit
+    uint32_t crc;        // of generation and of the image
+    uint32_t reserved;
+};
+
+/*
+  The EEPROM library's own RAM mirror is used as the image.
+  On ESP32 the library stores it as one NVS blob, which NVS replaces atomically.
+  On ESP8266 a commit erases the library's flash sector, then programs it from the first byte
+  to the last: the image is followed by a StorageSectorHeader, programmed last, so that a torn
+  sector is recognized. Before each commit, the image and its trailer are copied to a LittleFS
+  file, replaced atomically; begin() restores that copy when it is newer than the sector, as
+  after a power cut between the erase and the end of the programming.
+*/
+class EepromStorageBackend : public StorageBackend
+{
+#ifdef ESP8266
+private:
+    bool backupAvailable = false; // LittleFS mounted
+    uint32_t generation = 0;      // of the sector, 0 if it has no valid trailer
+
+    void restoreBackup();
+
+#endif
+public:
+    const char *name() const override { return "eeprom"; }
+    bool begin(size_t storageSize) override;
+    void end() override;
+    const uint8_t *readData() override { return writeData(); }
+    uint8_t *writeData() override;
+    bool commit(size_t from, size_t to) override;
+    uint32_t bytesErasedPerCommit(size_t from, size_t to) const override;
+};
+
+#ifdef ESP32
+/**
+ * Written last by a commit of the NVS backend, see NvsStorageBackend.
+ */
+struct NvsStorageHead
+{
+    uint64_t secondKeyPages; // bit n: page n is stored under its second key
+    uint32_t generation;     // incremented on every commit
+    uint32_t crc;            // of secondKeyPages and generation
+};
+
+/*
+  The storage is split in pages, one NVS blob each: a commit only rewrites the pages it touches.
+  Each page has two keys ("p0" and "q0" for page 0). A commit writes the touched pages under
+  the keys not in use, then a head, with the next generation number, that switches to them all
+  at once. The heads alternate between two keys as well, and begin() takes the valid one with
+  the highest generation. NVS replaces a key atomically, so a power cut during a commit leaves
+  either the previous or the new image, even for a record spanning two pages.
+  Without a head, as written by earlier firmwares, the pages are read from their first keys.
+*/
+class NvsStorageBackend : public StorageBackend
+{
+private:
+    const char *nvsNamespace;
+    Preferences preferences;
+    uint8_t *image = nullptr;
+    uint64_t secondKeyPages = 0; // of the head in use
+    uint32_t generation = 0;     // of the head in use, 0 if there is none
+
+    size_t pageLength(size_t page) const;
+    void pageKey(size_t page, bool second, char *key, size_t keySize) const;
+    bool readHead(uint8_t slot, NvsStorageHead &head);
+
+public:
+    static const size_t pageSize = 64;
+    static const size_t maxPages = 64; // bits of NvsStorageHead::secondKeyPages
+
+    NvsStorageBackend(const char *nvsNamespace_) : nvsNamespace(nvsNamespace_) {}
+    ~NvsStorageBackend() { end(); }
+
+    const char *name() const override { return "nvs"; }
+    bool begin(size_t storageSize) override;
+    void end() override;
+    const uint8_t *readData() override { return image; }
+    uint8_t *writeData() override { return image; }
+    bool commit(size_t from, size_t to) override;
+    uint32_t bytesErasedPerCommit(size_t from, size_t to) const override;
+    uint32_t getGeneration() const { return generation; }
+};
+#endif
+
+/**
+ * The storage is one file, which each commit replaces atomically, see replaceFile().
+ */
+class LittleFsStorageBackend : public StorageBackend
+{
+private:
+    const char *path;
+    uint8_t *image = nullptr;
+
+public:
+    static const size_t blockSize = 4096;
+
+    LittleFsStorageBackend(const char *path_) : path(path_) {}
+    ~LittleFsStorageBackend() { end(); }
+
+    const char *name() const override { return "littlefs"; }
+    bool begin(size_t storageSize) override;
+    void end() override;
+    const uint8_t *readData() override { return image; }
+    uint8_t *writeData() override { return image; }
+    bool commit(size_t from, size_t to) override;
+    uint32_t bytesErasedPerCommit(size_t from, size_t to) const override;
+};
+
+#ifdef ESP32
+/*
+  Records in a dedicated data partition (see partitions.csv), mapped into the address space:
+  reads are served by the flash cache, with no RAM copy. The first write copies the image to
+  RAM, and a commit writes it to the next sector, then maps the partition again.
+
+  The sectors form a journal: each commit erases and programs the sector after the active one,
+  its header last, with the next generation number. The previous image is never touched, so
+  a power cut at any point of a commit leaves either the previous or the new image: begin()
+  picks the valid sector with the highest generation. It also spreads the erases over the
+  whole partition, but for its last counterLogSectors sectors: those hold the counter log
+  (see counter_store.h), which is written without commits.
+*/
+class PartitionStorageBackend : public StorageBackend
+{
+private:
+    const char *label;
+    const esp_partition_t *partition = nullptr;
+    spi_flash_mmap_handle_t mapHandle = 0;
+    const uint8_t *mapped = nullptr; // whole partition
+    uint8_t *pending = nullptr;      // RAM copy with the uncommitted writes, nullptr if clean
+    uint8_t sectors = 0; // of the journal, the counter log sectors excluded
+    uint8_t activeSector = 0;
+    uint32_t generation = 0; // of the active sector, 0 if no sector is valid
+
+    bool map();
+    void unmap();
+    const uint8_t *sectorImage(uint8_t sector) const;
+
+public:
+    static const uint8_t partitionSubtype = 0x40;
+    static const uint8_t counterLogSectors = 2;
+
+    PartitionStorageBackend(const char *label_) : label(label_) {}
+    ~PartitionStorageBackend() { end(); }
+
+    const char *name() const override { return "partition"; }
+    bool begin(size_t storageSize) override;
+    void end() override;
+    const uint8_t *readData() override { return pending != nullptr ? pending : sectorImage(activeSector); }
+    uint8_t *writeData() override;
+    bool commit(size_t from, size_t to) override;
+    uint32_t bytesErasedPerCommit(size_t from, size_t to) const override;
+    uint32_t getGeneration() const { return generation; }
+};
+#endif
+
+StorageBackend &defaultStorageBackend();
+StorageBackend &fallbackStorageBackend();
+bool mountLittleFs();
+bool replaceFile(const char *path, const uint8_t *data, size_t length);
+
+#endif // STORAGE_BACKEND_H
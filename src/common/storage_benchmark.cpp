@@ -0,0 +1,130 @@
+#define LOG_MODULE LOG_MODULE_STORAGE
+
+#include "common/storage_benchmark.h"
+
+#include <ArduinoJson.h>
+
+#include "common/eeprom_session.h"
+#include "common/globals.h"
+#include "common/scheduler.h"
+#include "common/shared_state.h"
+#include "common/storage_backend.h"
+#include "common/utils.h"
+
+const uint8_t storageBenchmarkCommits = 8;
+
+String storageBenchmarkResults = "{}";
+TaskId storageBenchmarkTask = INVALID_TASK_ID;
+
+/**
+ * Commits single byte changes in the scratch area, after EEPROM_SIZE: records are left untouched.
+ * The live backend (the one eepromSession uses) is not reloaded, so its read time is not measured.
+ */
+void benchmarkStorageBackend(StorageBackend &backend, bool live, JsonObject result)
+{
+    result["backend"] = backend.name();
+    result["live"] = live;
+    if (!live)
+    {
+        uint64_t start = monotonicMicros();
+        if (!backend.begin(EEPROM_SIZE + STORAGE_SCRATCH_SIZE))
+        {
+            result["error"] = "begin failed";
+            return;
+        }
+        // Records are served from the image afterwards (RAM, or mapped flash): this is the only flash read
+        result["readMicros"] = (uint32_t)(monotonicMicros() - start);
+    }
+
+    uint64_t totalMicros = 0;
+    uint32_t maxMicros = 0;
+    uint8_t failedCommits = 0;
+    for (uint8_t i = 0; i < storageBenchmarkCommits; i++)
+    {
+        size_t address = EEPROM_SIZE + i % STORAGE_SCRATCH_SIZE;
+        // Taken again every time: a memory-mapped backend releases it on commit
+        uint8_t *image = backend.writeData();
+        if (image == nullptr)
+        {
+            failedCommits++;
+            continue;
+        }
+        image[address] ^= 0xFF;
+        uint64_t start = monotonicMicros();
+        if (!backend.commit(address, address + 1))
+            failedCommits++;
+        uint32_t elapsed = monotonicMicros() - start;
+        totalMicros += elapsed;
+        if (elapsed > maxMicros)
+            maxMicros = elapsed;
+        yield();
+    }
+    result["commits"] = storageBenchmarkCommits;
+    result["failedCommits"] = failedCommits;
+    result["commitMicrosAvg"] = (uint32_t)(totalMicros / storageBenchmarkCommits);
+    result["commitMicrosMax"] = maxMicros;
+    result["estimatedBytesErasedPerCommit"] = backend.bytesErasedPerCommit(EEPROM_SIZE, EEPROM_SIZE + 1);
+
+    if (!live)
+        backend.end();
+}
+
+/**
+ * Blocking, for several seconds: runs from the loop, never from a request handler.
+ */
+void runStorageBenchmark()
+{
+    LOG_PRINTLN(F("Storage benchmark: started"));
+    SharedStateLock lock;
+    // Pending record writes reach flash first, the benchmark commits must only carry its own bytes
+    eepromSession.commit();
+    StorageBackend *liveBackend = eepromSession.getBackend();
+
+    JsonDocument doc;
+    JsonArray results = doc["backends"].to<JsonArray>();
+
+    // The EEPROM library and the config partition are single instances: the live one is benchmarked in place
+    EepromStorageBackend eepromBackend;
+    bool eepromLive = liveBackend != nullptr && strcmp(liveBackend->name(), eepromBackend.name()) == 0;
+    benchmarkStorageBackend(eepromLive ? *liveBackend : eepromBackend, eepromLive, results.add<JsonObject>());
+#ifdef ESP32
+    NvsStorageBackend nvsBackend("storageBench");
+    benchmarkStorageBackend(nvsBackend, false, results.add<JsonObject>());
+
+    PartitionStorageBackend partitionBackend("config");
+    bool partitionLive = liveBackend != nullptr && strcmp(liveBackend->name(), partitionBackend.name()) == 0;
+    benchmarkStorageBackend(partitionLive ? *liveBackend : partitionBackend, partitionLive, results.add<JsonObject>());
+#endif
+    LittleFsStorageBackend littleFsBackend("/storage_bench.bin");
+    benchmarkStorageBackend(littleFsBackend, false, results.add<JsonObject>());
+
+    doc["ranAtMillis"] = monotonicMillis();
+    storageBenchmarkResults = "";
+    serializeJson(doc, storageBenchmarkResults);
+    LOG_PRINTLN(F("Storage benchmark: done"));
+}
+
+void scheduleStorageBenchmark()
+{
+    SharedStateLock lock;
+    if (storageBenchmarkTask != INVALID_TASK_ID)
+        return;
+    storageBenchmarkTask = scheduler.scheduleOnce("storageBenchmark", 0, []()
+                                                  {
+        runStorageBenchmark();
+        SharedStateLock lock;
+        storageBenchmarkTask = INVALID_TASK_ID; });
+}
+
+String storageBenchmarkToJson()
+{
+    SharedStateLock lock;
+    if (storageBenchmarkTask == INVALID_TASK_ID)
+        return storageBenchmarkResults;
+    JsonDocument doc;
+    deserializeJson(doc, storageBenchmarkResults);
+    doc["running"] = true;
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
@@ -0,0 +1,9 @@
+#ifndef STORAGE_BENCHMARK_H
+#define STORAGE_BENCHMARK_H
+
+#include <Arduino.h>
+
+void scheduleStorageBenchmark();
+String storageBenchmarkToJson();
+
+#endif // STORAGE_BENCHMARK_H
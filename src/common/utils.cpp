@@ -1,9 +1,8 @@
 #include "utils.h"
 
-#include <Ticker.h>
-
 #ifdef ESP32
 #include <WiFi.h>
+#include <esp_timer.h>
 #elif defined(ESP8266)
 #include <ESP8266WiFi.h>
 #endif
@@ -18,18 +17,6 @@ String stringMask(const String &str, char mask)
     return masked;
 }
 
-Ticker restartTimer;
-void scheduleRestart(uint8_t seconds = 3)
-{
-    static bool restartScheduled = false;
-    if (!restartScheduled)
-    {
-        restartScheduled = true;
-        restartTimer.once(seconds, []()
-                          { ESP.restart(); });
-    }
-}
-
 String getWifiStrength()
 {
     long rssi = WiFi.RSSI();
@@ -79,4 +66,13 @@ String millisToTimeStr(uint64_t millisValue)
 
     timeStr += String(seconds) + "s";
     return timeStr;
-}
\ No newline at end of file
+}
+
+uint64_t monotonicMicros()
+{
+#ifdef ESP32
+    return (uint64_t)esp_timer_get_time();
+#elif defined(ESP8266)
+    return micros64();
+#endif
+}
@@ -6,4 +6,11 @@
 String stringMask(const String &str, char mask);
 String getWifiStrength();
 String millisToTimeStr(uint64_t);
+
+/**
+ * 64-bit monotonic clock, unaffected by the 49-day rollover of millis().
+ */
+uint64_t monotonicMicros();
+inline uint64_t monotonicMillis() { return monotonicMicros() / 1000; }
+
 #endif // UTILS_H
\ No newline at end of file
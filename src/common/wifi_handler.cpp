@@ -1,3 +1,5 @@
+#define LOG_MODULE LOG_MODULE_WIFI
+
 #include "wifi_handler.h"
 
 #include <Arduino.h>
@@ -10,19 +12,73 @@
 #include <ESP8266mDNS.h>
 #endif
 
+#include "common/boot_timeline.h"
+#include "common/counter_store.h"
 #include "common/globals.h"
+#include "common/scheduler.h"
+#include "common/shared_state.h"
+#include "common/utils.h"
 #include "device_configuration.h"
 
-const char *ssid, *password, *hostname;
+// Copied out of the device configuration, which can be replaced by another task while connecting
+char ssid[sizeof(DeviceConfiguration::ssid) + 1];
+char password[sizeof(DeviceConfiguration::password) + 1];
+char hostname[sizeof(DeviceConfiguration::hostname) + 1];
+
+bool mdnsStarted = false;
+
+// Non-blocking connection: the interface powering down, then the STA connection being polled.
+// Only used on the housekeeping task
+const uint8_t wifiConnectionAttempts = 5;
+const uint32_t wifiConnectionPollMillis = 250;
+#ifdef ESP8266
+const uint32_t wifiPowerDownMillis = 2000; // ESP8266 needs longer to fully power down WiFi, and mDNS
+#else
+const uint32_t wifiPowerDownMillis = 1000;
+#endif
+TaskId wifiConnectTask = INVALID_TASK_ID;
+uint8_t wifiConnectionAttemptsLeft = 0;
+uint64_t wifiConnectionAttemptBeginMillis = 0;
+
+// Configuration test requested by the web server, see requestWifiConfigurationTest()
+const uint32_t wifiConfigurationTestDelayMillis = 250;
+DeviceConfiguration wifiCandidateConfiguration; // guarded by SharedStateLock
+TaskId wifiTestTask = INVALID_TASK_ID;          // guarded by SharedStateLock
+bool wifiTestingConfiguration = false;
+DeviceConfiguration wifiPreviousConfiguration;
+bool wifiHadPreviousConfiguration = false;
+
+void pollWifiConnection();
 
-uint64_t lastCheckedMillis = 0;
+void stopWifiConnectionPolling()
+{
+    // Reset the id as well, the slot may be reused by another task
+    scheduler.cancel(wifiConnectTask);
+    wifiConnectTask = INVALID_TASK_ID;
+}
 
-bool connectWiFi(const char *ssid, const char *password, const char *hostname)
+bool loadCredentials()
 {
-    bool connected = false;
-    uint8_t numRetries = 5;
-    IPAddress ipAddress = IPAddress((uint32_t)0);
+    if (configMode)
+    {
+        strlcpy(ssid, configModeSsid, sizeof(ssid));
+        password[0] = '\0';
+        strlcpy(hostname, configModeHostname, sizeof(hostname));
+        return true;
+    }
+
+    SharedStateLock lock;
+    if (currentDeviceConfiguration == nullptr)
+        return false;
+    // Fields are not necessarily null-terminated when they fill the whole array
+    strlcpy(ssid, currentDeviceConfiguration->ssid, std::min(sizeof(ssid), sizeof(currentDeviceConfiguration->ssid) + 1));
+    strlcpy(password, currentDeviceConfiguration->password, std::min(sizeof(password), sizeof(currentDeviceConfiguration->password) + 1));
+    strlcpy(hostname, currentDeviceConfiguration->hostname, std::min(sizeof(hostname), sizeof(currentDeviceConfiguration->hostname) + 1));
+    return true;
+}
 
+void configureRadio()
+{
     // Disable WiFi persistence to prevent flash wear and unexpected reconnections
     WiFi.setAutoReconnect(false);
     WiFi.persistent(false);
@@ -33,53 +89,13 @@ bool connectWiFi(const char *ssid, const char *password, const char *hostname)
     WiFi.setSleep(false);  // Disable WiFi sleep to reduce serial corruption
     esp_wifi_set_ps(WIFI_PS_NONE); // Explicitly disable power save for best performance
 #endif
+}
 
-    if (configMode)
-    {
-        WiFi.mode(WIFI_AP);
-        connected = WiFi.softAP(ssid, password);
-        ipAddress = WiFi.softAPIP();
-    }
-    else
-    {
-        while (!connected && numRetries-- > 0)
-        {
-            WiFi.mode(WIFI_STA);
-            // Uncomment to set dns
-            // WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, dns);
-            WiFi.begin(ssid, password);
-            DEBUG_PRINT(F("Connecting to WiFi..."));
-            uint64_t connectionAttemptBeginMillis = millis();
-
-            while (millis() - connectionAttemptBeginMillis < wifiConnectionMaxMillis && !connected)
-            {
-                delay(500);
-                DEBUG_PRINT(F("."));
-                if (WiFi.status() == WL_CONNECTED)
-                {
-                    connected = true;
-                    ipAddress = WiFi.localIP();
-                }
-            }
-            if (!connected)
-                DEBUG_PRINTLN(F("\nUnable to connect. Trying again."));
-        }
-        if (!connected)
-        {
-            DEBUG_PRINTLN(F("Connection to WiFi unsuccessful."));
-            return false;  // Let the caller handle config mode transition
-        }
-        DEBUG_PRINTLN("\nConnected to WiFi with IP address " + ipAddress.toString());
-    }
-
-    // Initialize mDNS
-    MDNS.end();
-#ifdef ESP8266
-    delay(2000); // ESP8266 needs longer delay for mDNS cleanup
-#else
-    delay(1000);
-#endif
-
+/**
+ * A running responder is ended first by restartWifi(), which then waits for its cleanup.
+ */
+void startMDNS(const char *hostname)
+{
     if (!MDNS.begin(hostname))
     {
         LOG_PRINTLN(F("Error setting up mDNS responder!"));
@@ -91,77 +107,178 @@ bool connectWiFi(const char *ssid, const char *password, const char *hostname)
         }
         else
         {
-            DEBUG_PRINTLN("mDNS responder started with hostname " + String(hostname) + " after retry");
+            LOGF_DEBUG("mDNS responder started with hostname %s after retry", hostname);
             // Advertise HTTP service
             MDNS.addService("http", "tcp", 80);
+            mdnsStarted = true;
         }
     }
     else
     {
-        DEBUG_PRINTLN("mDNS responder started with hostname " + String(hostname));
+        LOGF_DEBUG("mDNS responder started with hostname %s", hostname);
         // Advertise HTTP service for better discoverability
         MDNS.addService("http", "tcp", 80);
+        mdnsStarted = true;
     }
-
-    return true;
 }
 
-bool setupWifi()
+/**
+ * Starts the AP (config mode), or the STA connection, polled by pollWifiConnection().
+ * The interface must be off.
+ */
+void connectWifi()
 {
-    LOG_PRINT(F("Setting up WiFi in "));
-    LOG_PRINT(configMode ? F("AP") : F("STA"));
-    LOG_PRINTLN(F(" mode."));
-    if (configMode)
+    if (!loadCredentials())
     {
-        ssid = configModeSsid;
-        password = "";
-        hostname = configModeHostname;
+        LOG_PRINTLN(F("No WiFi configuration. Entering config mode."));
+        configMode = true;
+        loadCredentials();
     }
-    else
+
+    configureRadio();
+    if (configMode)
     {
-        ssid = currentDeviceConfiguration->ssid;
-        password = currentDeviceConfiguration->password;
-        hostname = currentDeviceConfiguration->hostname;
+        LOG_PRINTLN(F("Setting up WiFi in AP mode."));
+        WiFi.mode(WIFI_AP);
+        if (!WiFi.softAP(ssid, password))
+            LOG_PRINTLN(F("Unable to start the access point."));
+        startMDNS(hostname);
+        return;
     }
 
-    // Disconnect cleanly based on current mode
-    wifi_mode_t currentMode = WiFi.getMode();
+    LOG_PRINTLN(F("Connecting to WiFi in STA mode in the background."));
+    WiFi.mode(WIFI_STA);
+    // Uncomment to set dns
+    // WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, dns);
+    WiFi.begin(ssid, password);
 
-    if (currentMode == WIFI_STA || currentMode == WIFI_AP_STA)
+    wifiConnectionAttemptsLeft = wifiConnectionAttempts - 1;
+    wifiConnectionAttemptBeginMillis = monotonicMillis();
+    wifiConnectTask = scheduler.scheduleEvery("wifiConnect", wifiConnectionPollMillis, pollWifiConnection, wifiConnectionPollMillis);
+}
+
+/**
+ * Non-blocking (re)connection, on the housekeeping task only: tears the interface down,
+ * then connects (STA) or starts the AP (config mode) once it is off.
+ */
+void restartWifi()
+{
+    // Supersedes a connection in progress
+    stopWifiConnectionPolling();
+
+    if (mdnsStarted)
     {
-        WiFi.disconnect(true, true); // disconnect and erase AP info
-#ifdef ESP8266
-        delay(500); // ESP8266 needs more time
-#else
-        delay(100);
-#endif
+        MDNS.end();
+        mdnsStarted = false;
     }
-
+    wifi_mode_t currentMode = WiFi.getMode();
+    if (currentMode == WIFI_STA || currentMode == WIFI_AP_STA)
+        WiFi.disconnect(true, true); // disconnect and erase AP info
     if (currentMode == WIFI_AP || currentMode == WIFI_AP_STA)
-    {
         WiFi.softAPdisconnect(true);
-#ifdef ESP8266
-        delay(500); // ESP8266 needs more time
-#else
-        delay(100);
-#endif
+    WiFi.mode(WIFI_OFF);
+
+    // The radio, and mDNS, need a while to power down: waited for on the scheduler
+    wifiConnectTask = scheduler.scheduleOnce("wifiConnect", wifiPowerDownMillis, []()
+                                             {
+        wifiConnectTask = INVALID_TASK_ID;
+        if (WiFi.getMode() != WIFI_OFF)
+            LOG_PRINTLN(F("Warning: WiFi failed to turn off completely"));
+        connectWifi(); });
+}
+
+/**
+ * Ends a configuration test started by requestWifiConfigurationTest(): saves the tested
+ * configuration if connected, else goes back to the previous one.
+ */
+void endWifiConfigurationTest(bool connected)
+{
+    if (!wifiTestingConfiguration)
+        return;
+    wifiTestingConfiguration = false;
+    if (connected)
+    {
+        saveDeviceConfigurationToEeprom();
+        LOG_PRINTLN(F("Configuration accepted and saved."));
+        return;
     }
+    LOG_PRINTLN(F("Unable to connect to WiFi, configuration discarded."));
+    setCurrentDeviceConfiguration(wifiHadPreviousConfiguration ? &wifiPreviousConfiguration : nullptr);
+}
 
-    WiFi.mode(WIFI_OFF);
+/**
+ * Polls the connection started by connectWifi(): retries on timeout,
+ * and falls back to config mode (AP) once all attempts failed.
+ */
+void pollWifiConnection()
+{
+    if (WiFi.status() == WL_CONNECTED)
+    {
+        stopWifiConnectionPolling();
+        DEBUG_PRINTLN("Connected to WiFi with IP address " + WiFi.localIP().toString());
+        markBootPhase(BOOT_PHASE_WIFI_CONNECTED);
+        startMDNS(hostname);
+        endWifiConfigurationTest(true);
+        return;
+    }
 
-#ifdef ESP8266
-    delay(1000); // ESP8266 needs longer to fully power down WiFi
-#else
-    delay(500);  // ESP32 can switch faster
-#endif
+    if (monotonicMillis() - wifiConnectionAttemptBeginMillis < wifiConnectionMaxMillis)
+        return;
 
-    // Verify mode changed
-    if (WiFi.getMode() != WIFI_OFF)
+    if (wifiConnectionAttemptsLeft > 0)
     {
-        LOG_PRINTLN(F("Warning: WiFi failed to turn off completely"));
+        wifiConnectionAttemptsLeft--;
+        DEBUG_PRINTLN(F("Unable to connect. Trying again."));
+        WiFi.disconnect();
+        WiFi.begin(ssid, password);
+        wifiConnectionAttemptBeginMillis = monotonicMillis();
+        return;
     }
 
-    return connectWiFi(ssid, password, hostname);
+    stopWifiConnectionPolling();
+    LOG_PRINTLN(F("Connection to WiFi unsuccessful. Entering config mode."));
+    endWifiConfigurationTest(false);
+    configMode = true;
+    restartWifi(); // Enter AP mode after failed STA connection
+}
+
+/**
+ * Non-blocking, at boot: brings the interface up and returns, the connection completes in
+ * the background. In config mode the AP is started right away.
+ */
+void beginWifi()
+{
+    stopWifiConnectionPolling();
+    connectWifi();
+}
+
+/**
+ * From any task, typically the web server's: the configuration is tested on the housekeeping
+ * task, in the background. The STA connection is attempted with candidate; candidate is saved
+ * if it succeeds, else the previous configuration is restored and config mode entered.
+ */
+void requestWifiConfigurationTest(const DeviceConfiguration &candidate)
+{
+    SharedStateLock lock;
+    wifiCandidateConfiguration = candidate;
+    if (wifiTestTask != INVALID_TASK_ID)
+        return; // the candidate is replaced, the test not started yet
+    // Delayed a little, so that the reply is sent before the network goes down
+    wifiTestTask = scheduler.scheduleOnce("wifiTest", wifiConfigurationTestDelayMillis, []()
+                                          {
+        DeviceConfiguration candidate;
+        {
+            SharedStateLock lock;
+            candidate = wifiCandidateConfiguration;
+            wifiTestTask = INVALID_TASK_ID;
+        }
+        // A test still running is superseded: its previous configuration is kept
+        if (!wifiTestingConfiguration)
+            wifiHadPreviousConfiguration = copyCurrentDeviceConfiguration(wifiPreviousConfiguration);
+        wifiTestingConfiguration = true;
+        setCurrentDeviceConfiguration(&candidate);
+        configMode = false; // Force STA mode to test the new credentials
+        restartWifi(); });
 }
 
 void loopWiFi()
@@ -169,25 +286,29 @@ void loopWiFi()
 #ifdef ESP8266
     MDNS.update();
 #endif
+}
 
-    if (configMode)
+/**
+ * Makes sure WiFi is connected, reconnects if necessary.
+ * Run every wifiConnectionStatusCheckMillis by the scheduler.
+ */
+void checkWiFiConnection()
+{
+    // Nothing to check in AP mode, or while a connection is in progress
+    if (configMode || wifiConnectTask != INVALID_TASK_ID)
         return;
 
-    // Make sure WiFi is connected, reconnect if necessary
-    if (millis() - lastCheckedMillis >= wifiConnectionStatusCheckMillis)
-    {
-        lastCheckedMillis = millis();
-        WiFiClient client;
-        const char *host = "www.google.com";
-        const int port = 80; // HTTP port
+    WiFiClient client;
+    const char *host = "www.google.com";
+    const int port = 80; // HTTP port
 
-        if (WiFi.status() != WL_CONNECTED || !client.connect(host, port))
-        {
-            LOG_PRINTLN("WiFi disconnected. Attempting WiFi setup");
-            setupWifi();
-        }
-        client.stop(); // Explicitly close connection
+    if (WiFi.status() != WL_CONNECTED || !client.connect(host, port))
+    {
+        LOG_PRINTLN("WiFi disconnected. Attempting WiFi setup");
+        persistentCounters.add(COUNTER_WIFI_RECONNECTS);
+        restartWifi();
     }
+    client.stop(); // Explicitly close connection
 }
 
 String getIPAddress()
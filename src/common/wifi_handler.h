@@ -3,8 +3,13 @@
 
 #include <Arduino.h>
 
-bool setupWifi();
+#include "common/device_configuration.h"
+
+void beginWifi();
+void restartWifi();
+void requestWifiConfigurationTest(const DeviceConfiguration &candidate);
 void loopWiFi();
+void checkWiFiConnection();
 String getIPAddress();
 
 #endif
\ No newline at end of file
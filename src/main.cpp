@@ -7,6 +7,7 @@
 #include "common/common_main.h"
 #include "common/eeprom_utils.tpp"
 #include "common/globals.h"
+#include "common/scheduler.h"
 
 #include "globals.h"
 #include "serverHandles.h"
@@ -31,16 +32,17 @@ void setup(void)
 
 void loop(void)
 {
-  if (commonLoop() == 2) // don't run if in bootloop or if missing configuration
+  uint8_t commonStatus = commonLoop();
+  if (commonStatus == 2) // don't run if in bootloop or if missing configuration
   {
     DEBUG_PRINTLN("bootloopMode, skipping main loop");
-    delay(500);
+    delay(std::min<uint32_t>(500, scheduler.millisUntilNextDeadline()));
     return;
   }
 
-  if (!commonLoop() || systemConfiguration == nullptr)
+  if (commonStatus != 0 || systemConfiguration == nullptr)
   {
-    delay(500);
+    delay(std::min<uint32_t>(500, scheduler.millisUntilNextDeadline()));
     return;
   }
   // delay(1000);
@@ -3,51 +3,82 @@
 #elif defined(ESP8266)
 #include <ESP8266HTTPClient.h>
 #endif
-
+#include <memory>
 
 #include "globals.h"
+#include "common/shared_state.h"
 #include "common/utils.h"
 #include "serverHandles.h"
 
+/**
+ * The home page, sent chunk by chunk: the routes are rendered one at a time, never gathered
+ * into one String.
+ */
 void routeHomeComplete(AsyncWebServerRequest *request)
 {
     DEBUG_PRINTLN("routeHome");
 
+    struct HomePage
+    {
+        String pending; // rendered, not sent yet
+        size_t sent = 0;
+        std::map<String, String>::const_iterator route;
+    };
+    std::shared_ptr<HomePage> page = std::make_shared<HomePage>();
+
     // Software Version
-    String currentConfigStr = "\n\n---\nSoftware version: " + String(SW_VERSION);
+    page->pending = "\n\n---\nSoftware version: " + String(SW_VERSION);
 
     // Quick restarts
-    currentConfigStr += "\n\n---\nQuick restarts count: " + String(quickRestartsCount);
+    page->pending += "\n\n---\nQuick restarts count: " + String(quickRestartsCount);
 
     // Wifi signal strength
     String wifiStrength = getWifiStrength();
-    currentConfigStr += "\n\n---\nWifi Signal strength: " + wifiStrength;
-    currentConfigStr += "\nHostname: " + String(currentDeviceConfiguration->hostname);
+    page->pending += "\n\n---\nWifi Signal strength: " + wifiStrength;
+    {
+        SharedStateLock lock;
+        if (currentDeviceConfiguration != nullptr)
+            page->pending += "\nHostname: " + String(currentDeviceConfiguration->hostname);
+    }
 
     // Current common configuration
-    // currentConfigStr += "\n\n---\nDevice configuration:\n";
+    // page->pending += "\n\n---\nDevice configuration:\n";
     // if (currentDeviceConfiguration != nullptr)
-    //     currentConfigStr += currentDeviceConfiguration->toStr();
+    //     page->pending += currentDeviceConfiguration->toStr();
     // else
-    //     currentConfigStr += F("\tNo valid configuration was found.");
-
-    // Routes description
-    if (!routeDescriptions.empty())
-    {
-        currentConfigStr += "\n\n---\nAvailable services:\n";
-        // Iterate over the map and print the key-value pairs
-        for (const auto &pair : routeDescriptions)
-        {
-            currentConfigStr += pair.first;
-            currentConfigStr += !pair.second.isEmpty() ? (": " + pair.second) : "";
-            currentConfigStr += "\n";
-        }
-    }
+    //     page->pending += F("\tNo valid configuration was found.");
 
     // Components data
     // <components_data>
 
-    request->send(200, "text/plain", currentConfigStr);
+    // Routes description, added by the filler below
+    if (!routeDescriptions.empty())
+        page->pending += "\n\n---\nAvailable services:\n";
+    page->route = routeDescriptions.begin();
+
+    request->send(request->beginChunkedResponse("text/plain", [page](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                {
+        (void)index;
+        size_t written = 0;
+        while (written < maxLen)
+        {
+            if (page->sent == page->pending.length())
+            {
+                if (page->route == routeDescriptions.end())
+                    break;
+                page->pending = page->route->first;
+                if (!page->route->second.isEmpty())
+                    page->pending += ": " + page->route->second;
+                page->pending += "\n";
+                page->sent = 0;
+                ++page->route;
+            }
+            size_t length = std::min(maxLen - written, page->pending.length() - page->sent);
+            memcpy(buffer + written, page->pending.c_str() + page->sent, length);
+            page->sent += length;
+            written += length;
+        }
+        return written; }));
 }
 
 void addServerHandles()
@@ -61,20 +92,27 @@ void addServerHandles()
     routeDescriptions["/configure"] = "Configure sump pump manager settings";
 }
 
-String formatConfigurationHtmlTemplate()
-{
-    String myConfig = String(systemConfiguration->myConfig);
+// Sent straight from flash, see configurationValue() for the %PLACEHOLDERS%
+static const char configurationPage[] PROGMEM = R"(<!DOCTYPE html>
+<html><head><meta charset='utf-8'><title>System Configuration</title></head><body>
+<form method='post' action='/saveConfig'>
+<label for='myConfig'>My config char:</label>
+<input type='text' id='myConfig' name='myConfig' value='%MY_CONFIG%'><br><br>
+<input type='submit' value='Save'></form></body></html>
+)";
 
-    return String("<!DOCTYPE html><html><head><meta charset='utf-8'><title>System Configuration</title></head><body>\
-<form method='post' action='/saveConfig'>\
-<label for='myConfig'>My config char:</label>\
-<input type='text' id='myConfig' name='myConfig' value='" +
-                  myConfig + "'><br><br>\
-<input type='submit' value='Save'></form></body></html>");
+/**
+ * The value of one of configurationPage's placeholders, called while the page is sent.
+ */
+String configurationValue(const String &name)
+{
+    if (name == "MY_CONFIG" && systemConfiguration != nullptr)
+        return String(systemConfiguration->myConfig);
+    return String();
 }
 
 void routeConfigureBoard(AsyncWebServerRequest *request)
 {
-    DEBUG_PRINTLN("routeConfigureBoard")
-    request->send(200, "text/html", formatConfigurationHtmlTemplate());
+    DEBUG_PRINTLN("routeConfigureBoard");
+    request->send_P(200, "text/html", configurationPage, configurationValue);
 }
@@ -3,42 +3,45 @@
 #include "common/eeprom_utils.tpp"
 #include "common/globals.h"
 
-int SYSTEM_CONFIGURATION_EEPROM_ADDR;
+const int systemConfigurationEepromAddress = ProjectEepromLayout::address<SystemConfiguration>();
+// Statically owned: systemConfiguration points to it once a configuration is set
+SystemConfiguration systemConfigurationStorage('R');
 SystemConfiguration *systemConfiguration = nullptr;
 
 bool readConfigFromEeprom()
 {
     DEBUG_PRINTLN(F("EEPROM: SPM configuration: read"));
-    SystemConfiguration *eepromConfig = readDataFromEeprom<SystemConfiguration>(SYSTEM_CONFIGURATION_EEPROM_ADDR);
-    if (eepromConfig != nullptr)
+    SystemConfiguration eepromConfig('R');
+    if (readDataFromEeprom(systemConfigurationEepromAddress, eepromConfig))
     {
-        systemConfiguration = eepromConfig;
+        systemConfigurationStorage = eepromConfig;
+        systemConfiguration = &systemConfigurationStorage;
         DEBUG_PRINTLN(systemConfiguration->toStr());
         return true;
     }
-    LOG_PRINTLN(F(">>WARNING: got invalid configuration info from EEPROM"));
+    LOG_WARN(F("got invalid configuration info from EEPROM"));
     return false;
 }
 
 void saveConfigToEeprom()
 {
     DEBUG_PRINTLN(F("EEPROM: configuration: write"));
-    DEBUG_PRINTLN(systemConfiguration->toStr());
     if (systemConfiguration == nullptr)
         return;
+    DEBUG_PRINTLN(systemConfiguration->toStr());
 
-    writeDataToEeprom<SystemConfiguration>(SYSTEM_CONFIGURATION_EEPROM_ADDR, systemConfiguration);
+    writeDataToEeprom<SystemConfiguration>(systemConfigurationEepromAddress, systemConfiguration);
     DEBUG_PRINTLN(F("Done writing to EEPROM"));
 }
 
 void SystemConfiguration::initDefaultConfiguration()
 {
-    delete systemConfiguration;
-    systemConfiguration = new SystemConfiguration('R');
+    systemConfigurationStorage = SystemConfiguration('R');
+    systemConfiguration = &systemConfigurationStorage;
 }
 
 void invalidateSystemConfigurationOnEeprom()
 {
     DEBUG_PRINTLN(F("EEPROM: system configuration: invalidate"));
-    invalidateEepromData<SystemConfiguration>(SYSTEM_CONFIGURATION_EEPROM_ADDR);
+    invalidateEepromData<SystemConfiguration>(systemConfigurationEepromAddress);
 }
@@ -2,6 +2,8 @@
 #define SENSOR_CONFIG_H
 
 #include "Arduino.h"
+#include "common/eeprom_layout.h"
+#include "common/record_store.h"
 
 // Data Structure Alignment
 #pragma pack(push, 1)
@@ -24,10 +26,22 @@ struct SystemConfiguration
     static void initDefaultConfiguration();
 };
 
+#pragma pack(pop)
+
+// Bump schemaVersion when SystemConfiguration changes, see common/record_store.h
+template <>
+struct RecordTraits<SystemConfiguration> : AppendOnlyMigration<SystemConfiguration>
+{
+    static const uint8_t typeId = 16;
+    static const uint8_t schemaVersion = 1;
+    static const uint16_t capacity = 64;
+};
+
+// Project records, laid out after the common ones
+typedef EepromLayout<CommonEepromLayout::end, SystemConfiguration> ProjectEepromLayout;
+
 bool readConfigFromEeprom();
 void saveConfigToEeprom();
 void invalidateSystemConfigurationOnEeprom();
 
-#pragma pack(pop)
-
 #endif // SENSOR_CONFIG_H
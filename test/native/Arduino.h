@@ -0,0 +1,269 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+/*
+  Host stand-in for the Arduino core, just what the common modules use: the native test
+  suites compile them on the ESP8266 code path (see platformio.ini, [env:native]).
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+typedef unsigned int uint;
+
+class __FlashStringHelper;
+#define F(text) (reinterpret_cast<const __FlashStringHelper *>(text))
+#define PSTR(text) (text)
+#define PROGMEM
+#define PGM_P const char *
+#define IRAM_ATTR
+
+inline size_t strlen_P(const char *text) { return strlen(text); }
+inline void *memcpy_P(void *destination, const void *source, size_t length) { return memcpy(destination, source, length); }
+inline uint8_t pgm_read_byte(const void *address) { return *static_cast<const uint8_t *>(address); }
+
+inline size_t strlcpy(char *destination, const char *source, size_t size)
+{
+    size_t length = strlen(source);
+    if (size > 0)
+    {
+        size_t copied = std::min(length, size - 1);
+        memcpy(destination, source, copied);
+        destination[copied] = '\0';
+    }
+    return length;
+}
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+            write(buffer[i]);
+        return length;
+    }
+};
+
+class String : public std::string
+{
+public:
+    String() {}
+    String(const char *text) : std::string(text != nullptr ? text : "") {}
+    String(const std::string &text) : std::string(text) {}
+    String(const __FlashStringHelper *text) : std::string(reinterpret_cast<const char *>(text)) {}
+    String(char value) : std::string(1, value) {}
+    String(int value) : std::string(std::to_string(value)) {}
+    String(unsigned value) : std::string(std::to_string(value)) {}
+    String(long value) : std::string(std::to_string(value)) {}
+    String(unsigned long value) : std::string(std::to_string(value)) {}
+    String(long long value) : std::string(std::to_string(value)) {}
+    String(unsigned long long value) : std::string(std::to_string(value)) {}
+    String(float value, unsigned char decimals = 2) : String((double)value, decimals) {}
+    String(double value, unsigned char decimals = 2)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.*f", decimals, value);
+        assign(text);
+    }
+
+    bool isEmpty() const { return empty(); }
+    bool reserve(size_t size)
+    {
+        std::string::reserve(size);
+        return true;
+    }
+    bool concat(const char *text, size_t length)
+    {
+        append(text, length);
+        return true;
+    }
+    bool concat(const char *text)
+    {
+        append(text);
+        return true;
+    }
+    bool concat(char value)
+    {
+        push_back(value);
+        return true;
+    }
+    size_t write(uint8_t value)
+    {
+        push_back((char)value);
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t length)
+    {
+        append(reinterpret_cast<const char *>(buffer), length);
+        return length;
+    }
+    bool startsWith(const String &prefix) const { return compare(0, prefix.size(), prefix) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+        return size() >= suffix.size() && compare(size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+    int indexOf(const char *text) const
+    {
+        size_t position = find(text);
+        return position == npos ? -1 : (int)position;
+    }
+    String substring(size_t from) const { return String(substr(std::min(from, size()))); }
+    String substring(size_t from, size_t to) const { return String(substr(std::min(from, size()), to - from)); }
+    long toInt() const { return atol(c_str()); }
+    bool equalsIgnoreCase(const String &other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+    void trim()
+    {
+        size_t begin = find_first_not_of(" \t\r\n");
+        size_t end = find_last_not_of(" \t\r\n");
+        *this = begin == npos ? String() : String(substr(begin, end - begin + 1));
+    }
+
+    String &operator+=(const __FlashStringHelper *text)
+    {
+        append(reinterpret_cast<const char *>(text));
+        return *this;
+    }
+    String &operator+=(const char *text)
+    {
+        append(text);
+        return *this;
+    }
+    String &operator+=(char value)
+    {
+        push_back(value);
+        return *this;
+    }
+    String &operator+=(const String &text)
+    {
+        append(text);
+        return *this;
+    }
+};
+
+inline String operator+(const String &left, const String &right)
+{
+    return String(static_cast<const std::string &>(left) + static_cast<const std::string &>(right));
+}
+inline String operator+(const String &left, const char *right) { return String(static_cast<const std::string &>(left) + right); }
+inline String operator+(const char *left, const String &right) { return String(left + static_cast<const std::string &>(right)); }
+
+class IPAddress
+{
+public:
+    uint32_t address = 0; // network byte order, as on the cores
+
+    IPAddress() {}
+    IPAddress(uint32_t address_) : address(address_) {}
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+    {
+        uint8_t bytes[4] = {first, second, third, fourth};
+        memcpy(&address, bytes, sizeof(address));
+    }
+
+    operator uint32_t() const { return address; }
+    uint8_t operator[](int index) const { return reinterpret_cast<const uint8_t *>(&address)[index]; }
+    bool fromString(const char *text)
+    {
+        unsigned bytes[4];
+        char extra;
+        if (sscanf(text, "%u.%u.%u.%u%c", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &extra) != 4)
+            return false;
+        for (unsigned byte : bytes)
+        {
+            if (byte > 255)
+                return false;
+        }
+        *this = IPAddress(bytes[0], bytes[1], bytes[2], bytes[3]);
+        return true;
+    }
+    String toString() const
+    {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(text);
+    }
+};
+
+inline unsigned long millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline uint64_t micros64() { return micros(); }
+inline void delay(unsigned long duration) { std::this_thread::sleep_for(std::chrono::milliseconds(duration)); }
+inline void yield() {}
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+/**
+ * restart() is recorded, and returns.
+ */
+class EspClass
+{
+public:
+    uint32_t restarts = 0;
+
+    void restart() { restarts++; }
+    uint32_t getFreeHeap() const { return 40000; }
+    uint32_t getMaxFreeBlockSize() const { return 20000; }
+    uint8_t getHeapFragmentation() const { return 0; }
+};
+
+extern EspClass ESP;
+
+/**
+ * Swallows the output, unless capture is set: the tests look at the log sinks they exercise.
+ * room limits what the UART takes, as a full TX FIFO does.
+ */
+class HardwareSerial : public Print
+{
+public:
+    int room = -1; // bytes the UART takes until the test gives it more, -1: unlimited
+    bool capture = false;
+    String output; // what was written, when capture is set
+
+    void begin(unsigned long) {}
+    size_t write(uint8_t value) override { return write(&value, 1); }
+    size_t write(const uint8_t *buffer, size_t length) override
+    {
+        if (room >= 0)
+        {
+            length = std::min<size_t>(length, room);
+            room -= length;
+        }
+        if (capture)
+            output.write(buffer, length);
+        return length;
+    }
+    int availableForWrite() { return room >= 0 ? room : 128; }
+    void flush() {}
+    template <typename T>
+    size_t print(const T &) { return 0; }
+    template <typename T>
+    size_t println(const T &) { return 0; }
+    size_t println() { return 0; }
+};
+
+extern HardwareSerial Serial;
+
+#endif // NATIVE_ARDUINO_H
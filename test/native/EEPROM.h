@@ -0,0 +1,78 @@
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+
+#include <Arduino.h>
+
+#include "power_cut.h"
+
+/**
+ * A RAM mirror of one flash sector. On ESP8266 commit() erases the sector, then programs it
+ * from the first byte to the last. On ESP32 it is one NVS blob, replaced atomically.
+ */
+class EEPROMClass
+{
+public:
+    static const size_t sectorSize = 4096;
+
+    uint8_t sector[sectorSize]; // the flash, survives end() and begin()
+    uint32_t commits = 0;
+
+    EEPROMClass() { memset(sector, 0xFF, sizeof(sector)); }
+
+    bool begin(size_t size_)
+    {
+        size = std::min(size_, (size_t)sectorSize);
+        memcpy(data, sector, size);
+        dirty = false;
+        return true;
+    }
+    void end()
+    {
+        commit();
+        size = 0;
+    }
+    uint8_t *getDataPtr()
+    {
+        dirty = true;
+        return data;
+    }
+    const uint8_t *getConstDataPtr() const { return data; }
+    uint8_t read(int address) const { return data[address]; }
+    void write(int address, uint8_t value)
+    {
+        dirty |= data[address] != value;
+        data[address] = value;
+    }
+    bool commit()
+    {
+        if (size == 0 || !dirty)
+            return true;
+#ifdef ESP32
+        flashOperation();
+        memcpy(sector, data, size);
+#else
+        for (size_t i = 0; i < sectorSize; i++)
+        {
+            flashOperation();
+            sector[i] = 0xFF;
+        }
+        for (size_t i = 0; i < size; i++)
+        {
+            flashOperation();
+            sector[i] = data[i];
+        }
+#endif
+        dirty = false;
+        commits++;
+        return true;
+    }
+
+private:
+    uint8_t data[sectorSize];
+    size_t size = 0;
+    bool dirty = false;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // NATIVE_EEPROM_H
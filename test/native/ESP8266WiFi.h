@@ -0,0 +1,25 @@
+#ifndef NATIVE_ESP8266_WIFI_H
+#define NATIVE_ESP8266_WIFI_H
+
+#include <Arduino.h>
+
+#define WL_IDLE_STATUS 0
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+/**
+ * Connected. Names are resolved by the stand-in of lwIP's resolver, see lwip/dns.h.
+ */
+class ESP8266WiFiClass
+{
+public:
+    int currentStatus = WL_CONNECTED;
+
+    int status() const { return currentStatus; }
+    int32_t RSSI() const { return -60; }
+    IPAddress localIP() const { return IPAddress(192, 168, 1, 2); }
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif // NATIVE_ESP8266_WIFI_H
@@ -0,0 +1,76 @@
+#ifndef NATIVE_ESP_ASYNC_WEB_SERVER_H
+#define NATIVE_ESP_ASYNC_WEB_SERVER_H
+
+#include <Arduino.h>
+
+#include <list>
+#include <memory>
+#include <vector>
+
+/*
+  The part of ESPAsyncWebServer the log modules use: AsyncWebSocket, sending shared
+  buffers to clients by id. A client holds at most WS_MAX_QUEUED_MESSAGES frames, until
+  deliver() "sends" them.
+*/
+
+#ifndef WS_MAX_QUEUED_MESSAGES
+#define WS_MAX_QUEUED_MESSAGES 2
+#endif
+
+using AsyncWebSocketSharedBuffer = std::shared_ptr<std::vector<uint8_t>>;
+
+class AsyncWebSocketClient
+{
+public:
+    uint32_t clientId;
+    std::vector<AsyncWebSocketSharedBuffer> queue;
+    std::vector<std::string> received;
+
+    explicit AsyncWebSocketClient(uint32_t id) : clientId(id) {}
+    uint32_t id() const { return clientId; }
+    bool canSend() const { return queue.size() < WS_MAX_QUEUED_MESSAGES; }
+    void deliver()
+    {
+        for (const AsyncWebSocketSharedBuffer &frame : queue)
+            received.push_back(std::string(frame->begin(), frame->end()));
+        queue.clear();
+    }
+};
+
+class AsyncWebSocket
+{
+public:
+    std::list<AsyncWebSocketClient> clients;
+
+    explicit AsyncWebSocket(const char *) {}
+
+    AsyncWebSocketClient *client(uint32_t id)
+    {
+        for (AsyncWebSocketClient &candidate : clients)
+        {
+            if (candidate.id() == id)
+                return &candidate;
+        }
+        return nullptr;
+    }
+    size_t count() const { return clients.size(); }
+    void cleanupClients(uint16_t = 8) {}
+    bool availableForWrite(uint32_t id)
+    {
+        AsyncWebSocketClient *target = client(id);
+        return target != nullptr && target->canSend();
+    }
+    bool text(uint32_t id, AsyncWebSocketSharedBuffer buffer)
+    {
+        AsyncWebSocketClient *target = client(id);
+        if (target == nullptr || !target->canSend())
+            return false;
+        target->queue.push_back(buffer);
+        return true;
+    }
+};
+
+class AsyncWebServerRequest;
+class AsyncWebServer;
+
+#endif // NATIVE_ESP_ASYNC_WEB_SERVER_H
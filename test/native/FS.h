@@ -0,0 +1,222 @@
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include <Arduino.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "power_cut.h"
+
+/*
+  In-memory LittleFS. As on flash, what a file holds changes atomically: the writes made
+  through a File reach the filesystem when it is flushed or closed (a LittleFS sync), and
+  renames and removals are atomic. Each of these, and each write, is a flash operation
+  that a power cut can interrupt (see power_cut.h).
+*/
+
+class FS;
+
+class File : public Print
+{
+    friend class FS;
+
+private:
+    FS *fs = nullptr;
+    String path;
+    bool directory = false;
+    bool writable = false;
+    bool dirty = false;
+    std::string content; // working copy
+    size_t position = 0;
+    std::vector<String> entries; // of a directory, for openNextFile()
+    size_t nextEntry = 0;
+
+public:
+    explicit operator bool() const { return fs != nullptr; }
+    bool isDirectory() const { return directory; }
+    const char *name() const
+    {
+        size_t slash = path.rfind('/');
+        return slash == std::string::npos ? path.c_str() : path.c_str() + slash + 1;
+    }
+    const char *fullName() const { return path.c_str(); }
+    size_t size() const { return content.size(); }
+    int available() const { return (int)(content.size() - position); }
+    bool seek(size_t offset)
+    {
+        if (offset > content.size())
+            return false;
+        position = offset;
+        return true;
+    }
+    size_t read(uint8_t *buffer, size_t length)
+    {
+        length = std::min(length, content.size() - position);
+        memcpy(buffer, content.data() + position, length);
+        position += length;
+        return length;
+    }
+    int read()
+    {
+        uint8_t value;
+        return read(&value, 1) == 1 ? value : -1;
+    }
+    size_t write(const uint8_t *buffer, size_t length) override
+    {
+        if (!writable)
+            return 0;
+        flashOperation();
+        content.replace(position, std::min(length, content.size() - position), reinterpret_cast<const char *>(buffer), length);
+        position += length;
+        dirty = true;
+        return length;
+    }
+    size_t write(uint8_t value) override { return write(&value, 1); }
+    void flush();
+    void close()
+    {
+        flush();
+        fs = nullptr;
+    }
+    File openNextFile();
+};
+
+/**
+ * As on the ESP8266 core, whose begin() formats a partition that does not mount unless told
+ * not to with setConfig().
+ */
+class FSConfig
+{
+public:
+    bool _autoFormat;
+
+    explicit FSConfig(bool autoFormat = true) : _autoFormat(autoFormat) {}
+};
+
+class FS
+{
+    friend class File;
+
+public:
+    std::map<String, std::string> files;
+    std::set<String> directories;
+    bool mounted = false;
+    bool formatted = true; // begin() fails otherwise, unless asked to format
+    uint32_t syncs = 0;
+    FSConfig config;
+
+private:
+    bool mount(bool formatOnFail)
+    {
+        if (!formatted && formatOnFail)
+            format();
+        mounted = formatted;
+        return mounted;
+    }
+
+public:
+#ifdef ESP32
+    bool begin(bool formatOnFail = false) { return mount(formatOnFail); }
+#elif defined(ESP8266)
+    bool setConfig(const FSConfig &config_)
+    {
+        config = config_;
+        return true;
+    }
+    bool begin() { return mount(config._autoFormat); }
+#endif
+    void end() { mounted = false; }
+    bool format()
+    {
+        files.clear();
+        directories.clear();
+        formatted = true;
+        return true;
+    }
+    bool exists(const String &path) const { return files.count(path) > 0 || directories.count(path) > 0; }
+    bool mkdir(const String &path)
+    {
+        if (!mounted)
+            return false;
+        flashOperation();
+        directories.insert(path);
+        return true;
+    }
+    bool remove(const String &path)
+    {
+        if (!mounted || files.count(path) == 0)
+            return false;
+        flashOperation();
+        files.erase(path);
+        return true;
+    }
+    bool rename(const String &from, const String &to)
+    {
+        if (!mounted || files.count(from) == 0)
+            return false;
+        flashOperation();
+        files[to] = files[from];
+        files.erase(from);
+        return true;
+    }
+    File open(const String &path, const char *mode)
+    {
+        File file;
+        if (!mounted)
+            return file;
+        if (directories.count(path) > 0)
+        {
+            file.fs = this;
+            file.path = path;
+            file.directory = true;
+            String prefix = path + "/";
+            for (const auto &entry : files)
+            {
+                if (entry.first.startsWith(prefix) && entry.first.find('/', prefix.size()) == std::string::npos)
+                    file.entries.push_back(entry.first);
+            }
+            return file;
+        }
+        bool exists = files.count(path) > 0;
+        char kind = mode[0];
+        bool update = strchr(mode, '+') != nullptr;
+        if (kind == 'r' && !exists)
+            return file;
+        file.fs = this;
+        file.path = path;
+        file.writable = kind != 'r' || update;
+        if (kind != 'w')
+            file.content = files[path];
+        if (kind == 'a')
+            file.position = file.content.size();
+        if (kind == 'w' || !exists)
+        {
+            // Created, or truncated, right away
+            flashOperation();
+            files[path] = file.content;
+        }
+        return file;
+    }
+};
+
+inline void File::flush()
+{
+    if (fs == nullptr || !dirty)
+        return;
+    flashOperation();
+    fs->files[path] = content;
+    fs->syncs++;
+    dirty = false;
+}
+
+inline File File::openNextFile()
+{
+    if (fs == nullptr || nextEntry >= entries.size())
+        return File();
+    return fs->open(entries[nextEntry++], "r");
+}
+
+#endif // NATIVE_FS_H
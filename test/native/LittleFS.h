@@ -0,0 +1,16 @@
+#ifndef NATIVE_LITTLEFS_H
+#define NATIVE_LITTLEFS_H
+
+#include <FS.h>
+
+#ifdef ESP8266
+class LittleFSConfig : public FSConfig
+{
+public:
+    explicit LittleFSConfig(bool autoFormat = true) : FSConfig(autoFormat) {}
+};
+#endif
+
+extern FS LittleFS;
+
+#endif // NATIVE_LITTLEFS_H
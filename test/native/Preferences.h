@@ -0,0 +1,61 @@
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+
+#include <Arduino.h>
+
+#include <map>
+#include <vector>
+
+#include "power_cut.h"
+
+/**
+ * ESP32 NVS: a put of one key is atomic, the previous value is kept if it is interrupted.
+ * The keys of every namespace live in nvsKeys, which survives end() and begin().
+ */
+class Preferences
+{
+private:
+    String space;
+
+public:
+    static std::map<String, std::vector<uint8_t>> nvsKeys; // "namespace/key"
+    static uint32_t puts;
+
+    bool begin(const char *name, bool readOnly = false)
+    {
+        (void)readOnly;
+        space = String(name) + "/";
+        return true;
+    }
+    void end() {}
+    bool isKey(const char *key) const { return nvsKeys.count(space + key) > 0; }
+    size_t getBytesLength(const char *key) const
+    {
+        auto entry = nvsKeys.find(space + key);
+        return entry == nvsKeys.end() ? 0 : entry->second.size();
+    }
+    // As NVS: nothing is read if the value does not fit
+    size_t getBytes(const char *key, void *buffer, size_t maxLength) const
+    {
+        auto entry = nvsKeys.find(space + key);
+        if (entry == nvsKeys.end() || entry->second.size() > maxLength)
+            return 0;
+        memcpy(buffer, entry->second.data(), entry->second.size());
+        return entry->second.size();
+    }
+    size_t putBytes(const char *key, const void *value, size_t length)
+    {
+        flashOperation();
+        const uint8_t *bytes = static_cast<const uint8_t *>(value);
+        nvsKeys[space + key] = std::vector<uint8_t>(bytes, bytes + length);
+        puts++;
+        return length;
+    }
+    bool remove(const char *key)
+    {
+        flashOperation();
+        return nvsKeys.erase(space + key) > 0;
+    }
+};
+
+#endif // NATIVE_PREFERENCES_H
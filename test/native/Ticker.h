@@ -0,0 +1,18 @@
+#ifndef NATIVE_TICKER_H
+#define NATIVE_TICKER_H
+
+#include <functional>
+
+/**
+ * Never fires: the tests run the callbacks they need themselves.
+ */
+class Ticker
+{
+public:
+    std::function<void()> callback;
+
+    void once(float, std::function<void()> callback_) { callback = callback_; }
+    void detach() { callback = nullptr; }
+};
+
+#endif // NATIVE_TICKER_H
@@ -0,0 +1,7 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+// The ESP32 core's name for it: the same stand-in on both cores
+#include <ESP8266WiFi.h>
+
+#endif // NATIVE_WIFI_H
@@ -0,0 +1,51 @@
+#ifndef NATIVE_WIFI_UDP_H
+#define NATIVE_WIFI_UDP_H
+
+#include <ESP8266WiFi.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+/**
+ * Sends the datagrams with a host UDP socket.
+ */
+class WiFiUDP
+{
+private:
+    int socketFd = -1;
+    sockaddr_in target = sockaddr_in();
+    std::vector<uint8_t> packet;
+
+public:
+    ~WiFiUDP()
+    {
+        if (socketFd >= 0)
+            close(socketFd);
+    }
+    int beginPacket(IPAddress ip, uint16_t port)
+    {
+        if (socketFd < 0)
+            socketFd = socket(AF_INET, SOCK_DGRAM, 0);
+        target = sockaddr_in();
+        target.sin_family = AF_INET;
+        target.sin_port = htons(port);
+        target.sin_addr.s_addr = ip;
+        packet.clear();
+        return socketFd >= 0;
+    }
+    size_t write(const uint8_t *data, size_t length)
+    {
+        packet.insert(packet.end(), data, data + length);
+        return length;
+    }
+    int endPacket()
+    {
+        ssize_t sent = sendto(socketFd, packet.data(), packet.size(), 0, reinterpret_cast<sockaddr *>(&target), sizeof(target));
+        return sent == (ssize_t)packet.size();
+    }
+};
+
+#endif // NATIVE_WIFI_UDP_H
@@ -0,0 +1,76 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+/*
+  Counts the heap allocations of the process, and their bytes, while countingAllocations is
+  set: on glibc every malloc(), calloc() and realloc(), which operator new goes through too,
+  elsewhere operator new only. Included by the suites that check what a path allocates.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <new>
+
+static bool countingAllocations = false;
+static uint32_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+static void countAllocation(size_t size)
+{
+    if (countingAllocations)
+    {
+        allocations++;
+        allocatedBytes += size;
+    }
+}
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    countAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+#endif
+
+static void *allocate(size_t size)
+{
+#ifndef __GLIBC__
+    countAllocation(size);
+#endif
+    return malloc(size);
+}
+
+void *operator new(size_t size)
+{
+    void *pointer = allocate(size);
+    if (pointer == nullptr)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void operator delete(void *pointer) noexcept { free(pointer); }
+void operator delete[](void *pointer) noexcept { free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { free(pointer); }
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef NATIVE_COREDECLS_H
+#define NATIVE_COREDECLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The ESP8266 core's table-less CRC32 (MSB first, not reflected).
+ */
+inline uint32_t crc32(const void *data, size_t length, uint32_t crc = 0xffffffff)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    while (length--)
+    {
+        uint8_t byte = *bytes++;
+        for (uint32_t mask = 0x80; mask > 0; mask >>= 1)
+        {
+            bool bit = crc & 0x80000000;
+            if (byte & mask)
+                bit = !bit;
+            crc <<= 1;
+            if (bit)
+                crc ^= 0x04c11db7;
+        }
+    }
+    return crc;
+}
+
+#endif // NATIVE_COREDECLS_H
@@ -0,0 +1,19 @@
+#ifndef NATIVE_ESP32_ROM_CRC_H
+#define NATIVE_ESP32_ROM_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+inline uint32_t crc32_le(uint32_t crc, const uint8_t *data, size_t length)
+{
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+#endif // NATIVE_ESP32_ROM_CRC_H
@@ -0,0 +1,101 @@
+#ifndef NATIVE_ESP_PARTITION_H
+#define NATIVE_ESP_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "power_cut.h"
+
+/*
+  One data partition, NATIVE_PARTITION_SIZE bytes of NOR flash: erasing sets bytes to 0xFF,
+  programming can only clear bits. Each byte erased or programmed is a flash operation.
+*/
+
+#ifndef NATIVE_PARTITION_SIZE
+#define NATIVE_PARTITION_SIZE (4 * 4096)
+#endif
+
+#define SPI_FLASH_SEC_SIZE 4096
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef int esp_err_t;
+typedef uint32_t spi_flash_mmap_handle_t;
+typedef int esp_partition_subtype_t;
+
+enum esp_partition_type_t
+{
+    ESP_PARTITION_TYPE_APP = 0,
+    ESP_PARTITION_TYPE_DATA = 1
+};
+
+enum spi_flash_mmap_memory_t
+{
+    SPI_FLASH_MMAP_DATA
+};
+
+struct esp_partition_t
+{
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+};
+
+extern uint8_t partitionFlash[NATIVE_PARTITION_SIZE];
+extern bool partitionPresent; // false: a stock partition table, without it
+
+inline const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    static esp_partition_t partition = {ESP_PARTITION_TYPE_DATA, 0, 0, NATIVE_PARTITION_SIZE, ""};
+    if (!partitionPresent)
+        return nullptr;
+    partition.type = type;
+    partition.subtype = subtype;
+    strncpy(partition.label, label != nullptr ? label : "", sizeof(partition.label) - 1);
+    return &partition;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t *, size_t offset, void *destination, size_t length)
+{
+    memcpy(destination, partitionFlash + offset, length);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_mmap(const esp_partition_t *, size_t offset, size_t, spi_flash_mmap_memory_t,
+                                    const void **pointer, spi_flash_mmap_handle_t *handle)
+{
+    *pointer = partitionFlash + offset;
+    *handle = 1;
+    return ESP_OK;
+}
+
+inline void spi_flash_munmap(spi_flash_mmap_handle_t) {}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t *, size_t offset, size_t length)
+{
+    if (offset % SPI_FLASH_SEC_SIZE != 0 || length % SPI_FLASH_SEC_SIZE != 0 || offset + length > NATIVE_PARTITION_SIZE)
+        return ESP_FAIL;
+    for (size_t i = 0; i < length; i++)
+    {
+        flashOperation();
+        partitionFlash[offset + i] = 0xFF;
+    }
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t *, size_t offset, const void *source, size_t length)
+{
+    if (offset + length > NATIVE_PARTITION_SIZE)
+        return ESP_FAIL;
+    for (size_t i = 0; i < length; i++)
+    {
+        flashOperation();
+        partitionFlash[offset + i] &= static_cast<const uint8_t *>(source)[i];
+    }
+    return ESP_OK;
+}
+
+#endif // NATIVE_ESP_PARTITION_H
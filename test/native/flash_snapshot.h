@@ -0,0 +1,174 @@
+#ifndef NATIVE_FLASH_SNAPSHOT_H
+#define NATIVE_FLASH_SNAPSHOT_H
+
+#include <unity.h>
+
+#include <EEPROM.h>
+#include <LittleFS.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "common/storage_backend.h"
+#include "power_cut.h"
+
+#ifdef ESP32
+#include <Preferences.h>
+#include <esp_partition.h>
+#endif
+
+/**
+ * What the stand-ins keep in flash: taken before a commit, restored before each cut point.
+ */
+struct FlashSnapshot
+{
+    uint8_t eepromSector[EEPROMClass::sectorSize];
+    std::map<String, std::string> files;
+    std::set<String> directories;
+#ifdef ESP32
+    std::vector<uint8_t> partition;
+    std::map<String, std::vector<uint8_t>> nvsKeys;
+#endif
+
+    void take()
+    {
+        memcpy(eepromSector, EEPROM.sector, sizeof(eepromSector));
+        files = LittleFS.files;
+        directories = LittleFS.directories;
+#ifdef ESP32
+        partition.assign(partitionFlash, partitionFlash + sizeof(partitionFlash));
+        nvsKeys = Preferences::nvsKeys;
+#endif
+    }
+
+    void restore() const
+    {
+        memcpy(EEPROM.sector, eepromSector, sizeof(eepromSector));
+        LittleFS.files = files;
+        LittleFS.directories = directories;
+#ifdef ESP32
+        memcpy(partitionFlash, partition.data(), partition.size());
+        Preferences::nvsKeys = nvsKeys;
+#endif
+    }
+};
+
+typedef std::function<std::unique_ptr<StorageBackend>()> BackendFactory;
+typedef std::vector<uint8_t> StorageImage;
+
+/**
+ * A freshly started backend, as after a reboot.
+ */
+inline std::unique_ptr<StorageBackend> startBackend(const BackendFactory &makeBackend, size_t size)
+{
+    std::unique_ptr<StorageBackend> backend = makeBackend();
+    TEST_ASSERT_TRUE_MESSAGE(backend->begin(size), "the backend does not start");
+    return backend;
+}
+
+/**
+ * Commits image over the current content, as eepromSession does: only the range that differs
+ * is written and committed. Power is cut after budget flash operations, -1: never.
+ */
+inline void commitImage(const BackendFactory &makeBackend, const StorageImage &image, long budget)
+{
+    std::unique_ptr<StorageBackend> backend = startBackend(makeBackend, image.size());
+    const uint8_t *current = backend->readData();
+    size_t from = 0;
+    size_t to = image.size();
+    while (from < to && current[from] == image[from])
+        from++;
+    while (to > from && current[to - 1] == image[to - 1])
+        to--;
+    if (from == to)
+        return;
+    memcpy(backend->writeData() + from, image.data() + from, to - from);
+
+    powerCutBudget = budget;
+    try
+    {
+        backend->commit(from, to);
+    }
+    catch (const PowerCut &)
+    {
+    }
+    powerCutBudget = -1;
+}
+
+inline bool readsAs(StorageBackend &backend, const StorageImage &image)
+{
+    return memcmp(backend.readData(), image.data(), image.size()) == 0;
+}
+
+/**
+ * Commits next over current, cutting the power after every number of flash operations the
+ * commit performs. After each cut, a restarted backend must read either current or next,
+ * and commit a further image correctly. Returns the number of cut points tried.
+ */
+inline uint32_t checkCommitSurvivesPowerCuts(const BackendFactory &makeBackend, const StorageImage &current,
+                                             const StorageImage &next, const StorageImage &further)
+{
+    FlashSnapshot before;
+    before.take();
+    uint32_t operationsBefore = flashOperations;
+    commitImage(makeBackend, next, -1);
+    uint32_t operations = flashOperations - operationsBefore;
+
+    uint32_t cuts = 0;
+    for (uint32_t cut = 0; cut <= operations; cut++, cuts++)
+    {
+        before.restore();
+        commitImage(makeBackend, next, cut);
+
+        {
+            std::unique_ptr<StorageBackend> restarted = startBackend(makeBackend, current.size());
+            bool isNext = readsAs(*restarted, next);
+            if (cut == operations)
+                TEST_ASSERT_TRUE_MESSAGE(isNext, "a complete commit is not read back");
+            TEST_ASSERT_TRUE_MESSAGE(isNext || readsAs(*restarted, current), "a power cut tore the image");
+        }
+
+        commitImage(makeBackend, further, -1);
+        std::unique_ptr<StorageBackend> restarted = startBackend(makeBackend, current.size());
+        TEST_ASSERT_TRUE_MESSAGE(readsAs(*restarted, further), "the commit after a power cut is not read back");
+    }
+
+    // Leaves the flash with next committed
+    before.restore();
+    commitImage(makeBackend, next, -1);
+    return cuts;
+}
+
+/**
+ * Images that change a few bytes, a record across two NVS pages, or the whole storage.
+ */
+inline std::vector<StorageImage> storageImages(size_t size)
+{
+    std::vector<StorageImage> images;
+    StorageImage image(size, 0xFF);
+    for (uint8_t step = 0; step < 8; step++)
+    {
+        switch (step % 4)
+        {
+        case 0:
+            image[step * 7] = step;
+            break;
+        case 1:
+            for (size_t i = 60; i < 70; i++) // across a 64 bytes page boundary
+                image[i] = step + i;
+            break;
+        case 2:
+            for (size_t i = 0; i < size; i++)
+                image[i] = step * 31 + i;
+            break;
+        case 3:
+            image[size - 1] = step;
+            break;
+        }
+        images.push_back(image);
+    }
+    return images;
+}
+
+#endif // NATIVE_FLASH_SNAPSHOT_H
@@ -0,0 +1,10 @@
+#ifndef NATIVE_FREERTOS_H
+#define NATIVE_FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define pdTRUE 1
+
+#endif // NATIVE_FREERTOS_H
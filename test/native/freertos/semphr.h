@@ -0,0 +1,26 @@
+#ifndef NATIVE_FREERTOS_SEMPHR_H
+#define NATIVE_FREERTOS_SEMPHR_H
+
+#include <freertos/FreeRTOS.h>
+
+#include <mutex>
+
+/*
+  Recursive mutexes, what SharedStateLock uses, over std::recursive_mutex. Never freed.
+*/
+
+typedef std::recursive_mutex *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return new std::recursive_mutex(); }
+inline int xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t)
+{
+    mutex->lock();
+    return pdTRUE;
+}
+inline int xSemaphoreGiveRecursive(SemaphoreHandle_t mutex)
+{
+    mutex->unlock();
+    return pdTRUE;
+}
+
+#endif // NATIVE_FREERTOS_SEMPHR_H
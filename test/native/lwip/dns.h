@@ -0,0 +1,94 @@
+#ifndef NATIVE_LWIP_DNS_H
+#define NATIVE_LWIP_DNS_H
+
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+
+/*
+  Host stand-in for lwIP's resolver: names are looked up in NativeDns::names, either at once,
+  as from lwIP's cache, or when the test calls complete(), as from a DNS server.
+*/
+
+typedef int8_t err_t;
+#define ERR_OK 0
+#define ERR_INPROGRESS -5
+#define ERR_ARG -16
+
+#define IPADDR_TYPE_V4 0
+#define IPADDR_TYPE_V6 6
+
+struct ip4_addr_t
+{
+    uint32_t addr; // network byte order
+};
+
+struct ip_addr_t
+{
+    union
+    {
+        ip4_addr_t ip4;
+    } u_addr;
+    uint8_t type;
+};
+
+#define IP_IS_V4(ipaddr) ((ipaddr)->type == IPADDR_TYPE_V4)
+#define ip_2_ip4(ipaddr) (&((ipaddr)->u_addr.ip4))
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+
+struct NativeDns
+{
+    std::map<std::string, uint32_t> names; // address in network byte order
+    bool cached = true;                      // answered at once, else by complete()
+    uint32_t lookups = 0;
+
+    struct Lookup
+    {
+        std::string name;
+        dns_found_callback callback;
+        void *argument;
+    };
+    std::deque<Lookup> pending;
+
+    bool find(const std::string &name, ip_addr_t &address) const
+    {
+        std::map<std::string, uint32_t>::const_iterator found = names.find(name);
+        if (found == names.end())
+            return false;
+        address.u_addr.ip4.addr = found->second;
+        address.type = IPADDR_TYPE_V4;
+        return true;
+    }
+
+    /**
+     * Answers the oldest pending lookup, as lwIP does from its own task. false if there is none.
+     */
+    bool complete()
+    {
+        if (pending.empty())
+            return false;
+        Lookup lookup = pending.front();
+        pending.pop_front();
+        ip_addr_t address;
+        bool found = find(lookup.name, address);
+        lookup.callback(lookup.name.c_str(), found ? &address : nullptr, lookup.argument);
+        return true;
+    }
+};
+
+extern NativeDns nativeDns;
+
+inline err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg)
+{
+    nativeDns.lookups++;
+    if (nativeDns.cached)
+        return nativeDns.find(hostname, *addr) ? ERR_OK : ERR_ARG;
+    NativeDns::Lookup lookup = {hostname, found, callback_arg};
+    nativeDns.pending.push_back(lookup);
+    return ERR_INPROGRESS;
+}
+
+#endif // NATIVE_LWIP_DNS_H
@@ -0,0 +1,45 @@
+#ifndef NATIVE_GLOBALS_H
+#define NATIVE_GLOBALS_H
+
+/*
+  Defines the globals of the stand-ins, and those globals.h declares that the firmware
+  defines outside of common_config.cpp. Included once per suite, by native_modules.h, after
+  the modules.
+*/
+
+#include <EEPROM.h>
+#include <ESP8266WiFi.h>
+#include <ESPAsyncWebServer.h>
+#include <LittleFS.h>
+#include <lwip/dns.h>
+
+#include "common/common_config.cpp"
+#include "common/globals.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+EEPROMClass EEPROM;
+FS LittleFS;
+ESP8266WiFiClass WiFi;
+NativeDns nativeDns;
+long powerCutBudget = -1;
+uint32_t flashOperations = 0;
+
+#ifdef ESP32
+#include <Preferences.h>
+#include <esp_partition.h>
+
+std::map<String, std::vector<uint8_t>> Preferences::nvsKeys;
+uint32_t Preferences::puts = 0;
+uint8_t partitionFlash[NATIVE_PARTITION_SIZE];
+bool partitionPresent = true;
+#endif
+
+const char *GITHUB_TOKEN = "";
+AsyncWebSocket wsLogs("/wsLogs");
+DeviceConfiguration *currentDeviceConfiguration = nullptr;
+std::atomic<bool> configMode(false);
+std::atomic<bool> bootLoopMode(false);
+uint8_t quickRestartsCount = 0;
+
+#endif // NATIVE_GLOBALS_H
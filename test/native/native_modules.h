@@ -0,0 +1,43 @@
+#ifndef NATIVE_MODULES_H
+#define NATIVE_MODULES_H
+
+/*
+  Compiles the common modules into the suite, then the globals of the stand-ins
+  (native_globals.h). Included once per suite, by its test file, after the defines that
+  pick the platform (ESP32, else ESP8266) and the build flags under test.
+*/
+
+// Each picks its module, and leaves it defined
+#include "common/counter_store.cpp"
+#undef LOG_MODULE
+#include "common/eeprom_session.cpp"
+#undef LOG_MODULE
+#include "common/log.cpp"
+#undef LOG_MODULE
+#include "common/log_file.cpp"
+#undef LOG_MODULE
+#include "common/log_format.cpp"
+#undef LOG_MODULE
+#include "common/log_history.cpp"
+#undef LOG_MODULE
+#include "common/log_lz.cpp"
+#undef LOG_MODULE
+#include "common/log_ring.cpp"
+#undef LOG_MODULE
+#include "common/log_syslog.cpp"
+#undef LOG_MODULE
+#include "common/log_websocket.cpp"
+#undef LOG_MODULE
+#include "common/storage_backend.cpp"
+#undef LOG_MODULE
+
+// As log.h does for the files that pick no module
+#define LOG_MODULE LOG_MODULE_PROJECT
+#include "common/record_store.cpp"
+#include "common/scheduler.cpp"
+#include "common/shared_state.cpp"
+#include "common/utils.cpp"
+
+#include "native_globals.h"
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef NATIVE_POWER_CUT_H
+#define NATIVE_POWER_CUT_H
+
+#include <stdint.h>
+
+/*
+  Power cuts, for the simulated flash of the stand-ins (EEPROM, Preferences, esp_partition,
+  LittleFS): every flash operation consumes one unit of powerCutBudget, and the one found
+  at 0 throws PowerCut instead, leaving the flash as it was at that point.
+*/
+
+struct PowerCut
+{
+};
+
+extern long powerCutBudget;      // flash operations left before the power is cut, -1: never
+extern uint32_t flashOperations; // performed so far
+
+inline void flashOperation()
+{
+    if (powerCutBudget == 0)
+        throw PowerCut();
+    if (powerCutBudget > 0)
+        powerCutBudget--;
+    flashOperations++;
+}
+
+#endif // NATIVE_POWER_CUT_H
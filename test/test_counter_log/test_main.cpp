@@ -0,0 +1,233 @@
+/*
+  The counter log on ESP32 with the partition backend: increments are programmed into the
+  last sectors of the config partition, without erase nor storage commit, must survive a
+  power cut at any flash operation, and must leave the storage journal alone.
+*/
+
+#define ESP32
+#define STORAGE_BACKEND STORAGE_BACKEND_PARTITION
+
+#include <unity.h>
+
+#include "native_modules.h"
+
+#include <vector>
+
+#include "common/eeprom_layout.h"
+
+const int address = CommonEepromLayout::address<CounterSnapshot>();
+const size_t journalSize = NATIVE_PARTITION_SIZE - PartitionStorageBackend::counterLogSectors * SPI_FLASH_SEC_SIZE;
+
+void setUp()
+{
+    memset(partitionFlash, 0xFF, sizeof(partitionFlash));
+    partitionPresent = true;
+    eepromSession.begin();
+}
+
+void tearDown()
+{
+    powerCutBudget = -1;
+}
+
+uint32_t reloaded(uint8_t counterId)
+{
+    CounterStore store;
+    store.begin(address);
+    return store.get(counterId);
+}
+
+void test_increments_survive_a_restart_without_storage_commits()
+{
+    CounterStore store;
+    store.begin(address);
+    std::vector<uint8_t> journal(partitionFlash, partitionFlash + journalSize);
+    for (int i = 0; i < 10; i++)
+        store.add(COUNTER_WIFI_RECONNECTS);
+    store.add(COUNTER_PROJECT_FIRST, 500);
+
+    TEST_ASSERT_EQUAL_UINT32(10, reloaded(COUNTER_WIFI_RECONNECTS));
+    TEST_ASSERT_EQUAL_UINT32(500, reloaded(COUNTER_PROJECT_FIRST));
+    TEST_ASSERT_FALSE(eepromSession.isDirty());
+    TEST_ASSERT_EQUAL_MEMORY(journal.data(), partitionFlash, journalSize);
+}
+
+void test_a_full_sector_rotates_to_the_other_one()
+{
+    CounterStore store;
+    store.begin(address);
+    uint32_t increments = 2 * PartitionCounterLog::sectorEntries + 5;
+    uint32_t operations = flashOperations;
+    for (uint32_t i = 0; i < increments; i++)
+        store.add(COUNTER_UPTIME_HOURS);
+
+    TEST_ASSERT_EQUAL_UINT32(increments, reloaded(COUNTER_UPTIME_HOURS));
+    // Two sectors erased, each about a thousand increments: a few bytes per increment
+    TEST_ASSERT_LESS_OR_EQUAL(increments * sizeof(CounterLogEntry) + 3 * SPI_FLASH_SEC_SIZE, flashOperations - operations);
+}
+
+/**
+ * Cuts the power at every flash operation of one increment, from the current flash: the
+ * counter must read as before or after it, and the log must still take increments.
+ */
+uint32_t checkIncrementSurvivesPowerCuts(uint32_t before)
+{
+    std::vector<uint8_t> flash(partitionFlash, partitionFlash + NATIVE_PARTITION_SIZE);
+    uint32_t cuts = 0;
+    for (long budget = 0;; budget++)
+    {
+        memcpy(partitionFlash, flash.data(), flash.size());
+        CounterStore store;
+        store.begin(address);
+        TEST_ASSERT_EQUAL_UINT32(before, store.get(COUNTER_PROJECT_FIRST));
+        powerCutBudget = budget;
+        bool cut = false;
+        try
+        {
+            store.add(COUNTER_PROJECT_FIRST);
+        }
+        catch (const PowerCut &)
+        {
+            cut = true;
+        }
+        powerCutBudget = -1;
+
+        uint32_t after = reloaded(COUNTER_PROJECT_FIRST);
+        if (!cut)
+        {
+            TEST_ASSERT_EQUAL_UINT32(before + 1, after);
+            return cuts;
+        }
+        cuts++;
+        TEST_ASSERT_TRUE(after == before || after == before + 1);
+
+        // Another delta, which programmed over the torn entry would not read back
+        CounterStore restarted;
+        restarted.begin(address);
+        restarted.add(COUNTER_PROJECT_FIRST, 2);
+        TEST_ASSERT_EQUAL_UINT32(after + 2, reloaded(COUNTER_PROJECT_FIRST));
+    }
+}
+
+void test_increments_survive_power_cuts()
+{
+    CounterStore store;
+    store.begin(address);
+    store.add(COUNTER_PROJECT_FIRST, 7);
+    TEST_ASSERT_GREATER_THAN(0, checkIncrementSurvivesPowerCuts(7));
+}
+
+void test_rotations_survive_power_cuts()
+{
+    CounterStore store;
+    store.begin(address);
+    for (uint16_t i = 0; i < PartitionCounterLog::sectorEntries; i++)
+        store.add(COUNTER_PROJECT_FIRST);
+    // The next increment erases and starts the other sector
+    TEST_ASSERT_GREATER_THAN(SPI_FLASH_SEC_SIZE, checkIncrementSurvivesPowerCuts(PartitionCounterLog::sectorEntries));
+}
+
+void test_the_record_is_carried_over_once()
+{
+    CounterSnapshot snapshot;
+    snapshot.values[COUNTER_OTA_ATTEMPTS] = 12;
+    writeDataToEeprom<CounterSnapshot>(address, &snapshot);
+
+    CounterStore store;
+    store.begin(address);
+    TEST_ASSERT_EQUAL_UINT32(12, store.get(COUNTER_OTA_ATTEMPTS));
+    store.add(COUNTER_OTA_ATTEMPTS, 1, EEPROM_COMMIT_NOW);
+
+    // The record is not read, nor written, any more
+    snapshot.values[COUNTER_OTA_ATTEMPTS] = 40;
+    writeDataToEeprom<CounterSnapshot>(address, &snapshot);
+    TEST_ASSERT_EQUAL_UINT32(13, reloaded(COUNTER_OTA_ATTEMPTS));
+}
+
+void test_the_journal_and_the_counter_log_share_the_partition()
+{
+    CounterStore store;
+    store.begin(address);
+    uint8_t journalSectors = journalSize / SPI_FLASH_SEC_SIZE;
+    for (uint8_t value = 1; value <= 2 * journalSectors; value++)
+    {
+        eepromSession.put(0, value);
+        store.add(COUNTER_PROJECT_FIRST, value);
+    }
+
+    PartitionStorageBackend backend("config");
+    TEST_ASSERT_TRUE(backend.begin(EEPROM_SIZE + STORAGE_SCRATCH_SIZE));
+    TEST_ASSERT_EQUAL_UINT8(2 * journalSectors, backend.readData()[0]);
+    TEST_ASSERT_EQUAL_UINT32(journalSectors * (2 * journalSectors + 1), reloaded(COUNTER_PROJECT_FIRST));
+}
+
+void test_a_storage_image_in_the_counter_sectors_is_moved_to_the_journal()
+{
+    // Earlier firmware had its journal over the whole partition
+    const size_t size = EEPROM_SIZE + STORAGE_SCRATCH_SIZE;
+    std::vector<uint8_t> image(size, 0x42);
+    StorageSectorHeader header;
+    header.magic = storageSectorMagic;
+    header.generation = 9;
+    header.crc = storageImageCrc(header.generation, image.data(), size);
+    header.reserved = 0xFFFFFFFF;
+    uint8_t *lastSector = partitionFlash + NATIVE_PARTITION_SIZE - SPI_FLASH_SEC_SIZE;
+    memcpy(lastSector, &header, sizeof(header));
+    memcpy(lastSector + sizeof(header), image.data(), size);
+
+    PartitionStorageBackend backend("config");
+    TEST_ASSERT_TRUE(backend.begin(size));
+    TEST_ASSERT_EQUAL_UINT32(10, backend.getGeneration());
+    backend.end();
+
+    CounterStore store;
+    store.begin(address);
+    store.add(COUNTER_PROJECT_FIRST);
+    TEST_ASSERT_TRUE(backend.begin(size));
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), backend.readData(), size);
+    TEST_ASSERT_EQUAL_UINT32(1, reloaded(COUNTER_PROJECT_FIRST));
+}
+
+void test_without_the_partition_increments_are_committed_together()
+{
+    partitionPresent = false;
+    CounterStore store;
+    store.begin(address);
+    eepromSession.commit();
+    for (int i = 0; i < 3; i++)
+        store.add(COUNTER_WIFI_RECONNECTS);
+    TEST_ASSERT_TRUE(eepromSession.isDirty());
+
+    TaskId commitTask = INVALID_TASK_ID;
+    for (TaskId id = 0; id < SCHEDULER_MAX_TASKS; id++)
+    {
+        const ScheduledTask *task = scheduler.getTask(id);
+        if (task != nullptr && task->active && strcmp(task->name, "counterCommit") == 0)
+        {
+            TEST_ASSERT_EQUAL(INVALID_TASK_ID, commitTask); // one commit for the three
+            commitTask = id;
+        }
+    }
+    TEST_ASSERT_NOT_EQUAL(INVALID_TASK_ID, commitTask);
+    const ScheduledTask *task = scheduler.getTask(commitTask);
+    TEST_ASSERT_GREATER_THAN(counterCommitDelayMillis - 1000, task->nextRunMillis - monotonicMillis());
+
+    task->callback();
+    scheduler.cancel(commitTask);
+    TEST_ASSERT_FALSE(eepromSession.isDirty());
+    TEST_ASSERT_EQUAL_UINT32(3, reloaded(COUNTER_WIFI_RECONNECTS));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_increments_survive_a_restart_without_storage_commits);
+    RUN_TEST(test_a_full_sector_rotates_to_the_other_one);
+    RUN_TEST(test_increments_survive_power_cuts);
+    RUN_TEST(test_rotations_survive_power_cuts);
+    RUN_TEST(test_the_record_is_carried_over_once);
+    RUN_TEST(test_the_journal_and_the_counter_log_share_the_partition);
+    RUN_TEST(test_a_storage_image_in_the_counter_sectors_is_moved_to_the_journal);
+    RUN_TEST(test_without_the_partition_increments_are_committed_together);
+    return UNITY_END();
+}
@@ -0,0 +1,97 @@
+/*
+  drainLogs() (log_ring.cpp) with a full UART: a line the UART does not take is left in the
+  ring for the next drain, but it reaches the other outputs (WebSocket, history) only once.
+*/
+
+#define ESP8266
+
+#include <unity.h>
+
+#include "native_modules.h"
+
+const uint32_t clientId = 1;
+
+size_t occurrences(const std::string &text, const char *line)
+{
+    size_t count = 0;
+    for (size_t position = text.find(line); position != std::string::npos; position = text.find(line, position + 1))
+        count++;
+    return count;
+}
+
+/**
+ * What the WebSocket client got of line, once its frames are sent.
+ */
+size_t sentToWebsocket(const char *line)
+{
+    flushLogWebsocket();
+    AsyncWebSocketClient *client = wsLogs.client(clientId);
+    client->deliver();
+    size_t count = 0;
+    for (const std::string &frame : client->received)
+        count += occurrences(frame, line);
+    return count;
+}
+
+void setUp()
+{
+    wsLogs.clients.emplace_back(clientId);
+    TEST_ASSERT_TRUE(addLogWebsocketClient(clientId));
+    Serial.room = -1;
+    drainLogs();
+    Serial.output = "";
+    Serial.capture = true;
+}
+
+void tearDown()
+{
+    Serial.room = -1;
+    Serial.capture = false;
+    removeLogWebsocketClient(clientId);
+    wsLogs.clients.clear();
+}
+
+void test_a_line_the_uart_does_not_take_is_sent_to_the_other_outputs_once()
+{
+    Serial.room = 0;
+    LOG_PRINTLN("hello from a full uart");
+    for (int drain = 0; drain < 6; drain++)
+        drainLogs();
+
+    TEST_ASSERT_EQUAL(1, sentToWebsocket("hello from a full uart"));
+    TEST_ASSERT_EQUAL(1, occurrences(logHistory.toText(), "hello from a full uart"));
+    TEST_ASSERT_TRUE(logRing.used() > 0);
+    TEST_ASSERT_TRUE(Serial.output.empty());
+
+    Serial.room = -1;
+    drainLogs();
+    TEST_ASSERT_EQUAL(0, logRing.used());
+    TEST_ASSERT_EQUAL(1, occurrences(Serial.output, "hello from a full uart\n"));
+    TEST_ASSERT_EQUAL(1, sentToWebsocket("hello from a full uart"));
+}
+
+void test_a_line_the_uart_takes_in_pieces_reaches_it_whole()
+{
+    LOG_PRINTLN("first line, in pieces");
+    LOG_PRINTLN("second line, in pieces");
+    for (int drain = 0; drain < 100 && logRing.used() > 0; drain++)
+    {
+        Serial.room = 3;
+        drainLogs();
+    }
+
+    TEST_ASSERT_EQUAL(0, logRing.used());
+    TEST_ASSERT_EQUAL(1, occurrences(Serial.output, "first line, in pieces\n"));
+    TEST_ASSERT_EQUAL(1, occurrences(Serial.output, "second line, in pieces\n"));
+    TEST_ASSERT_EQUAL(1, sentToWebsocket("first line, in pieces"));
+    TEST_ASSERT_EQUAL(1, sentToWebsocket("second line, in pieces"));
+    TEST_ASSERT_EQUAL(1, occurrences(logHistory.toText(), "second line, in pieces"));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_a_line_the_uart_does_not_take_is_sent_to_the_other_outputs_once);
+    RUN_TEST(test_a_line_the_uart_takes_in_pieces_reaches_it_whole);
+    return UNITY_END();
+}
@@ -0,0 +1,325 @@
+/*
+  Log shipping (log_syslog.cpp) against a UDP listener on the loopback interface: every line
+  queued reaches it, or is counted as dropped, one RFC 5424 message per datagram or framed
+  lines batched, and the collector's host name is resolved without ever making the flush
+  wait. Prints the throughput of the drain and flush path.
+*/
+
+#define ESP8266
+
+// Short intervals, waited for by the tests
+#define LOG_SYSLOG_RESOLVE_RETRY_MILLIS 100
+#define LOG_SYSLOG_RESOLVE_REFRESH_MILLIS 200
+
+#include <unity.h>
+
+#include "native_modules.h"
+
+#include <fcntl.h>
+
+#include <set>
+
+/**
+ * The collector: receives the datagrams on 127.0.0.1, and collects the sequence numbers of
+ * their RFC 5424 messages or framed lines.
+ */
+class Listener
+{
+private:
+    int socketFd;
+
+public:
+    uint16_t port = 0;
+    std::set<uint32_t> sequences;
+    uint32_t duplicates = 0;
+    uint32_t datagrams = 0;
+    uint64_t bytes = 0;
+    uint32_t mostLinesPerDatagram = 0;
+
+    Listener()
+    {
+        socketFd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in address = sockaddr_in();
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(socketFd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+        socklen_t length = sizeof(address);
+        getsockname(socketFd, reinterpret_cast<sockaddr *>(&address), &length);
+        port = ntohs(address.sin_port);
+        fcntl(socketFd, F_SETFL, O_NONBLOCK);
+    }
+    ~Listener() { close(socketFd); }
+
+    /**
+     * Reads the datagrams received so far.
+     */
+    void receive()
+    {
+        char datagram[2048];
+        ssize_t length;
+        while ((length = recv(socketFd, datagram, sizeof(datagram) - 1, 0)) > 0)
+        {
+            datagrams++;
+            bytes += length;
+            datagram[length] = '\0';
+            uint32_t lines = 0;
+            if (memcmp(datagram, "ELGU", 4) == 0)
+            {
+                // Framed: the sequence number of the first line, and the line count
+                size_t offset = 6 + (uint8_t)datagram[5];
+                uint32_t firstSequence;
+                uint16_t count;
+                memcpy(&firstSequence, datagram + offset, sizeof(firstSequence));
+                memcpy(&count, datagram + offset + 8, sizeof(count));
+                for (lines = 0; lines < count; lines++)
+                    collect(firstSequence + lines);
+            }
+            else
+            {
+                const char *message = datagram;
+                while ((message = strstr(message, "sequenceId=\"")) != nullptr)
+                {
+                    message += strlen("sequenceId=\"");
+                    collect(strtoul(message, nullptr, 10));
+                    lines++;
+                }
+            }
+            mostLinesPerDatagram = std::max(mostLinesPerDatagram, lines);
+        }
+    }
+
+private:
+    void collect(uint32_t sequence)
+    {
+        if (!sequences.insert(sequence).second)
+            duplicates++;
+    }
+};
+
+DeviceConfiguration configuration;
+
+void useCollector(const char *host, uint16_t port, uint8_t format = LOG_SYSLOG_RFC5424)
+{
+    strlcpy(configuration.syslogHost, host, sizeof(configuration.syslogHost));
+    configuration.syslogPort = port;
+    configuration.syslogFormat = format;
+    strlcpy(configuration.hostname, "native", sizeof(configuration.hostname));
+    currentDeviceConfiguration = &configuration;
+    flushLogSyslog(); // picks it up: lines are queued from then on
+}
+
+/**
+ * As the housekeeping task does, with a flush per logSyslogFlushIntervalMillis.
+ */
+void drainAndFlush()
+{
+    drainLogs();
+    flushLogSyslog();
+}
+
+void setUp()
+{
+    nativeDns = NativeDns();
+    nativeDns.names["collector.test"] = IPAddress(127, 0, 0, 1);
+    nativeDns.names["other.test"] = IPAddress(127, 0, 0, 1);
+}
+
+void tearDown()
+{
+    // No collector: the queue is freed, its counters start over with the next one
+    configuration.syslogHost[0] = '\0';
+    flushLogSyslog();
+    syslogSink = LogSyslogSink();
+    drainLogs();
+}
+
+void test_an_address_is_not_looked_up()
+{
+    Listener listener;
+    useCollector("127.0.0.1", listener.port);
+    LOGF_INFO("to an address");
+    drainAndFlush();
+    listener.receive();
+
+    TEST_ASSERT_EQUAL_UINT32(0, nativeDns.lookups);
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, listener.datagrams);
+}
+
+void test_the_flush_does_not_wait_for_the_dns_server()
+{
+    Listener listener;
+    nativeDns.cached = false;
+    useCollector("collector.test", listener.port);
+    LOGF_INFO("before the answer");
+    drainAndFlush();
+    listener.receive();
+    TEST_ASSERT_EQUAL_UINT32(1, nativeDns.lookups); // pending, not started again
+    TEST_ASSERT_EQUAL_UINT32(0, listener.datagrams);
+
+    TEST_ASSERT_TRUE(nativeDns.complete());
+    drainAndFlush();
+    listener.receive();
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, listener.datagrams);
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, listener.sequences.size()); // queued before the answer
+}
+
+void test_a_resolved_name_is_refreshed_in_the_background()
+{
+    Listener listener;
+    useCollector("collector.test", listener.port);
+    for (int i = 0; i < 10; i++)
+    {
+        LOGF_INFO("line %d", i);
+        drainAndFlush();
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, nativeDns.lookups);
+
+    delay(LOG_SYSLOG_RESOLVE_REFRESH_MILLIS + 20);
+    nativeDns.cached = false;
+    listener.receive();
+    size_t received = listener.sequences.size();
+    LOGF_INFO("while refreshing");
+    drainAndFlush();
+    listener.receive();
+    TEST_ASSERT_EQUAL_UINT32(2, nativeDns.lookups);
+    TEST_ASSERT_EQUAL(received + 1, listener.sequences.size()); // sent to the cached address
+}
+
+void test_a_failed_lookup_is_retried_after_the_retry_interval()
+{
+    Listener listener;
+    useCollector("unknown.test", listener.port);
+    drainAndFlush();
+    TEST_ASSERT_EQUAL_UINT32(1, nativeDns.lookups);
+
+    delay(LOG_SYSLOG_RESOLVE_RETRY_MILLIS + 20);
+    nativeDns.names["unknown.test"] = IPAddress(127, 0, 0, 1);
+    drainAndFlush();
+    listener.receive();
+    TEST_ASSERT_EQUAL_UINT32(2, nativeDns.lookups);
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, listener.datagrams);
+}
+
+void test_the_answer_for_a_previous_collector_is_ignored()
+{
+    Listener listener;
+    nativeDns.names["other.test"] = IPAddress(127, 0, 0, 2);
+    nativeDns.cached = false;
+    useCollector("other.test", listener.port);
+    useCollector("collector.test", listener.port);
+    TEST_ASSERT_EQUAL_UINT32(2, nativeDns.lookups);
+
+    TEST_ASSERT_TRUE(nativeDns.complete()); // other.test
+    TEST_ASSERT_FALSE(syslogResolved);
+    TEST_ASSERT_TRUE(nativeDns.complete());
+    TEST_ASSERT_TRUE(syslogResolved);
+    TEST_ASSERT_EQUAL_STRING("127.0.0.1", syslogAddress.toString().c_str());
+}
+
+void test_each_rfc5424_message_has_its_own_datagram()
+{
+    Listener listener;
+    useCollector("127.0.0.1", listener.port);
+    drainAndFlush();
+    listener.receive();
+    uint32_t datagrams = listener.datagrams;
+    for (int i = 0; i < 2 * LOG_SYSLOG_MESSAGES_PER_FLUSH; i++)
+        LOGF_INFO("line %d", i);
+    drainAndFlush();
+    listener.receive();
+
+    TEST_ASSERT_EQUAL_UINT32(datagrams + LOG_SYSLOG_MESSAGES_PER_FLUSH, listener.datagrams); // the budget of a flush
+    TEST_ASSERT_EQUAL_UINT32(1, listener.mostLinesPerDatagram);
+    flushLogSyslog();
+    listener.receive();
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, listener.datagrams);
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, listener.sequences.size());
+}
+
+void test_framed_lines_are_batched()
+{
+    Listener listener;
+    useCollector("127.0.0.1", listener.port, LOG_SYSLOG_FRAMED);
+    for (int i = 0; i < 2 * LOG_SYSLOG_MESSAGES_PER_FLUSH; i++)
+        LOGF_INFO("line %d", i);
+    drainAndFlush();
+    listener.receive();
+
+    TEST_ASSERT_EQUAL_UINT32(1, listener.datagrams);
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, listener.sequences.size());
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, *listener.sequences.rbegin()); // no gap
+}
+
+/**
+ * rounds flushes, each after lines lines were logged. Returns the lines per second through
+ * drainLogs() and flushLogSyslog().
+ */
+double shipLines(Listener &listener, int rounds, int lines)
+{
+    unsigned long begin = micros();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int line = 0; line < lines; line++)
+            LOGF_INFO("round %d, line %d of the shipping test", round, line);
+        drainAndFlush();
+        listener.receive();
+    }
+    unsigned long elapsed = micros() - begin;
+    // The rest of the queue
+    while (syslogSink.length > 0)
+    {
+        flushLogSyslog();
+        listener.receive();
+    }
+    return elapsed > 0 ? rounds * lines * 1e6 / elapsed : 0;
+}
+
+void reportShipping(const char *name, const Listener &listener, double linesPerSecond)
+{
+    char message[160];
+    snprintf(message, sizeof(message), "%s: %u lines in %u datagrams, %u dropped, %.0f lines/s, %.1f lines per datagram",
+             name, (unsigned)listener.sequences.size(), (unsigned)listener.datagrams, (unsigned)syslogSink.droppedLines,
+             linesPerSecond, (double)listener.sequences.size() / listener.datagrams);
+    TEST_MESSAGE(message);
+}
+
+void test_every_line_within_capacity_is_received()
+{
+    Listener listener;
+    useCollector("127.0.0.1", listener.port);
+    double linesPerSecond = shipLines(listener, 500, 8);
+    reportShipping("within capacity", listener, linesPerSecond);
+
+    TEST_ASSERT_EQUAL_UINT32(0, syslogSink.droppedLines);
+    TEST_ASSERT_EQUAL_UINT32(0, listener.duplicates);
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, listener.sequences.size());
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, *listener.sequences.rbegin()); // no gap
+}
+
+void test_lines_beyond_capacity_are_counted_as_dropped()
+{
+    Listener listener;
+    useCollector("127.0.0.1", listener.port);
+    double linesPerSecond = shipLines(listener, 500, 30);
+    reportShipping("overloaded", listener, linesPerSecond);
+
+    TEST_ASSERT_TRUE(syslogSink.droppedLines > 0);
+    TEST_ASSERT_EQUAL_UINT32(0, listener.duplicates);
+    TEST_ASSERT_EQUAL_UINT32(syslogSink.lines, listener.sequences.size() + syslogSink.droppedLines);
+    TEST_ASSERT_EQUAL_UINT32(0, logRing.dropped()); // lost by the sink, not before
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_an_address_is_not_looked_up);
+    RUN_TEST(test_the_flush_does_not_wait_for_the_dns_server);
+    RUN_TEST(test_a_resolved_name_is_refreshed_in_the_background);
+    RUN_TEST(test_a_failed_lookup_is_retried_after_the_retry_interval);
+    RUN_TEST(test_the_answer_for_a_previous_collector_is_ignored);
+    RUN_TEST(test_each_rfc5424_message_has_its_own_datagram);
+    RUN_TEST(test_framed_lines_are_batched);
+    RUN_TEST(test_every_line_within_capacity_is_received);
+    RUN_TEST(test_lines_beyond_capacity_are_counted_as_dropped);
+    return UNITY_END();
+}
@@ -0,0 +1,150 @@
+/*
+  Fan-out of the log lines to the /wsLogs clients (log_websocket.cpp): clients with the same
+  lines share one frame, so a flush builds and allocates as much for 8 clients as for one.
+  Prints the time per flush as the clients grow.
+*/
+
+#define ESP8266
+#define LOG_WEBSOCKET_MAX_CLIENTS 8
+
+#include <unity.h>
+
+#include "allocation_counter.h"
+#include "native_modules.h"
+
+void connectClients(uint32_t count)
+{
+    for (uint32_t id = 1; id <= count; id++)
+    {
+        wsLogs.clients.emplace_back(id);
+        TEST_ASSERT_TRUE(addLogWebsocketClient(id));
+    }
+}
+
+void logIncident(int round)
+{
+    for (int line = 0; line < 10; line++)
+        LOGF_WARN("round %d, line %d of the incident", round, line);
+    drainLogs();
+}
+
+void deliverFrames()
+{
+    for (AsyncWebSocketClient &client : wsLogs.clients)
+        client.deliver();
+}
+
+void setUp()
+{
+    countingAllocations = false;
+}
+
+void tearDown()
+{
+    for (AsyncWebSocketClient &client : wsLogs.clients)
+        removeLogWebsocketClient(client.id());
+    wsLogs.clients.clear();
+}
+
+void test_clients_with_the_same_lines_share_one_frame()
+{
+    connectClients(LOG_WEBSOCKET_MAX_CLIENTS);
+    uint32_t built = framesBuilt;
+    logIncident(0);
+    flushLogWebsocket();
+
+    TEST_ASSERT_EQUAL_UINT32(built + 1, framesBuilt);
+    AsyncWebSocketSharedBuffer first = wsLogs.clients.front().queue.at(0);
+    TEST_ASSERT_TRUE(strstr(std::string(first->begin(), first->end()).c_str(), "line 9 of the incident") != nullptr);
+    for (AsyncWebSocketClient &client : wsLogs.clients)
+    {
+        TEST_ASSERT_EQUAL(1, client.queue.size());
+        TEST_ASSERT_TRUE(client.queue[0] == first);
+    }
+}
+
+void test_a_client_with_another_subscription_gets_its_own_frame()
+{
+    connectClients(4);
+    const char subscription[] = "{\"filter\": \"line 3\"}";
+    subscribeLogWebsocket(4, reinterpret_cast<const uint8_t *>(subscription), strlen(subscription));
+    uint32_t built = framesBuilt;
+    logIncident(0);
+    flushLogWebsocket();
+    deliverFrames();
+
+    TEST_ASSERT_EQUAL_UINT32(built + 2, framesBuilt);
+    const std::string &filtered = wsLogs.client(4)->received.at(0);
+    TEST_ASSERT_TRUE(filtered.find("line 3 of") != std::string::npos);
+    TEST_ASSERT_TRUE(filtered.find("line 4 of") == std::string::npos);
+}
+
+void test_a_slow_client_does_not_hold_the_others_back()
+{
+    connectClients(2);
+    for (int round = 0; round < 5; round++)
+    {
+        logIncident(round);
+        flushLogWebsocket();
+        wsLogs.client(1)->deliver(); // client 2 never sends its frames
+    }
+
+    TEST_ASSERT_EQUAL(5, wsLogs.client(1)->received.size());
+    TEST_ASSERT_EQUAL(WS_MAX_QUEUED_MESSAGES, wsLogs.client(2)->queue.size());
+}
+
+void test_the_cost_of_a_flush_does_not_grow_with_the_clients()
+{
+    const int rounds = 200;
+    uint32_t allocationsForOne = 0;
+    size_t bytesForOne = 0;
+    for (uint32_t clients = 1; clients <= LOG_WEBSOCKET_MAX_CLIENTS; clients *= 2)
+    {
+        connectClients(clients);
+        // Once, so that the stand-in's own queues have grown
+        logIncident(0);
+        flushLogWebsocket();
+        deliverFrames();
+
+        allocations = 0;
+        allocatedBytes = 0;
+        uint32_t built = framesBuilt;
+        unsigned long elapsed = 0;
+        for (int round = 0; round < rounds; round++)
+        {
+            logIncident(round);
+            unsigned long begin = micros();
+            countingAllocations = true;
+            flushLogWebsocket();
+            countingAllocations = false;
+            elapsed += micros() - begin;
+            deliverFrames();
+        }
+
+        char message[128];
+        snprintf(message, sizeof(message), "%u clients: %.1f allocations, %u bytes, %.2f us per flush",
+                 (unsigned)clients, (double)allocations / rounds, (unsigned)(allocatedBytes / rounds), (double)elapsed / rounds);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_EQUAL_UINT32(rounds, framesBuilt - built);
+        if (clients == 1)
+        {
+            allocationsForOne = allocations;
+            bytesForOne = allocatedBytes;
+        }
+        TEST_ASSERT_EQUAL_UINT32(allocationsForOne, allocations);
+        TEST_ASSERT_EQUAL(bytesForOne, allocatedBytes);
+        for (AsyncWebSocketClient &client : wsLogs.clients)
+            TEST_ASSERT_EQUAL(rounds + 1, client.received.size());
+        tearDown();
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_clients_with_the_same_lines_share_one_frame);
+    RUN_TEST(test_a_client_with_another_subscription_gets_its_own_frame);
+    RUN_TEST(test_a_slow_client_does_not_hold_the_others_back);
+    RUN_TEST(test_the_cost_of_a_flush_does_not_grow_with_the_clients);
+    return UNITY_END();
+}
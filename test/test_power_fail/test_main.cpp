@@ -0,0 +1,140 @@
+/*
+  Power cuts during commits, on ESP32: every storage backend must leave either the previous
+  or the new image, whatever flash operation the power is cut at (see flash_snapshot.h).
+*/
+
+#define ESP32
+
+#include <unity.h>
+
+#include "native_modules.h"
+
+#include "common/eeprom_session.h"
+#include "flash_snapshot.h"
+
+const size_t storageSize = EEPROM_SIZE + STORAGE_SCRATCH_SIZE;
+
+void setUp()
+{
+    memset(EEPROM.sector, 0xFF, sizeof(EEPROM.sector));
+    LittleFS.format();
+    Preferences::nvsKeys.clear();
+    memset(partitionFlash, 0xFF, sizeof(partitionFlash));
+    partitionPresent = true;
+}
+
+void tearDown()
+{
+    powerCutBudget = -1;
+}
+
+void checkEveryCommit(const BackendFactory &makeBackend)
+{
+    std::vector<StorageImage> images = storageImages(storageSize);
+    StorageImage current(storageSize, 0xFF);
+    uint32_t cuts = 0;
+    for (const StorageImage &next : images)
+    {
+        StorageImage further(next);
+        further[storageSize / 2] ^= 0x5A;
+        cuts += checkCommitSurvivesPowerCuts(makeBackend, current, next, further);
+        current = next;
+    }
+    TEST_ASSERT_GREATER_THAN(images.size(), cuts);
+}
+
+void test_partition_commits_survive_power_cuts()
+{
+    checkEveryCommit([]()
+                     { return std::unique_ptr<StorageBackend>(new PartitionStorageBackend("config")); });
+}
+
+void test_partition_commits_rotate_over_the_sectors()
+{
+    PartitionStorageBackend backend("config");
+    TEST_ASSERT_TRUE(backend.begin(storageSize));
+    uint32_t sectors = NATIVE_PARTITION_SIZE / SPI_FLASH_SEC_SIZE;
+    for (uint32_t commit = 1; commit <= 2 * sectors; commit++)
+    {
+        backend.writeData()[0] = commit;
+        TEST_ASSERT_TRUE(backend.commit(0, 1));
+        TEST_ASSERT_EQUAL_UINT32(commit, backend.getGeneration());
+    }
+    backend.end();
+
+    TEST_ASSERT_TRUE(backend.begin(storageSize));
+    TEST_ASSERT_EQUAL_UINT32(2 * sectors, backend.getGeneration());
+    TEST_ASSERT_EQUAL_UINT8(2 * sectors, backend.readData()[0]);
+}
+
+void test_nvs_commits_survive_power_cuts()
+{
+    checkEveryCommit([]()
+                     { return std::unique_ptr<StorageBackend>(new NvsStorageBackend("storage")); });
+}
+
+void test_nvs_reads_the_pages_of_earlier_firmwares()
+{
+    // One key per page, and no head
+    StorageImage image = storageImages(storageSize).back();
+    Preferences preferences;
+    preferences.begin("storage");
+    char key[8];
+    for (size_t page = 0; page * NvsStorageBackend::pageSize < storageSize; page++)
+    {
+        snprintf(key, sizeof(key), "p%u", (unsigned)page);
+        preferences.putBytes(key, image.data() + page * NvsStorageBackend::pageSize,
+                             std::min(NvsStorageBackend::pageSize, storageSize - page * NvsStorageBackend::pageSize));
+    }
+
+    NvsStorageBackend backend("storage");
+    TEST_ASSERT_TRUE(backend.begin(storageSize));
+    TEST_ASSERT_EQUAL_UINT32(0, backend.getGeneration());
+    TEST_ASSERT_TRUE(readsAs(backend, image));
+}
+
+void test_nvs_commit_writes_only_the_touched_pages()
+{
+    NvsStorageBackend backend("storage");
+    TEST_ASSERT_TRUE(backend.begin(storageSize));
+    uint32_t puts = Preferences::puts;
+    backend.writeData()[63] = 1;
+    backend.writeData()[64] = 2;
+    TEST_ASSERT_TRUE(backend.commit(63, 65));
+
+    TEST_ASSERT_EQUAL_UINT32(3, Preferences::puts - puts); // two pages and the head
+}
+
+void test_littlefs_commits_survive_power_cuts()
+{
+    checkEveryCommit([]()
+                     { return std::unique_ptr<StorageBackend>(new LittleFsStorageBackend("/storage.bin")); });
+}
+
+void test_littlefs_is_not_formatted_when_it_does_not_mount()
+{
+    LittleFS.formatted = false;
+    LittleFsStorageBackend backend("/storage.bin");
+    TEST_ASSERT_FALSE(backend.begin(storageSize));
+    TEST_ASSERT_FALSE(LittleFS.formatted);
+}
+
+void test_eeprom_commits_survive_power_cuts()
+{
+    checkEveryCommit([]()
+                     { return std::unique_ptr<StorageBackend>(new EepromStorageBackend()); });
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_partition_commits_survive_power_cuts);
+    RUN_TEST(test_partition_commits_rotate_over_the_sectors);
+    RUN_TEST(test_nvs_commits_survive_power_cuts);
+    RUN_TEST(test_nvs_reads_the_pages_of_earlier_firmwares);
+    RUN_TEST(test_nvs_commit_writes_only_the_touched_pages);
+    RUN_TEST(test_littlefs_commits_survive_power_cuts);
+    RUN_TEST(test_littlefs_is_not_formatted_when_it_does_not_mount);
+    RUN_TEST(test_eeprom_commits_survive_power_cuts);
+    return UNITY_END();
+}
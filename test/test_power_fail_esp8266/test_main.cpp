@@ -0,0 +1,105 @@
+/*
+  Power cuts during commits, on ESP8266: the EEPROM library erases its single sector before
+  programming it, the backup copy on LittleFS must cover that window (see flash_snapshot.h).
+*/
+
+#define ESP8266
+
+#include <unity.h>
+
+#include "native_modules.h"
+
+#include "common/eeprom_session.h"
+#include "flash_snapshot.h"
+
+const size_t storageSize = EEPROM_SIZE + STORAGE_SCRATCH_SIZE;
+
+BackendFactory makeEepromBackend = []()
+{ return std::unique_ptr<StorageBackend>(new EepromStorageBackend()); };
+
+void setUp()
+{
+    memset(EEPROM.sector, 0xFF, sizeof(EEPROM.sector));
+    LittleFS.format();
+}
+
+void tearDown()
+{
+    powerCutBudget = -1;
+}
+
+void test_eeprom_commits_survive_power_cuts()
+{
+    std::vector<StorageImage> images = storageImages(storageSize);
+    StorageImage current(storageSize, 0xFF);
+    for (const StorageImage &next : images)
+    {
+        StorageImage further(next);
+        further[storageSize / 2] ^= 0x5A;
+        checkCommitSurvivesPowerCuts(makeEepromBackend, current, next, further);
+        current = next;
+    }
+}
+
+void test_eeprom_restores_the_backup_of_a_torn_sector()
+{
+    StorageImage image = storageImages(storageSize).back();
+    commitImage(makeEepromBackend, image, -1);
+    // Cut while programming the sector, after the backup was replaced
+    StorageImage next(image);
+    next[0] ^= 0xFF;
+    commitImage(makeEepromBackend, next, EEPROMClass::sectorSize + 100 + 4);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, EEPROM.sector[storageSize]); // the trailer is not programmed
+
+    std::unique_ptr<StorageBackend> restarted = startBackend(makeEepromBackend, storageSize);
+    TEST_ASSERT_TRUE(readsAs(*restarted, next));
+    TEST_ASSERT_NOT_EQUAL(0xFF, EEPROM.sector[storageSize]); // and the sector is whole again
+}
+
+void test_eeprom_reads_the_sector_of_earlier_firmwares()
+{
+    // No trailer, and no backup
+    StorageImage image = storageImages(storageSize).back();
+    memcpy(EEPROM.sector, image.data(), storageSize);
+
+    std::unique_ptr<StorageBackend> backend = startBackend(makeEepromBackend, storageSize);
+    TEST_ASSERT_TRUE(readsAs(*backend, image));
+}
+
+void test_eeprom_commits_without_littlefs()
+{
+    LittleFS.formatted = false;
+    StorageImage image = storageImages(storageSize).back();
+    commitImage(makeEepromBackend, image, -1);
+
+    std::unique_ptr<StorageBackend> backend = startBackend(makeEepromBackend, storageSize);
+    TEST_ASSERT_TRUE(readsAs(*backend, image));
+    TEST_ASSERT_FALSE(LittleFS.formatted); // left as is, for another firmware to recover
+    TEST_ASSERT_FALSE(LittleFS.exists("/storage.bak"));
+}
+
+void test_littlefs_commits_survive_power_cuts()
+{
+    BackendFactory makeBackend = []()
+    { return std::unique_ptr<StorageBackend>(new LittleFsStorageBackend("/storage.bin")); };
+    std::vector<StorageImage> images = storageImages(storageSize);
+    StorageImage current(storageSize, 0xFF);
+    for (const StorageImage &next : images)
+    {
+        StorageImage further(next);
+        further[storageSize / 2] ^= 0x5A;
+        checkCommitSurvivesPowerCuts(makeBackend, current, next, further);
+        current = next;
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_eeprom_commits_survive_power_cuts);
+    RUN_TEST(test_eeprom_restores_the_backup_of_a_torn_sector);
+    RUN_TEST(test_eeprom_reads_the_sector_of_earlier_firmwares);
+    RUN_TEST(test_eeprom_commits_without_littlefs);
+    RUN_TEST(test_littlefs_commits_survive_power_cuts);
+    return UNITY_END();
+}
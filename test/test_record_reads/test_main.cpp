@@ -0,0 +1,78 @@
+/*
+  readDataFromEeprom() checks the record in place and copies it once into the caller's
+  struct: it must not allocate. Every heap allocation of the process is counted, around
+  reads from the EEPROM backend over the stand-in EEPROM library.
+*/
+
+#define ESP8266
+
+#include <unity.h>
+
+#include "allocation_counter.h"
+#include "native_modules.h"
+
+#include "common/device_configuration.h"
+#include "common/eeprom_layout.h"
+#include "common/eeprom_utils.tpp"
+
+const int address = CommonEepromLayout::address<DeviceConfiguration>();
+const int reads = 100;
+
+void setUp()
+{
+    allocations = 0;
+    countingAllocations = false;
+}
+
+void tearDown()
+{
+    countingAllocations = false;
+}
+
+void test_reading_a_stored_configuration_does_not_allocate()
+{
+    DeviceConfiguration stored("home", "secret", "node-7", "pump", "token", true, "logs.local", 5514, 1);
+    writeDataToEeprom<DeviceConfiguration>(address, &stored);
+
+    DeviceConfiguration read;
+    countingAllocations = true;
+    for (int i = 0; i < reads; i++)
+        TEST_ASSERT_TRUE(readDataFromEeprom<DeviceConfiguration>(address, read));
+    countingAllocations = false;
+
+    TEST_ASSERT_EQUAL_UINT32(0, allocations);
+    TEST_ASSERT_EQUAL_MEMORY(&stored, &read, sizeof(DeviceConfiguration));
+}
+
+void test_reading_an_invalidated_configuration_does_not_allocate()
+{
+    DeviceConfiguration stored("home", "secret", "node-7", "pump", "token");
+    writeDataToEeprom<DeviceConfiguration>(address, &stored);
+    invalidateEepromData<DeviceConfiguration>(address);
+
+    DeviceConfiguration read;
+    countingAllocations = true;
+    for (int i = 0; i < reads; i++)
+        TEST_ASSERT_FALSE(readDataFromEeprom<DeviceConfiguration>(address, read));
+    countingAllocations = false;
+
+    TEST_ASSERT_EQUAL_UINT32(0, allocations);
+}
+
+void test_the_counter_sees_allocations()
+{
+    countingAllocations = true;
+    String text("a string longer than the small string buffer of the host");
+    countingAllocations = false;
+
+    TEST_ASSERT_GREATER_THAN(0, allocations);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_the_counter_sees_allocations);
+    RUN_TEST(test_reading_a_stored_configuration_does_not_allocate);
+    RUN_TEST(test_reading_an_invalidated_configuration_does_not_allocate);
+    return UNITY_END();
+}
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Decodes a binary log dump, taken from http://<device-ip>/logs?binary.
+
+Deferred-format records (LOGF_xxx() macros) only hold the address of their format string:
+it is read from the firmware ELF the device runs, e.g. .pio/build/esp32dev/firmware.elf.
+
+    curl -o logs.bin "http://<device-ip>/logs?binary"
+    python3 tools/decode_logs.py .pio/build/esp32dev/firmware.elf logs.bin
+
+The dump layout is described in src/common/log_history.h, the arguments in log_format.h.
+"""
+
+import argparse
+import re
+import struct
+import sys
+import urllib.request
+
+# Keep in sync with src/common/log.cpp and log_ring.h
+LEVEL_LETTERS = "-EWIDT"
+MODULE_NAMES = ["main", "wifi", "server", "ota", "config", "storage", "logs", "project"]
+FLAG_NEWLINE = 2
+FLAG_FORMAT = 4
+
+SPEC_PATTERN = re.compile(r"%([-+ #0]*)(\d*)(?:\.(\d+))?(?:hh|h|ll|l|L|q|j|z|t)?([diouxXcsfFeEgGaAp%])")
+
+
+class Elf:
+    """Allocated sections of an ELF file, enough to read strings at their run-time address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as file:
+            self.data = file.read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError(f"{path} is not an ELF file")
+        is64 = self.data[4] == 2
+        endian = "<" if self.data[5] == 1 else ">"
+        if is64:
+            shoff, = struct.unpack_from(endian + "Q", self.data, 0x28)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x3A)
+            section_format = endian + "IIQQQQ"
+        else:
+            shoff, = struct.unpack_from(endian + "I", self.data, 0x20)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x2E)
+            section_format = endian + "IIIIII"
+        self.sections = []
+        for index in range(shnum):
+            _, kind, flags, address, offset, size = struct.unpack_from(section_format, self.data, shoff + index * shentsize)
+            allocated = flags & 0x2
+            if allocated and kind != 8 and address != 0:  # 8: SHT_NOBITS, e.g. .bss
+                self.sections.append((address, offset, size))
+
+    def string_at(self, address):
+        for start, offset, size in self.sections:
+            if start <= address < start + size:
+                begin = offset + address - start
+                end = self.data.index(b"\0", begin)
+                return self.data[begin:end].decode("utf-8", "replace")
+        return None
+
+
+def read_arguments(payload):
+    arguments = []
+    offset = 0
+    while offset < len(payload):
+        kind = chr(payload[offset])
+        offset += 1
+        if kind in "iu":
+            value, = struct.unpack_from("<i" if kind == "i" else "<I", payload, offset)
+            arguments.append((kind, value, 32))
+            offset += 4
+        elif kind in "IU":
+            value, = struct.unpack_from("<q" if kind == "I" else "<Q", payload, offset)
+            arguments.append((kind.lower(), value, 64))
+            offset += 8
+        elif kind == "d":
+            value, = struct.unpack_from("<d", payload, offset)
+            arguments.append(("d", value, 64))
+            offset += 8
+        elif kind == "s":
+            length = payload[offset]
+            arguments.append(("s", payload[offset + 1:offset + 1 + length].decode("utf-8", "replace"), 0))
+            offset += 1 + length
+        else:
+            break  # unknown type: the rest cannot be parsed
+    return arguments
+
+
+def format_argument(flags, width, precision, conversion, argument):
+    """As appendArgument() in log_format.cpp: the stored type decides the conversion."""
+    kind, value, bits = argument
+    spec = "%" + flags + width + ("." + precision if precision else "")
+    if kind in "iu":
+        if conversion == "c":
+            return (spec + "c") % chr(value & 0xFF)
+        if conversion in "ouxX":
+            return (spec + conversion) % (value & ((1 << bits) - 1))
+        return (spec + "d") % value
+    if kind == "d":
+        return (spec + (conversion if conversion in "fFeEgG" else "g")) % value
+    return (spec + "s") % value
+
+
+def format_record(format_string, payload):
+    arguments = read_arguments(payload)
+
+    def replace(match):
+        flags, width, precision, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        if not arguments:
+            return "<?>"
+        return format_argument(flags, width, precision, conversion, arguments.pop(0))
+
+    return SPEC_PATTERN.sub(replace, format_string)
+
+
+def decode(elf, dump, out):
+    if dump[:4] != b"ELOG" or dump[4] != 1:
+        raise ValueError("not a /logs?binary dump")
+    pointer_size = dump[5]
+    version_length = dump[6]
+    version = dump[7:7 + version_length].decode()
+    print(f"# firmware {version}", file=sys.stderr)
+    offset = 7 + version_length
+    at_line_start = True
+    while offset + 4 <= len(dump):
+        length, flags, tag = struct.unpack_from("<HBB", dump, offset)
+        payload = dump[offset + 4:offset + 4 + length]
+        offset += 4 + length
+
+        if at_line_start:
+            level, module = tag & 0x07, tag >> 3
+            letter = LEVEL_LETTERS[level] if level < len(LEVEL_LETTERS) else "?"
+            name = MODULE_NAMES[module] if module < len(MODULE_NAMES) else "?"
+            out.write(f"[{letter}][{name}] ")
+        if flags & FLAG_FORMAT:
+            address = int.from_bytes(payload[:pointer_size], "little")
+            format_string = elf.string_at(address) if elf else None
+            if format_string is None:
+                out.write(f"<format at 0x{address:08x} not found, wrong firmware?>")
+            else:
+                out.write(format_record(format_string, payload[pointer_size:]))
+        else:
+            out.write(payload.decode("utf-8", "replace"))
+        at_line_start = bool(flags & FLAG_NEWLINE)
+        if at_line_start:
+            out.write("\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="firmware ELF the device runs")
+    parser.add_argument("dump", help="dump file, or the http:// URL of /logs?binary")
+    args = parser.parse_args()
+
+    if args.dump.startswith("http://"):
+        with urllib.request.urlopen(args.dump) as response:
+            dump = response.read()
+    else:
+        with open(args.dump, "rb") as file:
+            dump = file.read()
+    decode(Elf(args.elf), dump, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
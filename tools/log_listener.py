@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""Receives the logs shipped by devices over UDP, see src/common/log_syslog.h.
+
+Both formats are accepted: RFC 5424 syslog and framed. Lines are printed, and every
+--report seconds the throughput and the loss: the gaps in each device's sequence numbers,
+lines dropped by its queue and lost on the network alike.
+
+    python3 tools/log_listener.py --port 5514
+
+Then set the log collector of the device (/configure) to this computer, port 5514.
+"""
+
+import argparse
+import re
+import socket
+import struct
+import sys
+import time
+
+# Keep in sync with src/common/log.cpp
+LEVEL_LETTERS = "-EWIDT"
+MODULE_NAMES = ["main", "wifi", "server", "ota", "config", "storage", "logs", "project"]
+SEVERITY_LETTERS = {3: "E", 4: "W", 6: "I", 7: "D"}
+
+SYSLOG_PATTERN = re.compile(
+    rb'<(\d+)>1 \S+ (\S+) (\S+) \S+ \S+ \[meta sequenceId="(\d+)" sysUpTime="(\d+)"\] ?(.*)')
+
+
+class Device:
+    def __init__(self):
+        self.expected = None
+        self.lines = 0
+        self.lost = 0
+        self.late = 0
+        self.dropped_by_device = None  # framed format only
+
+    def received(self, sequence):
+        self.lines += 1
+        if self.expected is not None and sequence == 1 and self.expected > 2:
+            self.expected = None  # restarted
+        if self.expected is None or sequence >= self.expected:
+            if self.expected is not None:
+                self.lost += sequence - self.expected
+            self.expected = sequence + 1
+        else:
+            # Reordered by the network: counted as lost when its gap was seen
+            self.late += 1
+            self.lost -= 1
+
+
+def parse_syslog(datagram):
+    """(hostname, sequence, uptime in ms, level letter, module, text) per message."""
+    for message in datagram.split(b"\n"):
+        match = SYSLOG_PATTERN.match(message)
+        if match is None:
+            continue
+        priority, hostname, module, sequence, uptime, text = match.groups()
+        letter = SEVERITY_LETTERS.get(int(priority) % 8, "?")
+        yield (hostname.decode(), int(sequence), int(uptime) * 10, letter, module.decode(),
+               text.decode("utf-8", "replace"))
+
+
+def parse_framed(datagram, devices):
+    if datagram[4] != 1:
+        raise ValueError(f"unknown framed version {datagram[4]}")
+    hostname_length = datagram[5]
+    hostname = datagram[6:6 + hostname_length].decode()
+    offset = 6 + hostname_length
+    sequence, dropped, count = struct.unpack_from("<IIH", datagram, offset)
+    offset += 10
+    devices.setdefault(hostname, Device()).dropped_by_device = dropped
+    for _ in range(count):
+        uptime, tag, length = struct.unpack_from("<IBH", datagram, offset)
+        offset += 7
+        text = datagram[offset:offset + length].decode("utf-8", "replace")
+        offset += length
+        level, module = tag & 0x07, tag >> 3
+        letter = LEVEL_LETTERS[level] if level < len(LEVEL_LETTERS) else "?"
+        name = MODULE_NAMES[module] if module < len(MODULE_NAMES) else "?"
+        yield hostname, sequence, uptime, letter, name, text
+        sequence += 1
+
+
+def report(devices, datagrams, bytes_received, elapsed, out):
+    lines = sum(device.lines for device in devices.values())
+    lost = sum(device.lost for device in devices.values())
+    total = lines + lost
+    print(f"# {elapsed:.1f}s: {datagrams} datagrams, {bytes_received} bytes, {lines} lines "
+          f"({lines / elapsed if elapsed else 0:.1f}/s), {lost} lost "
+          f"({100.0 * lost / total if total else 0:.2f}%)", file=out)
+    for hostname, device in sorted(devices.items()):
+        dropped = "" if device.dropped_by_device is None else f", {device.dropped_by_device} dropped by the device"
+        print(f"#   {hostname or '-'}: {device.lines} lines, {device.lost} lost, {device.late} late{dropped}", file=out)
+    out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=5514, help="UDP port, 5514 by default (514 needs root)")
+    parser.add_argument("--bind", default="0.0.0.0", help="address to listen on")
+    parser.add_argument("--quiet", action="store_true", help="only print the reports")
+    parser.add_argument("--report", type=float, default=10, help="seconds between two reports")
+    parser.add_argument("--duration", type=float, help="stop after that many seconds")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    sock.bind((args.bind, args.port))
+    sock.settimeout(0.5)
+
+    devices = {}
+    datagrams = 0
+    bytes_received = 0
+    start = time.monotonic()
+    next_report = start + args.report
+    try:
+        while args.duration is None or time.monotonic() - start < args.duration:
+            try:
+                datagram, _ = sock.recvfrom(65535)
+            except socket.timeout:
+                datagram = None
+            if datagram:
+                datagrams += 1
+                bytes_received += len(datagram)
+                if datagram[:4] == b"ELGU":
+                    records = parse_framed(datagram, devices)
+                else:
+                    records = parse_syslog(datagram)
+                for hostname, sequence, uptime, letter, module, text in records:
+                    devices.setdefault(hostname, Device()).received(sequence)
+                    if not args.quiet:
+                        print(f"{hostname} {uptime / 1000:10.3f} [{letter}][{module}] {text}")
+            if time.monotonic() >= next_report:
+                report(devices, datagrams, bytes_received, time.monotonic() - start, sys.stderr)
+                next_report += args.report
+    except KeyboardInterrupt:
+        pass
+    report(devices, datagrams, bytes_received, time.monotonic() - start, sys.stderr)
+
+
+if __name__ == "__main__":
+    main()